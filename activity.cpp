@@ -0,0 +1,85 @@
+#include "activity.h"
+#include "timer_queue.h"
+
+namespace term_screen {
+
+static int s_monitored = 0;
+static uint64_t s_generation = 0;
+
+Activity::~Activity() {
+  TimerQueue::Instance().Cancel(m_timer);
+  if (m_monitor != MONITOR::NONE) {
+    --s_monitored;
+  }
+  // the panes after this one are numbered one less
+  ++s_generation;
+}
+
+void Activity::Raise() {
+  if (!m_alert) {
+    m_alert = true;
+    ++s_generation;
+  }
+}
+
+void Activity::Watched(bool focused) {
+  switch (m_monitor) {
+  case MONITOR::NONE:
+    break;
+  case MONITOR::ACTIVITY:
+    if (!focused) {
+      Raise();
+    }
+    break;
+  case MONITOR::SILENCE:
+    if (m_silent) {
+      m_silent = false;
+      Arm(m_silence);
+    }
+    break;
+  }
+}
+
+void Activity::Arm(Clock::duration delay) {
+  auto ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+  m_timer = TimerQueue::Instance().Add(ms, [this]() {
+    m_timer = 0;
+    auto quiet = Clock::now() - std::max(m_last, m_since);
+    if (quiet >= m_silence) {
+      m_silent = true;
+      Raise();
+    } else {
+      Arm(m_silence - quiet);
+    }
+  });
+}
+
+void Activity::Monitor(MONITOR monitor, Clock::duration silence) {
+  TimerQueue::Instance().Cancel(m_timer);
+  m_timer = 0;
+  m_silent = false;
+  if ((m_monitor != MONITOR::NONE) != (monitor != MONITOR::NONE)) {
+    s_monitored += monitor != MONITOR::NONE ? 1 : -1;
+  }
+  m_monitor = monitor;
+  m_silence = silence;
+  m_alert = m_alert && monitor != MONITOR::NONE;
+  m_since = Clock::now();
+  if (monitor == MONITOR::SILENCE) {
+    Arm(silence);
+  }
+  ++s_generation;
+}
+
+void Activity::Clear() {
+  if (m_alert) {
+    m_alert = false;
+    ++s_generation;
+  }
+}
+
+int Activity::Monitored() { return s_monitored; }
+
+uint64_t Activity::Generation() { return s_generation; }
+
+} // namespace term_screen
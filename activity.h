@@ -0,0 +1,82 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <span>
+#include <stdint.h>
+
+namespace term_screen {
+
+enum class MONITOR : uint8_t {
+  NONE,
+  // alert when the pane prints while it is not focused
+  ACTIVITY,
+  // alert when the pane prints nothing for a while
+  SILENCE,
+};
+
+// The output counters of a pane and the alerts raised from them.
+//
+// Output runs for every chunk the event loop reads, so it only counts and
+// remembers the time of the loop turn. Silence is noticed by a timer set
+// for the earliest time the pane could have been quiet long enough; when
+// it fires after more output it is set again for the rest, so no pane is
+// ever polled. Only used from the main thread.
+class Activity {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  uint64_t m_bytes = 0;
+  uint64_t m_lines = 0;
+  Clock::time_point m_last;
+
+  MONITOR m_monitor = MONITOR::NONE;
+  Clock::duration m_silence = {};
+  // when monitoring started, a pane that never printed is quiet since then
+  Clock::time_point m_since;
+  bool m_alert = false;
+  // the silence alert was raised and waits for output to set the timer
+  bool m_silent = false;
+  uint64_t m_timer = 0;
+
+  void Watched(bool focused);
+  void Arm(Clock::duration delay);
+  void Raise();
+
+public:
+  Activity() = default;
+  Activity(const Activity &) = delete;
+  Activity &operator=(const Activity &) = delete;
+  ~Activity();
+
+  // the read path, before the output is parsed
+  void Output(std::span<const char> data, Clock::time_point now,
+              bool focused) {
+    m_bytes += data.size();
+    m_lines += std::count(data.begin(), data.end(), '\n');
+    m_last = now;
+    if (m_monitor != MONITOR::NONE) {
+      Watched(focused);
+    }
+  }
+
+  uint64_t Bytes() const { return m_bytes; }
+  uint64_t Lines() const { return m_lines; }
+  // the last output, a default time_point if there was none
+  Clock::time_point Last() const { return m_last; }
+
+  // silence is how long the pane has to be quiet for MONITOR::SILENCE
+  void Monitor(MONITOR monitor,
+               Clock::duration silence = std::chrono::seconds(0));
+  MONITOR Monitoring() const { return m_monitor; }
+  // raised and shown until the pane is focused
+  bool Alert() const { return m_alert; }
+  void Clear();
+
+  // panes monitoring anything, the status line is shown while there are
+  static int Monitored();
+  // changes whenever a status line would look different
+  static uint64_t Generation();
+};
+
+} // namespace term_screen
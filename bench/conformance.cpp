@@ -0,0 +1,382 @@
+// Escape sequences against golden screens, and how long they take.
+//
+// Every case is a small screen, the bytes a program would write and the
+// rows and cursor a VT100 compatible terminal shows afterwards. Each one is
+// run on
+//   vtparser  vtwrite and the mtm.cpp handlers, read back from the pad
+//   node      NODE::parse, libvterm and the callbacks of a pane, read back
+//             from the published frame
+// fed once whole and once a byte at a time, so that a sequence split
+// between reads is covered too. Then the case is repeated, after a RIS,
+// and the fastest of a few passes is held against the budget of the case.
+// A wrong screen, a blown budget or one that is not measured yet fails the
+// run; the latter prints what to record, from this run. A case name and a
+// factor for the budgets can be given as arguments.
+#include "../mtm.h"
+#include "../node.h"
+#include "../term.h"
+#include "../utf8.h"
+#include "../vtparser.h"
+#include <algorithm>
+#include <chrono>
+#include <curses.h>
+#include <functional>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <wchar.h>
+
+using namespace term_screen;
+
+// bytes run through an emulator per timed pass
+static const size_t TIMED_BYTES = 64 * 1024;
+static const int PASSES = 3;
+
+enum EMULATOR_ID { ID_VTPARSER, ID_NODE, EMULATORS };
+
+struct CASE {
+  const char *Name;
+  SIZE Size;
+  const char *Input;
+  // UTF-8, trailing blanks left out, missing rows are blank
+  std::vector<const char *> Rows;
+  POS Cursor;
+  // nanoseconds per byte for vtparser and node, three times the slowest of
+  // three runs of a debug build (-O0), rounded up to 50; 0 is not measured
+  double Budget[EMULATORS];
+  // what vtparser shows instead, where it is known to differ
+  std::vector<const char *> VtparserRows = {};
+};
+
+static const CASE CASES[] = {
+    {"scroll",
+     {3, 10},
+     "1\r\n2\r\n3\r\n4",
+     {"2", "3", "4"},
+     {2, 1},
+     {4650, 0}},
+    {"wrap",
+     {3, 10},
+     "0123456789abc\r\nX",
+     {"0123456789", "abc", "X"},
+     {2, 1},
+     {1000, 0}},
+    {"nowrap",
+     {2, 10},
+     "\033[?7l0123456789abc",
+     {"012345678c"},
+     {0, 9},
+     {900, 0}},
+    {"insert-mode",
+     {1, 10},
+     "abcdef\r\033[4hXY",
+     {"XYabcdef"},
+     {0, 2},
+     {1000, 0}},
+    {"scroll-region",
+     {5, 10},
+     "1\r\n2\r\n3\r\n4\r\n5\033[2;4r\033[4;1H\nx",
+     {"1", "3", "4", "x", "5"},
+     {3, 1},
+     {700, 0}},
+    {"reverse-index",
+     {5, 10},
+     "1\r\n2\r\n3\r\n4\r\n5\033[2;4r\033[2;1H\033M",
+     {"1", "", "2", "3", "5"},
+     {1, 0},
+     {700, 0}},
+    {"scroll-up-down",
+     {5, 10},
+     "1\r\n2\r\n3\r\n4\r\n5\033[2;4r\033[S\033[2T",
+     {"1", "", "", "3", "5"},
+     {0, 0},
+     {700, 0}},
+    {"origin",
+     {5, 10},
+     "\033[2;4r\033[?6h\033[1;1HA\033[3;1HB",
+     {"", "A", "", "B"},
+     {3, 1},
+     {600, 0}},
+    {"insert-delete-chars",
+     {2, 10},
+     "abcdefghij\r\033[3G\033[2@\r\n0123456789\033[2;3H\033[3P",
+     {"ab  cdefgh", "0156789"},
+     {1, 2},
+     {700, 0}},
+    {"insert-delete-lines",
+     {5, 10},
+     "1\r\n2\r\n3\r\n4\r\n5\033[2;4r\033[3;1H\033[L\033[2;1H\033[M",
+     {"1", "", "3", "", "5"},
+     {1, 0},
+     {600, 0}},
+    {"erase-line",
+     {4, 10},
+     "abcdefghij\r\n0123456789\r\n0123456789\r\nabc"
+     "\033[1;3H\033[4X\033[2;5H\033[1K\033[3;5H\033[K\033[4;2H\033[2K",
+     {"ab    ghij", "     56789", "0123", ""},
+     {3, 1},
+     {600, 0}},
+    {"erase-display",
+     {4, 10},
+     "1111111111\r\n2222222222\r\n3333333333\r\n4444444444"
+     "\033[2;3H\033[J\033[1;5H\033[1J",
+     {"     11111", "22"},
+     {0, 4},
+     {700, 0}},
+    {"tabs",
+     {2, 20},
+     "\033[1;5H\033H\r\ta\tb\r\n\033[3g\tc",
+     {"    a   b", "                   c"},
+     {1, 19},
+     {1150, 0}},
+    {"save-restore",
+     {3, 10},
+     "\033[2;3H\0337\033[H\033[Jx\0338y",
+     {"x", "  y"},
+     {1, 3},
+     {700, 0}},
+    {"alignment",
+     {3, 5},
+     "\033#8",
+     {"EEEEE", "EEEEE", "EEEEE"},
+     {0, 0},
+     {1300, 0}},
+    {"charsets",
+     {3, 10},
+     "\033(0lqk\r\n\033(Bx\033)0\016q\017q\r\n\033(A#\033(B#",
+     {"┌─┐", "x─q", "£#"},
+     {2, 2},
+     {700, 0},
+     // mtm.cpp applies a designated G0 at the next shift only, and config.c
+     // draws line drawing in ASCII
+     {"lqk", "x-q", "##"}},
+    {"wide",
+     {3, 10},
+     "a中b\r\n012345678中",
+     {"a中b", "012345678", "中"},
+     {2, 2},
+     {800, 0}},
+    {"wide-erase",
+     {3, 10},
+     "中文字\033[1;5H\033[K",
+     {"中文"},
+     {0, 4},
+     {600, 0}},
+    {"alt-screen",
+     {3, 10},
+     "main\033[?1049hjunk\033[?1049l\033[?1049h\033[2;3Halt",
+     {"", "  alt"},
+     {1, 5},
+     {1100, 0}},
+    {"alt-screen-exit",
+     {3, 10},
+     "main\033[?1049h\033[2;3Halt\033[?1049l!",
+     {"main!"},
+     {0, 5},
+     {650, 0}},
+};
+
+// what an emulator shows, in the form of the goldens
+struct GRID {
+  std::vector<std::string> Rows;
+  POS Cursor;
+};
+
+// a row of characters, one per column, wide ones followed by 0
+static std::string rowtext(const std::vector<uint32_t> &chars) {
+  std::string row;
+  for (auto c : chars) {
+    if (c) {
+      pututf8(row, c);
+    }
+  }
+  row.erase(row.find_last_not_of(' ') + 1);
+  return row;
+}
+
+struct EMULATOR {
+  const char *Name;
+  // a fresh emulator of that size
+  std::function<void(const SIZE &)> Start;
+  std::function<void(const char *, size_t)> Write;
+  std::function<GRID()> Read;
+};
+
+// whether the emulator shows what the case expects, the difference if not
+static bool check(const CASE &c, EMULATOR_ID id, const GRID &grid,
+                  const char *how, std::string &diff) {
+  auto &golden =
+      id == ID_VTPARSER && !c.VtparserRows.empty() ? c.VtparserRows : c.Rows;
+  bool same = grid.Cursor == c.Cursor;
+  char line[128];
+  for (int y = 0; y < c.Size.Rows; ++y) {
+    std::string want = y < (int)golden.size() ? golden[y] : "";
+    std::string got = y < (int)grid.Rows.size() ? grid.Rows[y] : "";
+    if (want != got) {
+      same = false;
+      snprintf(line, sizeof(line), "    %s row %d: want \"%s\" got \"%s\"\n",
+               how, y, want.c_str(), got.c_str());
+      diff += line;
+    }
+  }
+  if (!(grid.Cursor == c.Cursor)) {
+    snprintf(line, sizeof(line), "    %s cursor: want %d,%d got %d,%d\n",
+             how, c.Cursor.Y, c.Cursor.X, grid.Cursor.Y, grid.Cursor.X);
+    diff += line;
+  }
+  return same;
+}
+
+// nanoseconds per byte of the case repeated, the fastest pass
+static double timed(const EMULATOR &emulator, const CASE &c) {
+  std::string data = "\033c";
+  data += c.Input;
+  double best = 0;
+  for (int pass = 0; pass < PASSES; ++pass) {
+    emulator.Start(c.Size);
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    while (bytes < TIMED_BYTES) {
+      emulator.Write(data.data(), data.size());
+      bytes += data.size();
+    }
+    auto ns = std::chrono::duration<double, std::nano>(
+                  std::chrono::steady_clock::now() - start)
+                  .count() /
+              bytes;
+    best = pass ? std::min(best, ns) : ns;
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : nullptr;
+  double scale = argc > 2 ? atof(argv[2]) : 1;
+  // the goldens are UTF-8, whatever the environment says
+  if (!setlocale(LC_ALL, "C.UTF-8")) {
+    setlocale(LC_ALL, "");
+  }
+  // the pads of both emulators need curses, the handlers of mtm.cpp color
+  // pairs
+  setenv("TERM", "xterm-256color", 1);
+  if (!Term::Insance().Initialize(true)) {
+    printf("could not initialize curses\n");
+    return EXIT_FAILURE;
+  }
+  start_color();
+  use_default_colors();
+
+  std::shared_ptr<NODE> node;
+  std::shared_ptr<VTPARSER> vp;
+  EMULATOR emulators[EMULATORS] = {
+      {"vtparser",
+       [&](const SIZE &size) {
+         node = std::make_shared<NODE>(POS{0, 0}, size);
+         vp = std::make_shared<VTPARSER>();
+         *vp = {};
+         setupevents(vp.get(), node.get());
+       },
+       [&](const char *b, size_t n) { vtwrite(vp.get(), b, n); },
+       [&]() {
+         auto s = node->s;
+         GRID grid;
+         // before reading the cells moves it
+         int cy, cx;
+         getyx(s->win, cy, cx);
+         grid.Cursor = {cy - s->tos, cx};
+         for (int y = 0; y < node->Size.Rows; ++y) {
+           std::vector<uint32_t> chars;
+           for (int x = 0; x < node->Size.Cols; ++x) {
+             cchar_t cc;
+             wchar_t wch[CCHARW_MAX + 1] = {};
+             attr_t attrs;
+             short pair;
+             mvwin_wch(s->win, s->tos + y, x, &cc);
+             getcchar(&cc, wch, &attrs, &pair, nullptr);
+             uint32_t c = wch[0] ? wch[0] : ' ';
+             chars.push_back(c);
+             // the pad repeats a wide character in its second column
+             if (wcwidth(c) == 2 && x + 1 < node->Size.Cols) {
+               chars.push_back(0);
+               ++x;
+             }
+           }
+           grid.Rows.push_back(rowtext(chars));
+         }
+         return grid;
+       }},
+      {"node",
+       [&](const SIZE &size) {
+         node = std::make_shared<NODE>(POS{0, 0}, size);
+       },
+       [&](const char *b, size_t n) { node->parse(b, n); },
+       [&]() {
+         auto frame = node->m_grid.Acquire();
+         GRID grid;
+         if (!frame) {
+           return grid;
+         }
+         for (auto &row : frame->Rows) {
+           std::vector<uint32_t> chars;
+           // every cell, whatever is after a wide character shows
+           for (auto &cell : row->Cells) {
+             chars.push_back(cell.Char || !cell.Width ? cell.Char : ' ');
+           }
+           grid.Rows.push_back(rowtext(chars));
+         }
+         grid.Cursor = frame->Cursor;
+         return grid;
+       }},
+  };
+
+  printf("%-20s %-9s %-6s %10s %10s\n", "case", "emulator", "screen",
+         "ns/byte", "budget");
+  bool found = false;
+  int failures = 0;
+  for (auto &c : CASES) {
+    if (only && strcmp(only, c.Name)) {
+      continue;
+    }
+    found = true;
+    for (int id = 0; id < EMULATORS; ++id) {
+      auto &emulator = emulators[id];
+      std::string diff;
+      emulator.Start(c.Size);
+      emulator.Write(c.Input, strlen(c.Input));
+      bool whole = check(c, (EMULATOR_ID)id, emulator.Read(), "whole", diff);
+      emulator.Start(c.Size);
+      for (auto p = c.Input; *p; ++p) {
+        emulator.Write(p, 1);
+      }
+      bool bytewise =
+          check(c, (EMULATOR_ID)id, emulator.Read(), "bytewise", diff);
+
+      auto ns = timed(emulator, c);
+      auto budget = c.Budget[id] * scale;
+      bool fast = budget && ns <= budget;
+      bool ok = whole && bytewise && fast;
+      char note[64] = "";
+      if (!budget) {
+        snprintf(note, sizeof(note), " UNMEASURED, %d from this run",
+                 ((int)(ns * 3) / 50 + 1) * 50);
+      } else if (!fast) {
+        snprintf(note, sizeof(note), " SLOW");
+      }
+      printf("%-20s %-9s %-6s %10.1f %10.0f%s\n", c.Name, emulator.Name,
+             whole && bytewise ? "ok" : !whole ? "WRONG" : "SPLIT", ns,
+             budget, note);
+      printf("%s", diff.c_str());
+      fflush(stdout);
+      failures += !ok;
+    }
+  }
+  node.reset();
+  vp.reset();
+  if (failures) {
+    printf("%d failed\n", failures);
+  }
+  return found && !failures ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,174 @@
+// Throughput of the control channel, and what happens to a client that
+// stops reading.
+//
+// A client thread reads OUTPUT messages from the socket while the loop
+// feeds four panes 64 KiB per turn, holding back while more than 4 MiB are
+// unread so the client is never cut off. Then a client that never reads
+// connects; it must be dropped at the limit without a turn ever waiting.
+#include "../control.h"
+#include "../selector.h"
+#include <algorithm>
+#include <chrono>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace term_screen;
+
+static const size_t CHUNK = 64 * 1024;
+static const size_t AHEAD = 4 * 1024 * 1024;
+
+static int dial(const char *path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+  if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static bool readn(int fd, char *p, size_t n) {
+  while (n) {
+    auto r = read(fd, p, n);
+    if (r <= 0) {
+      return false;
+    }
+    p += r;
+    n -= r;
+  }
+  return true;
+}
+
+// pane bytes in the OUTPUT messages until BYE
+static size_t consume(int fd) {
+  size_t got = 0;
+  std::vector<char> body;
+  char head[5];
+  while (readn(fd, head, sizeof(head))) {
+    uint32_t len;
+    memcpy(&len, head + 1, 4);
+    body.resize(len);
+    if (!readn(fd, body.data(), len)) {
+      break;
+    }
+    auto type = (MSG)head[0];
+    if (type == MSG::BYE) {
+      break;
+    }
+    if (type != MSG::OUTPUT) {
+      continue;
+    }
+    for (size_t p = 0; p + 8 <= len;) {
+      uint32_t n;
+      memcpy(&n, &body[p + 4], 4);
+      got += n;
+      p += 8 + n;
+    }
+  }
+  return got;
+}
+
+static void turn(Control &control, int timeout) {
+  Selector::Instance().Select(timeout);
+  control.Dispatch([](std::string &&) {});
+}
+
+static bool run(Selector::Backend backend, const char *path, size_t total) {
+  auto &selector = Selector::Instance();
+  if (!selector.Initialize(backend)) {
+    printf("%-9s %10s\n", Selector::Name(backend), "unsupported");
+    return true;
+  }
+  auto control = Control::Open(path);
+  if (!control) {
+    perror(path);
+    return false;
+  }
+  std::vector<char> chunk(CHUNK, 'x');
+
+  // a client that keeps up
+  size_t got = 0;
+  int fd = dial(path);
+  std::thread client([&] { got = consume(fd); });
+  turn(*control, 100);
+  auto start = std::chrono::steady_clock::now();
+  auto syscalls = selector.Syscalls();
+  for (size_t sent = 0; sent < total;) {
+    if (control->Backlog() > AHEAD) {
+      turn(*control, 10);
+      continue;
+    }
+    turn(*control, 0);
+    for (uint32_t id = 1; id <= 4 && sent < total; ++id) {
+      control->Output(id, chunk);
+      sent += CHUNK;
+    }
+    control->Flush();
+  }
+  while (control->Backlog()) {
+    turn(*control, 10);
+  }
+  syscalls = selector.Syscalls() - syscalls;
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  // a client that never reads takes over and falls behind
+  int stalled = dial(path);
+  turn(*control, 100);
+  client.join();
+  close(fd);
+  double longest = 0;
+  size_t behind = 0;
+  for (size_t sent = 0; sent < 64 * 1024 * 1024; sent += CHUNK) {
+    auto before = std::chrono::steady_clock::now();
+    turn(*control, 0);
+    control->Output(1, chunk);
+    control->Flush();
+    longest = std::max(longest, std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() - before)
+                                    .count());
+    behind = std::max(behind, control->Backlog());
+    if (sent > 32 * 1024 * 1024 && control->Backlog() == 0) {
+      break;
+    }
+  }
+  bool dropped = control->Backlog() == 0;
+  control.reset();
+  close(stalled);
+
+  auto mb = (double)got / (1024 * 1024);
+  printf("%-9s %10.1f %12.1f %10.1f %9.2f %8s\n", Selector::Name(backend),
+         mb / elapsed, (double)syscalls / mb, mb, longest,
+         dropped ? "yes" : "NO");
+  return got == total && dropped && behind <= 16 * 1024 * 1024 + CHUNK;
+}
+
+int main(int argc, char **argv) {
+  size_t total = (argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024) << 20;
+  if (total == 0) {
+    fprintf(stderr, "usage: %s [MiB]\n", argv[0]);
+    return 2;
+  }
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/mtm-control-bench-%d", (int)getpid());
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("%-9s %10s %12s %10s %9s %8s\n", "backend", "MB/s", "syscalls/MB",
+         "MB read", "turn ms", "dropped");
+  bool ok = true;
+  for (auto backend : {Selector::Backend::Select, Selector::Backend::Epoll,
+                       Selector::Backend::Uring}) {
+    ok = run(backend, path, total) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// How long copy mode takes to copy out of a deep history.
+//
+// A pane keeps a build log of LINES lines, 200000 by default, in its
+// history. Copy mode is driven with its keys and the copy is timed for the
+// whole history, a rectangle over all of it and ten lines at its oldest
+// end; the last should not depend on the depth of the history. A number of
+// lines can be given as argument.
+#include "../copy_mode.h"
+#include "../node.h"
+#include "../term.h"
+#include <chrono>
+#include <curses.h>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace term_screen;
+
+static const SIZE PANE_SIZE = {50, 160};
+
+// lines of a compiler run, about 100 columns each
+static std::vector<CELL> logline(size_t i) {
+  char text[160];
+  snprintf(text, sizeof(text),
+           "[%zu/%zu] g++ -std=c++20 -O2 -Wall -c src/module_%zu/file_%zu.cpp "
+           "-o build/module_%zu/file_%zu.o",
+           i, i * 3, i % 97, i, i % 97, i);
+  std::vector<CELL> cells;
+  for (auto p = text; *p; ++p) {
+    CELL cell;
+    cell.Char = (uint8_t)*p;
+    cells.push_back(cell);
+  }
+  return cells;
+}
+
+static Input key(uint32_t c) { return {OK, c}; }
+
+// the copy that the keys make, and how long the last one took
+static double copy(const std::shared_ptr<NODE> &node, const char *keys,
+                   std::string *copied) {
+  auto mode = CopyMode::Start(node);
+  if (!mode) {
+    return -1;
+  }
+  copied->clear();
+  for (auto p = keys; p[1]; ++p) {
+    mode->Key(key(*p), copied);
+  }
+  auto start = std::chrono::steady_clock::now();
+  mode->Key(key(keys[strlen(keys) - 1]), copied);
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  size_t lines = argc > 1 ? strtoul(argv[1], nullptr, 10) : 200000;
+  if (lines == 0) {
+    printf("usage: %s [lines > 0]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  setlocale(LC_ALL, "");
+  // the pads of a pane need curses
+  if (!Term::Insance().Initialize(true)) {
+    printf("could not initialize curses\n");
+    return EXIT_FAILURE;
+  }
+
+  NODE::s_historyLines = lines;
+  auto node = std::make_shared<NODE>(POS{0, 0}, PANE_SIZE);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < lines; ++i) {
+    node->m_history.Push(logline(i));
+  }
+  auto filled = std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
+  // publishes the first frame
+  node->parse("$ ", 2);
+  printf("history  %zu lines, %.1f MB, pushed in %.0f ms\n",
+         node->m_history.Size(), node->m_history.Bytes() / 1e6, filled);
+
+  struct {
+    const char *Name;
+    const char *Keys;
+  } cases[] = {
+      // g to the oldest line, V whole lines, G to the newest, y copies
+      {"all", "gVGy"},
+      // a rectangle of the first 40 columns
+      {"rect", "g0rG0llllllllllllllllllllllllllllllllllllllly"},
+      // ten lines at the oldest end
+      {"oldest", "gVjjjjjjjjjy"},
+  };
+  printf("%-8s %12s %10s %10s\n", "copy", "bytes", "ms", "MB/s");
+  bool ok = true;
+  for (auto &c : cases) {
+    std::string copied;
+    auto ms = copy(node, c.Keys, &copied);
+    ok = ok && ms >= 0 && !copied.empty();
+    printf("%-8s %12zu %10.2f %10.1f\n", c.Name, copied.size(), ms,
+           copied.size() / ms / 1e3);
+  }
+  node.reset();
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
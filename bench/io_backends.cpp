@@ -0,0 +1,219 @@
+// Throughput and system calls of each Selector backend on a local pty flood.
+//
+// Every pane is a pty whose child writes a fixed amount of output and
+// exits. The parent reads everything through the Selector.
+//
+// Then the other direction, a paste into the pane of a NODE: the keys of a
+// turn are queued like handleinput does and flushed to the child once per
+// key, as mtm did before it coalesced input, or once per turn, and the
+// system calls per KB pasted are counted until the child has read it all.
+#include "../child_process.h"
+#include "../input_stream.h"
+#include "../node.h"
+#include "../selector.h"
+#include "../term.h"
+#include <algorithm>
+#include <chrono>
+#include <locale.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace term_screen;
+
+static const size_t FLOOD = 16 * 1024 * 1024;
+static const size_t PASTE = 1024 * 1024;
+// keys curses hands over in one turn of a paste
+static const size_t TURN = 1024;
+static const SIZE PANE_SIZE = {24, 80};
+
+static pid_t flooder(int *master) {
+  pid_t pid = forkpty(master, nullptr, nullptr, nullptr);
+  if (pid == 0) {
+    struct termios t;
+    tcgetattr(STDOUT_FILENO, &t);
+    cfmakeraw(&t);
+    tcsetattr(STDOUT_FILENO, TCSANOW, &t);
+    char line[4096];
+    memset(line, 'x', sizeof(line));
+    for (size_t w = 0; w < FLOOD;) {
+      auto r = write(STDOUT_FILENO, line, sizeof(line));
+      if (r <= 0) {
+        break;
+      }
+      w += r;
+    }
+    _exit(0);
+  }
+  return pid;
+}
+
+static void run(Selector::Backend backend, size_t panes) {
+  auto &selector = Selector::Instance();
+  if (!selector.Initialize(backend)) {
+    printf("%-9s %6zu %12s\n", Selector::Name(backend), panes, "unsupported");
+    return;
+  }
+
+  std::vector<int> fds;
+  std::vector<pid_t> pids;
+  for (size_t i = 0; i < panes; ++i) {
+    int fd;
+    pids.push_back(flooder(&fd));
+    fds.push_back(fd);
+    selector.Register(fd);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto syscalls = selector.Syscalls();
+  size_t total = 0;
+  size_t open = panes;
+  while (open) {
+    selector.Select(1000);
+    for (auto &fd : fds) {
+      while (fd >= 0) {
+        auto data = selector.Read(fd);
+        if (!data) {
+          selector.Unregister(fd);
+          close(fd);
+          fd = -1;
+          --open;
+          break;
+        }
+        if (data->empty()) {
+          break;
+        }
+        total += data->size();
+      }
+    }
+  }
+  syscalls = selector.Syscalls() - syscalls;
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  for (auto pid : pids) {
+    waitpid(pid, nullptr, 0);
+  }
+  auto mb = (double)total / (1024 * 1024);
+  printf("%-9s %6zu %10.1f %12.1f %12.1f\n", Selector::Name(backend), panes,
+         mb / elapsed, (double)syscalls / mb, mb);
+}
+
+// the shell of a pane that reads size bytes of input and exits, with an r
+// once its pty is raw
+static std::string sink(size_t size) {
+  char path[64];
+  snprintf(path, sizeof(path), "/tmp/mtm-paste-sink-%d", (int)getpid());
+  auto f = fopen(path, "w");
+  if (!f) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(f,
+          "#!/bin/sh\n"
+          "stty raw -echo\n"
+          "printf r\n"
+          "exec head -c %zu >/dev/null\n",
+          size);
+  fclose(f);
+  chmod(path, 0700);
+  return path;
+}
+
+// polls the pane and throws its output away, false once it is closed
+static bool drain(void *handle, int timeout) {
+  auto &stream = InputStream::Instance();
+  stream.Poll(timeout);
+  auto data = stream.Peek(handle);
+  if (!data) {
+    return false;
+  }
+  stream.Consume(handle, data->size());
+  return true;
+}
+
+static void paste(Selector::Backend backend, const char *shell,
+                  bool coalesced) {
+  auto &selector = Selector::Instance();
+  const char *how = coalesced ? "turn" : "key";
+  if (!selector.Initialize(backend)) {
+    printf("%-9s %6s %12s\n", Selector::Name(backend), how, "unsupported");
+    return;
+  }
+  auto node = std::make_shared<NODE>(POS{0, 0}, PANE_SIZE);
+  node->Process = Process::Fork(PANE_SIZE, nullptr, shell);
+  if (!node->Process) {
+    printf("%-9s %6s %12s\n", Selector::Name(backend), how, "no child");
+    return;
+  }
+  auto handle = node->Process->Handle();
+  auto &stream = InputStream::Instance();
+  for (auto data = stream.Peek(handle); data && data->empty();
+       data = stream.Peek(handle)) {
+    stream.Poll(1000);
+  }
+  drain(handle, 0);
+  std::vector<char> keys(PASTE, 'x');
+
+  auto start = std::chrono::steady_clock::now();
+  auto syscalls = selector.Syscalls();
+  for (size_t off = 0; off < PASTE;) {
+    drain(handle, 0);
+    auto n = std::min(TURN, PASTE - off);
+    for (size_t i = 0; i < n; ++i) {
+      node->queue(&keys[off + i], 1);
+      if (!coalesced) {
+        node->flush();
+      }
+    }
+    node->flush();
+    off += n;
+  }
+  // the pty closes once the child has read everything
+  while (drain(handle, 1000)) {
+  }
+  syscalls = selector.Syscalls() - syscalls;
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  node.reset();
+  auto kb = (double)PASTE / 1024;
+  printf("%-9s %6s %10.1f %12.1f\n", Selector::Name(backend), how,
+         kb / 1024 / elapsed, (double)syscalls / kb);
+}
+
+int main(int argc, char **argv) {
+  setlocale(LC_ALL, "");
+  // the pads of a pane need curses
+  if (!Term::Insance().Initialize(true)) {
+    printf("could not initialize curses\n");
+    return EXIT_FAILURE;
+  }
+  auto shell = sink(PASTE);
+  printf("%-9s %6s %10s %12s %12s\n", "backend", "panes", "MB/s",
+         "syscalls/MB", "MB read");
+  for (size_t panes : {1, 8, 32}) {
+    for (auto backend : {Selector::Backend::Select, Selector::Backend::Epoll,
+                         Selector::Backend::Uring}) {
+      run(backend, panes);
+    }
+  }
+
+  printf("\n%-9s %6s %10s %12s\n", "backend", "write", "MB/s",
+         "syscalls/KB");
+  for (auto backend : {Selector::Backend::Select, Selector::Backend::Epoll,
+                       Selector::Backend::Uring}) {
+    paste(backend, shell.c_str(), false);
+    paste(backend, shell.c_str(), true);
+  }
+  unlink(shell.c_str());
+  return 0;
+}
@@ -0,0 +1,253 @@
+// Keystroke to screen latency of mtm, seen from the terminal it runs in.
+//
+// mtm is started on a pty with this program as the shell of its panes. A
+// pane echoes every key as a circled digit on a cleared screen, so the glyph
+// shows up in mtm's output only once mtm has read the key, passed it to the
+// pane, parsed the echo and drawn it. Keys are sent one at a time and timed
+// from the write to the glyph. Every run is measured idle and while a second
+// pane prints as fast as it can, with the default inline parsing and with
+// parse workers. The path of mtm is the first argument, the number of keys
+// per run the second.
+#include <algorithm>
+#include <chrono>
+#include <errno.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// set for the panes, which run this program as their shell
+static const char *CHILD_ENV = "MTM_LATENCY_PANE";
+static const char COMMAND_KEY = 'g' & 0x1f;
+// makes a pane print until the end
+static const char FLOOD_KEY = 'f' & 0x1f;
+// the keys are a..t, echoed as U+2460..U+2473
+static const int GLYPHS = 20;
+static const int KEY_TIMEOUT_MS = 5000;
+
+static std::string glyph(int i) {
+  uint32_t c = 0x2460 + i;
+  return {(char)(0xe0 | (c >> 12)), (char)(0x80 | ((c >> 6) & 0x3f)),
+          (char)(0x80 | (c & 0x3f))};
+}
+
+static void writeall(int fd, const char *b, size_t n) {
+  while (n) {
+    auto w = write(fd, b, n);
+    if (w < 0 && errno == EINTR) {
+      continue;
+    }
+    if (w <= 0) {
+      _exit(EXIT_FAILURE);
+    }
+    b += w;
+    n -= w;
+  }
+}
+
+// a pane: echo keys, or print lines once the flood key arrives
+static int pane() {
+  struct termios t;
+  if (tcgetattr(STDIN_FILENO, &t) == 0) {
+    cfmakeraw(&t);
+    tcsetattr(STDIN_FILENO, TCSANOW, &t);
+  }
+  std::string line;
+  for (int i = 0; i < 4; ++i) {
+    line += "the quick brown fox jumps over the lazy dog ";
+  }
+  line += "\r\n";
+
+  bool flood = false;
+  while (true) {
+    struct pollfd p = {.fd = STDIN_FILENO, .events = POLLIN};
+    if (poll(&p, 1, flood ? 0 : -1) > 0) {
+      char buf[256];
+      auto r = read(STDIN_FILENO, buf, sizeof(buf));
+      if (r <= 0) {
+        return EXIT_SUCCESS;
+      }
+      std::string out;
+      for (ssize_t i = 0; i < r; ++i) {
+        if (buf[i] == FLOOD_KEY) {
+          flood = true;
+        } else if (buf[i] >= 'a' && buf[i] < 'a' + GLYPHS) {
+          out += "\033[H\033[2J" + glyph(buf[i] - 'a');
+        }
+      }
+      writeall(STDOUT_FILENO, out.data(), out.size());
+    }
+    if (flood) {
+      writeall(STDOUT_FILENO, line.data(), line.size());
+    }
+  }
+}
+
+struct MTM {
+  pid_t Pid = -1;
+  int Fd = -1;
+  // what was read and not matched yet, kept short
+  std::string Seen;
+
+  ~MTM() {
+    if (Pid > 0) {
+      kill(Pid, SIGTERM);
+      // drain, so that mtm is not stuck writing while it exits
+      char buf[65536];
+      while (waitpid(Pid, nullptr, WNOHANG) == 0) {
+        struct pollfd p = {.fd = Fd, .events = POLLIN};
+        if (poll(&p, 1, 10) > 0 && read(Fd, buf, sizeof(buf)) <= 0) {
+          waitpid(Pid, nullptr, 0);
+          break;
+        }
+      }
+    }
+    if (Fd >= 0) {
+      close(Fd);
+    }
+  }
+
+  bool Start(const char *path, const char *self, const char *threads) {
+    struct winsize ws = {.ws_row = 24, .ws_col = 80};
+    Pid = forkpty(&Fd, nullptr, nullptr, &ws);
+    if (Pid == 0) {
+      setenv(CHILD_ENV, "1", 1);
+      setenv("SHELL", self, 1);
+      setenv("TERM", "xterm-256color", 1);
+      setenv("LC_ALL", "C.UTF-8", 1);
+      execl(path, path, "-j", threads, nullptr);
+      _exit(127);
+    }
+    return Pid > 0;
+  }
+
+  void Send(const char *keys) { writeall(Fd, keys, strlen(keys)); }
+
+  // reads mtm's output until text appears, false after ms milliseconds
+  bool Wait(const std::string &text, int ms) {
+    auto end = Clock::now() + std::chrono::milliseconds(ms);
+    char buf[65536];
+    while (true) {
+      auto found = Seen.find(text);
+      if (found != std::string::npos) {
+        Seen.erase(0, found + text.size());
+        return true;
+      }
+      // a glyph may be split between two reads
+      if (Seen.size() > text.size()) {
+        Seen.erase(0, Seen.size() - text.size());
+      }
+      auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                      end - Clock::now())
+                      .count();
+      struct pollfd p = {.fd = Fd, .events = POLLIN};
+      if (left <= 0 || poll(&p, 1, (int)left) <= 0) {
+        return false;
+      }
+      auto r = read(Fd, buf, sizeof(buf));
+      if (r <= 0) {
+        return false;
+      }
+      Seen.append(buf, r);
+    }
+  }
+
+  // reads whatever mtm still has to say for ms milliseconds
+  void Settle(int ms) {
+    Wait(std::string(1, '\0'), ms);
+    Seen.clear();
+  }
+};
+
+struct RESULT {
+  std::vector<double> Micros;
+  int Missed = 0;
+};
+
+static RESULT measure(MTM &mtm, int keys) {
+  RESULT result;
+  for (int i = 0; i < keys; ++i) {
+    char key[] = {(char)('a' + i % GLYPHS), 0};
+    auto start = Clock::now();
+    mtm.Send(key);
+    if (mtm.Wait(glyph(i % GLYPHS), KEY_TIMEOUT_MS)) {
+      result.Micros.push_back(
+          std::chrono::duration<double, std::micro>(Clock::now() - start)
+              .count());
+    } else {
+      ++result.Missed;
+    }
+  }
+  return result;
+}
+
+static void report(const char *parse, const char *load, RESULT &result) {
+  auto &m = result.Micros;
+  std::sort(m.begin(), m.end());
+  auto at = [&](double q) {
+    return m.empty() ? 0.0 : m[std::min(m.size() - 1, (size_t)(q * m.size()))];
+  };
+  printf("%-8s %-6s %6zu %6d %10.0f %10.0f %10.0f\n", parse, load, m.size(),
+         result.Missed, at(0.5), at(0.99), m.empty() ? 0.0 : m.back());
+  fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+  if (getenv(CHILD_ENV)) {
+    return pane();
+  }
+  if (argc < 2) {
+    printf("usage: %s MTM [KEYS]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  int keys = argc > 2 ? atoi(argv[2]) : 200;
+  char self[4096];
+  auto n = readlink("/proc/self/exe", self, sizeof(self) - 1);
+  if (n <= 0) {
+    return EXIT_FAILURE;
+  }
+  self[n] = 0;
+  signal(SIGPIPE, SIG_IGN);
+
+  printf("%-8s %-6s %6s %6s %10s %10s %10s\n", "parse", "load", "keys",
+         "missed", "p50 us", "p99 us", "max us");
+  bool ok = true;
+  for (auto [parse, threads] : {std::pair{"inline", "0"}, {"workers", "2"}}) {
+    MTM mtm;
+    if (!mtm.Start(argv[1], self, threads)) {
+      printf("could not start %s\n", argv[1]);
+      return EXIT_FAILURE;
+    }
+    // the first pane is up once it echoes
+    mtm.Send("a");
+    if (!mtm.Wait(glyph(0), KEY_TIMEOUT_MS)) {
+      printf("%s: no pane came up\n", parse);
+      ok = false;
+      continue;
+    }
+    mtm.Settle(200);
+    auto idle = measure(mtm, keys);
+    report(parse, "idle", idle);
+
+    // a second pane floods, the focus goes back to the first one
+    const char split[] = {COMMAND_KEY, 'v', 0};
+    mtm.Send(split);
+    mtm.Settle(500);
+    const char flood[] = {FLOOD_KEY, COMMAND_KEY, 'o', 0};
+    mtm.Send(flood);
+    mtm.Settle(200);
+    auto busy = measure(mtm, keys);
+    report(parse, "flood", busy);
+    ok = ok && idle.Missed == 0 && busy.Missed == 0;
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,137 @@
+// Emulator throughput with rendered-text logging off, plain and gzipped.
+//
+// A libvterm screen is fed a scrolling corpus in pty sized chunks. Every
+// line leaving the screen goes to the log, as in mtm. The emulator thread
+// only hands lines to the writer, so the three rates should match.
+//
+// Then the cost of Push alone: 132-column lines are pushed straight into
+// the log as fast as possible and at one per microsecond, about 60 MB/s of
+// text, reporting the time per line on the pushing thread and how many
+// lines the writer had to drop. "emulator" or "push" runs just that part.
+#include "../pane_log.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+
+static std::string flood(size_t size) {
+  std::string out;
+  char line[128];
+  for (int i = 0; out.size() < size; ++i) {
+    snprintf(line, sizeof(line),
+             "\033[3%dm%08d\033[0m the quick brown fox jumps over the lazy "
+             "dog\r\n",
+             i % 8, i);
+    out += line;
+  }
+  return out;
+}
+
+static void run(const char *name, const char *path,
+                const std::string &corpus) {
+  auto log = path ? PaneLog::Open(path) : nullptr;
+  if (path && !log) {
+    printf("%-6s %10s\n", name, "no file");
+    return;
+  }
+
+  auto vt = vterm_new(50, 132);
+  vterm_set_utf8(vt, true);
+  auto screen = vterm_obtain_screen(vt);
+  static VTermScreenCallbacks callbacks = {
+      .sb_pushline =
+          [](int cols, const VTermScreenCell *cells, void *user) {
+            if (user) {
+              ((PaneLog *)user)->Push(cols, cells);
+            }
+            return 1;
+          },
+  };
+  vterm_screen_set_callbacks(screen, &callbacks, log.get());
+  vterm_screen_reset(screen, true);
+
+  const size_t chunk = 4096;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t off = 0; off < corpus.size(); off += chunk) {
+    vterm_input_write(vt, corpus.data() + off,
+                      std::min(chunk, corpus.size() - off));
+  }
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+  vterm_free(vt);
+
+  auto lines = log ? log->Lines() : 0;
+  auto dropped = log ? log->Dropped() : 0;
+  log.reset();
+  if (path) {
+    unlink(path);
+  }
+  printf("%-6s %10.1f %10llu %10llu\n", name,
+         corpus.size() / elapsed / (1024 * 1024), (unsigned long long)lines,
+         (unsigned long long)dropped);
+}
+
+static void push(const char *name, const char *path, int pace) {
+  const int LINES = 2000000;
+  auto log = path ? PaneLog::Open(path) : nullptr;
+  if (path && !log) {
+    printf("%-6s %6s %10s\n", name, "", "no file");
+    return;
+  }
+  VTermScreenCell cells[132] = {};
+  char text[64];
+  volatile uint32_t sink = 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < LINES; ++i) {
+    auto due = start + std::chrono::microseconds(i) * pace;
+    while (std::chrono::steady_clock::now() < due) {
+    }
+    snprintf(text, sizeof(text),
+             "%08d the quick brown fox jumps over the lazy dog", i);
+    for (int x = 0; text[x]; ++x) {
+      cells[x].chars[0] = (uint8_t)text[x];
+    }
+    if (log) {
+      log->Push(132, cells);
+    } else {
+      sink = sink + cells[i % 132].chars[0];
+    }
+  }
+  auto elapsed = std::chrono::duration<double, std::nano>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  auto lines = log ? log->Lines() : 0;
+  auto dropped = log ? log->Dropped() : 0;
+  log.reset();
+  if (path) {
+    unlink(path);
+  }
+  printf("%-6s %6s %10.0f %10llu %10llu\n", name, pace ? "1/us" : "max",
+         elapsed / LINES, (unsigned long long)lines,
+         (unsigned long long)dropped);
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : nullptr;
+  if (!only || !strcmp(only, "emulator")) {
+    auto corpus = flood(64 * 1024 * 1024);
+    printf("%-6s %10s %10s %10s\n", "log", "MB/s", "lines", "dropped");
+    run("off", nullptr, corpus);
+    run("plain", "pane_log_bench.log", corpus);
+    run("gzip", "pane_log_bench.log.gz", corpus);
+  }
+  if (!only || !strcmp(only, "push")) {
+    printf("%-6s %6s %10s %10s %10s\n", "log", "rate", "ns/line", "lines",
+           "dropped");
+    for (int pace : {0, 1}) {
+      push("off", nullptr, pace);
+      push("plain", "pane_log_bench.log", pace);
+      push("gzip", "pane_log_bench.log.gz", pace);
+    }
+  }
+  return 0;
+}
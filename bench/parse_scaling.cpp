@@ -0,0 +1,72 @@
+// Scaling of the parse pool with 1/4/16/64 panes flooded with output.
+//
+// Each pane is an independent libvterm instance fed the same corpus in pty
+// sized chunks. Reports aggregate MB/s for inline parsing and for the pool.
+#include "../parse_pool.h"
+#include <chrono>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <vterm.h>
+
+static std::string flood(size_t size) {
+  std::string out;
+  char line[128];
+  for (int i = 0; out.size() < size; ++i) {
+    snprintf(line, sizeof(line),
+             "\033[3%dm%08d\033[0m the quick brown fox jumps over the lazy "
+             "dog\r\n",
+             i % 8, i);
+    out += line;
+  }
+  return out;
+}
+
+static double run(size_t threads, size_t panes, const std::string &corpus) {
+  std::vector<VTerm *> vts;
+  ParsePool pool(threads);
+  for (size_t i = 0; i < panes; ++i) {
+    auto vt = vterm_new(24, 80);
+    vterm_set_utf8(vt, true);
+    vterm_screen_reset(vterm_obtain_screen(vt), true);
+    vts.push_back(vt);
+    pool.Register(vt, [vt](const char *b, size_t n) {
+      vterm_input_write(vt, b, n);
+    });
+  }
+
+  const size_t chunk = 4096;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t off = 0; off < corpus.size(); off += chunk) {
+    auto n = std::min(chunk, corpus.size() - off);
+    for (auto vt : vts) {
+      pool.Submit(vt, {corpus.data() + off, n});
+    }
+  }
+  pool.Drain();
+  auto elapsed = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+
+  for (auto vt : vts) {
+    pool.Unregister(vt);
+    vterm_free(vt);
+  }
+  return (double)corpus.size() * panes / elapsed / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+  auto threads = std::thread::hardware_concurrency();
+  auto corpus = flood(4 * 1024 * 1024);
+
+  printf("%6s %12s %12s %8s\n", "panes", "inline MB/s", "pool MB/s",
+         "speedup");
+  for (size_t panes : {1, 4, 16, 64}) {
+    auto single = run(0, panes, corpus);
+    auto pooled = run(threads, panes, corpus);
+    printf("%6zu %12.1f %12.1f %8.2f\n", panes, single, pooled,
+           pooled / single);
+  }
+  return 0;
+}
@@ -0,0 +1,108 @@
+// How long output parsed on a worker waits before the loop draws it.
+//
+// A typist thread writes one key every INTERVAL_MS into a pipe that stands
+// for a pane. The loop sleeps in Select like mtm does, hands what it reads
+// to a ParsePool with one worker and "draws" once it sees the worker is
+// done. A key is timed from its write to that draw, with the worker waking
+// the loop through Events::Wake as mtm does and without, where only the
+// next key wakes it. The number of keys can be given as argument.
+#include "../events.h"
+#include "../parse_pool.h"
+#include "../selector.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const int INTERVAL_MS = 20;
+
+static void run(bool wake, int keys) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    perror("pipe");
+    exit(EXIT_FAILURE);
+  }
+  auto &selector = Selector::Instance();
+  selector.Register(fds[0]);
+
+  ParsePool pool(1);
+  std::atomic<int> parsed{0};
+  pool.Register(&parsed, [&parsed](const char *, size_t n) {
+    parsed.fetch_add((int)n, std::memory_order_release);
+  });
+  if (wake) {
+    pool.OnParsed([](void *) { Events::Instance().Wake(); });
+  }
+
+  std::vector<Clock::time_point> written(keys);
+  std::thread typist([&]() {
+    for (int i = 0; i < keys; ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(INTERVAL_MS));
+      written[i] = Clock::now();
+      (void)!write(fds[1], "k", 1);
+    }
+    // a last wake for the loop to see the last key
+    std::this_thread::sleep_for(std::chrono::milliseconds(INTERVAL_MS));
+    close(fds[1]);
+  });
+
+  std::vector<double> latency;
+  int drawn = 0;
+  bool open = true;
+  while (drawn < keys) {
+    selector.Select(open ? -1 : INTERVAL_MS);
+    Events::Instance().Dispatch();
+    while (open) {
+      auto data = selector.Read(fds[0]);
+      if (!data) {
+        open = false;
+      } else if (data->empty()) {
+        break;
+      } else {
+        pool.Submit(&parsed, *data);
+      }
+    }
+    auto now = Clock::now();
+    for (int done = parsed.load(std::memory_order_acquire); drawn < done;
+         ++drawn) {
+      latency.push_back(
+          std::chrono::duration<double, std::micro>(now - written[drawn])
+              .count());
+    }
+  }
+  typist.join();
+  pool.Unregister(&parsed);
+  selector.Unregister(fds[0]);
+  close(fds[0]);
+
+  std::sort(latency.begin(), latency.end());
+  // drawn only after the next key came
+  auto late = std::count_if(latency.begin(), latency.end(),
+                            [](double us) { return us > 1000; });
+  printf("%-8s %10.0f %10.0f %10.0f %10zd\n", wake ? "wake" : "no wake",
+         latency[latency.size() / 2], latency[latency.size() * 99 / 100],
+         latency.back(), late);
+}
+
+int main(int argc, char **argv) {
+  int keys = argc > 1 ? atoi(argv[1]) : 200;
+  if (keys <= 0) {
+    printf("usage: %s [keys > 0]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  Selector::Instance().Initialize();
+  // before any thread, for the signal mask
+  Events::Instance();
+
+  printf("%-8s %10s %10s %10s %10s   (us, a key every %d ms)\n", "", "p50",
+         "p99", "max", "over 1 ms", INTERVAL_MS);
+  run(false, keys);
+  run(true, keys);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,290 @@
+// Throughput of the emulators on typical kinds of terminal output.
+//
+// Every corpus is generated from a fixed seed, so runs compare. Each one is
+// fed in pty sized chunks through
+//   vtparser  vtwrite and the mtm.cpp handlers, drawing into curses pads
+//   libvterm  vterm_input_write on a bare VTermScreen
+//   node      NODE::parse, libvterm with the callbacks mtm runs in a pane,
+//             which fill the grid snapshot and the scrollback
+// The median of a fixed number of passes is reported. A corpus name and the
+// number of passes can be given as arguments.
+#include "../mtm.h"
+#include "../node.h"
+#include "../term.h"
+#include "../utf8.h"
+#include "../vtparser.h"
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <locale.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <vterm.h>
+
+using namespace term_screen;
+
+static const SIZE SCREEN = {50, 200};
+static const size_t CORPUS_SIZE = 1024 * 1024;
+static const size_t CHUNK = 4096;
+
+// the same numbers on every run
+struct Random {
+  uint64_t State = 0x9e3779b97f4a7c15;
+  uint32_t operator()(uint32_t n) {
+    State = State * 6364136223846793005 + 1442695040888963407;
+    return (State >> 33) % n;
+  }
+};
+
+static const char *WORDS[] = {"the",   "quick",  "brown",   "fox",
+                              "jumps", "over",   "lazy",    "dog",
+                              "make",  "target", "include", "return"};
+
+static std::string word(Random &r) { return WORDS[r(std::size(WORDS))]; }
+
+// lines of words, like cat on a source file
+static std::string ascii(Random &r) {
+  std::string out;
+  while (out.size() < CORPUS_SIZE) {
+    for (int n = r(12); n >= 0; --n) {
+      out += word(r);
+      out += ' ';
+    }
+    out += "\r\n";
+  }
+  return out;
+}
+
+// every word in another 256 color, like ls --color or a syntax highlighter
+static std::string sgr(Random &r) {
+  std::string out;
+  char buf[64];
+  while (out.size() < CORPUS_SIZE) {
+    for (int n = r(12); n >= 0; --n) {
+      snprintf(buf, sizeof(buf), "\033[%d;38;5;%u;48;5;%um", r(2) ? 1 : 22,
+               r(256), r(256));
+      out += buf;
+      out += word(r);
+      out += "\033[0m ";
+    }
+    out += "\r\n";
+  }
+  return out;
+}
+
+// short text all over the screen, like top or a progress display
+static std::string motion(Random &r) {
+  std::string out;
+  char buf[64];
+  while (out.size() < CORPUS_SIZE) {
+    snprintf(buf, sizeof(buf), "\033[%u;%uH", r(SCREEN.Rows) + 1,
+             r(SCREEN.Cols - 16) + 1);
+    out += buf;
+    out += word(r);
+    switch (r(4)) {
+    case 0:
+      out += "\033[K";
+      break;
+    case 1:
+      snprintf(buf, sizeof(buf), "\033[%uA\033[%uC", r(4) + 1, r(8) + 1);
+      out += buf;
+      break;
+    default:
+      break;
+    }
+  }
+  return out;
+}
+
+// wide CJK characters and emoji between ASCII
+static std::string utf8(Random &r) {
+  std::string out;
+  while (out.size() < CORPUS_SIZE) {
+    for (int n = r(40); n >= 0; --n) {
+      switch (r(4)) {
+      case 0:
+        pututf8(out, 0x1f600 + r(80));
+        break;
+      case 1:
+        out += word(r);
+        out += ' ';
+        break;
+      default:
+        pututf8(out, 0x4e00 + r(0x5000));
+        break;
+      }
+    }
+    out += "\r\n";
+  }
+  return out;
+}
+
+// long lines that wrap and scroll, like a build or a server log
+static std::string log(Random &r) {
+  std::string out;
+  char buf[64];
+  for (unsigned i = 0; out.size() < CORPUS_SIZE; ++i) {
+    snprintf(buf, sizeof(buf), "2024-01-01T00:%02u:%02u.%06u [%s] ",
+             i / 60 % 60, i % 60, r(1000000), r(8) ? "INFO" : "WARN");
+    out += buf;
+    for (int n = r(60) + 10; n >= 0; --n) {
+      out += word(r);
+      out += ' ';
+    }
+    out += "\r\n";
+  }
+  return out;
+}
+
+// an editor scrolling and repainting, with a status line
+static std::string vim(Random &r) {
+  std::string out;
+  char buf[64];
+  snprintf(buf, sizeof(buf), "\033[?1049h\033[1;%dr", SCREEN.Rows - 1);
+  out += buf;
+  while (out.size() < CORPUS_SIZE) {
+    if (r(4)) {
+      // scroll by a few lines and draw the new ones
+      int lines = r(3) + 1;
+      snprintf(buf, sizeof(buf), "\033[%dS", lines);
+      out += buf;
+      for (int y = SCREEN.Rows - lines; y < SCREEN.Rows; ++y) {
+        snprintf(buf, sizeof(buf), "\033[%d;1H\033[33m%4d \033[m", y, y);
+        out += buf;
+        for (int n = r(12); n >= 0; --n) {
+          out += r(3) ? "\033[36m" : "\033[1;35m";
+          out += word(r);
+          out += "\033[m ";
+        }
+        out += "\033[K";
+      }
+    } else {
+      // a full repaint
+      out += "\033[H\033[2J";
+      for (int y = 1; y < SCREEN.Rows; ++y) {
+        snprintf(buf, sizeof(buf), "\033[%d;1H\033[33m%4d \033[m", y, y);
+        out += buf;
+        for (int n = r(12); n >= 0; --n) {
+          out += word(r);
+          out += ' ';
+        }
+      }
+    }
+    snprintf(buf, sizeof(buf), "\033[%d;1H\033[7m", SCREEN.Rows);
+    out += buf;
+    out += " NORMAL  main.cpp  ";
+    out += std::to_string(r(10000));
+    out += "\033[K\033[m";
+    snprintf(buf, sizeof(buf), "\033[%u;%uH", r(SCREEN.Rows - 1) + 1,
+             r(SCREEN.Cols) + 1);
+    out += buf;
+  }
+  return out;
+}
+
+struct CORPUS {
+  const char *Name;
+  std::string (*Make)(Random &);
+};
+
+static const CORPUS CORPORA[] = {
+    {"ascii", ascii}, {"sgr", sgr}, {"motion", motion},
+    {"utf8", utf8},   {"log", log}, {"vim", vim},
+};
+
+// a parser, made fresh for every pass
+struct PARSER {
+  const char *Name;
+  std::function<std::function<void(const char *, size_t)>()> Start;
+};
+
+// seconds of one pass through data
+static double pass(const PARSER &parser, const std::string &data) {
+  auto write = parser.Start();
+  auto start = std::chrono::steady_clock::now();
+  for (size_t off = 0; off < data.size(); off += CHUNK) {
+    write(data.data() + off, std::min(CHUNK, data.size() - off));
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : nullptr;
+  long passes = 5;
+  if (argc > 2) {
+    char *end;
+    passes = strtol(argv[2], &end, 10);
+    if (*end || passes <= 0) {
+      printf("usage: %s [corpus] [passes > 0]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  setlocale(LC_ALL, "");
+  // the pads of the vtparser handlers need curses
+  if (!Term::Insance().Initialize(true)) {
+    printf("could not initialize curses\n");
+    return EXIT_FAILURE;
+  }
+
+  // kept alive between passes, so that only parsing is timed
+  std::shared_ptr<NODE> node;
+  std::shared_ptr<VTPARSER> vp;
+  VTerm *vt = nullptr;
+  std::vector<PARSER> parsers = {
+      {"vtparser",
+       [&]() {
+         node = std::make_shared<NODE>(POS{0, 0}, SCREEN);
+         vp = std::make_shared<VTPARSER>();
+         *vp = {};
+         setupevents(vp.get(), node.get());
+         return [&](const char *b, size_t n) { vtwrite(vp.get(), b, n); };
+       }},
+      {"libvterm",
+       [&]() {
+         if (vt) {
+           vterm_free(vt);
+         }
+         vt = vterm_new(SCREEN.Rows, SCREEN.Cols);
+         vterm_set_utf8(vt, true);
+         vterm_screen_reset(vterm_obtain_screen(vt), true);
+         return [&](const char *b, size_t n) { vterm_input_write(vt, b, n); };
+       }},
+      {"node",
+       [&]() {
+         node = std::make_shared<NODE>(POS{0, 0}, SCREEN);
+         return [&](const char *b, size_t n) { node->parse(b, n); };
+       }},
+  };
+
+  printf("%-8s %-9s %10s %10s\n", "corpus", "parser", "MB/s", "ns/byte");
+  bool found = false;
+  for (auto &corpus : CORPORA) {
+    if (only && strcmp(only, corpus.Name)) {
+      continue;
+    }
+    found = true;
+    Random random;
+    auto data = corpus.Make(random);
+    for (auto &parser : parsers) {
+      std::vector<double> seconds;
+      for (long i = 0; i < passes; ++i) {
+        seconds.push_back(pass(parser, data));
+      }
+      std::sort(seconds.begin(), seconds.end());
+      auto median = seconds[seconds.size() / 2];
+      printf("%-8s %-9s %10.1f %10.2f\n", corpus.Name, parser.Name,
+             data.size() / median / 1e6, median * 1e9 / data.size());
+      fflush(stdout);
+    }
+  }
+  node.reset();
+  if (vt) {
+    vterm_free(vt);
+  }
+  return found ? EXIT_SUCCESS : EXIT_FAILURE;
+}
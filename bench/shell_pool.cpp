@@ -0,0 +1,143 @@
+// Split-to-prompt latency: from asking for a shell to its first output.
+//
+// fork is the forkpty and execl mtm used to do, spawn is Process::Fork on
+// posix_spawn and pool takes a shell from a ShellPool. The parent touches a
+// large heap first, since the cost of fork grows with the page tables of
+// mtm. Heap MiB and splits can be given as arguments.
+#include "../child_process.h"
+#include "../events.h"
+#include "../input_stream.h"
+#include "../shell_pool.h"
+#include "../timer_queue.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <pty.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace term_screen;
+using Clock = std::chrono::steady_clock;
+
+static const SIZE SPLIT_SIZE = {24, 80};
+
+// runs the loop for ms milliseconds, or until done returns true
+template <typename F> static bool pump(int ms, F done) {
+  auto end = Clock::now() + std::chrono::milliseconds(ms);
+  while (!done()) {
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    end - Clock::now())
+                    .count();
+    if (left <= 0) {
+      return false;
+    }
+    auto timeout = TimerQueue::Instance().Timeout();
+    InputStream::Instance().Poll(timeout < 0 ? std::min<int>(left, 10)
+                                             : std::min<int>(left, timeout));
+    TimerQueue::Instance().Run();
+    Events::Instance().Dispatch();
+  }
+  return true;
+}
+
+static bool output(void *handle) {
+  auto data = InputStream::Instance().Peek(handle);
+  return !data || !data->empty();
+}
+
+// what Process::Fork did before posix_spawn
+static pid_t forkshell(int *master, const char *shell) {
+  struct winsize ws = {.ws_row = SPLIT_SIZE.Rows, .ws_col = SPLIT_SIZE.Cols};
+  pid_t pid = forkpty(master, nullptr, nullptr, &ws);
+  if (pid == 0) {
+    setsid();
+    Events::ResetChild();
+    execl(shell, shell, nullptr);
+    _exit(127);
+  }
+  return pid;
+}
+
+static void report(const char *name, std::vector<double> &ms) {
+  std::sort(ms.begin(), ms.end());
+  if (ms.empty()) {
+    printf("%-6s %10s\n", name, "failed");
+    return;
+  }
+  printf("%-6s median %8.2f ms  p90 %8.2f ms  max %8.2f ms\n", name,
+         ms[ms.size() / 2], ms[ms.size() * 9 / 10], ms.back());
+}
+
+int main(int argc, char **argv) {
+  size_t heap = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1024;
+  int splits = argc > 2 ? atoi(argv[2]) : 20;
+  auto shell = Process::GetShell();
+  Events::Instance();
+
+  std::vector<char> ballast(heap * 1024 * 1024);
+  for (size_t i = 0; i < ballast.size(); i += 4096) {
+    ballast[i] = 1;
+  }
+  printf("%s, %zu MiB heap, %d splits\n", shell, heap, splits);
+
+  std::vector<double> ms;
+  for (int i = 0; i < splits; ++i) {
+    int master;
+    auto start = Clock::now();
+    pid_t pid = forkshell(&master, shell);
+    if (pid < 0) {
+      break;
+    }
+    auto handle = (void *)(intptr_t)master;
+    InputStream::Instance().Register(handle);
+    if (pump(5000, [&]() { return output(handle); })) {
+      ms.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+    }
+    InputStream::Instance().Unregister(handle);
+    close(master);
+    waitpid(pid, nullptr, 0);
+  }
+  report("fork", ms);
+
+  ms.clear();
+  for (int i = 0; i < splits; ++i) {
+    auto start = Clock::now();
+    auto process = Process::Fork(SPLIT_SIZE, "xterm", shell);
+    if (!process) {
+      break;
+    }
+    if (pump(5000, [&]() { return output(process->Handle()); })) {
+      ms.push_back(
+          std::chrono::duration<double, std::milli>(Clock::now() - start)
+              .count());
+    }
+  }
+  report("spawn", ms);
+
+  ms.clear();
+  {
+    ShellPool pool(2, SPLIT_SIZE, "xterm");
+    for (int i = 0; i < splits; ++i) {
+      // a user splits at most a few times a second
+      pump(200, []() { return false; });
+      auto start = Clock::now();
+      auto process = pool.Take(SPLIT_SIZE);
+      if (!process) {
+        break;
+      }
+      if (pump(5000, [&]() { return output(process->Handle()); })) {
+        ms.push_back(
+            std::chrono::duration<double, std::milli>(Clock::now() - start)
+                .count());
+      }
+    }
+  }
+  report("pool", ms);
+  return EXIT_SUCCESS;
+}
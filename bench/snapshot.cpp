@@ -0,0 +1,117 @@
+// Saving and restoring a large session.
+//
+// 100 panes of 50x200, each with 100k lines of history, are written into
+// one snapshot, then opened again and every pane restored as mtm does at
+// startup. A restore maps the histories; the last screen of lines is then
+// decoded, like a scrolled up pane would. Panes and lines can be given as
+// arguments.
+#include "../snapshot.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace term_screen;
+
+static double since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// a shell like line, a colored prompt and some text
+static void fill(std::vector<CELL> &line, int n) {
+  char text[160];
+  int len = snprintf(text, sizeof(text),
+                     "user@host:~/src$ make -j8 target-%08d && echo ok", n);
+  for (auto &cell : line) {
+    cell = {};
+  }
+  for (int x = 0; x < len && x < (int)line.size(); ++x) {
+    line[x].Char = text[x];
+    line[x].Width = 1;
+    line[x].Fg = x < 16 ? 2 : -1;
+    line[x].Bg = -1;
+  }
+}
+
+int main(int argc, char **argv) {
+  size_t npanes = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100;
+  size_t nlines = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100000;
+  const SIZE size = {50, 200};
+  char path[] = "/tmp/mtm-snapshot-XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return EXIT_FAILURE;
+  }
+  close(fd);
+
+  std::vector<std::unique_ptr<Scrollback>> histories;
+  std::vector<PANE_SNAPSHOT> panes(npanes);
+  std::vector<CELL> line(size.Cols);
+  for (size_t i = 0; i < npanes; ++i) {
+    histories.push_back(std::make_unique<Scrollback>(nlines));
+    for (size_t n = 0; n < nlines; ++n) {
+      fill(line, n);
+      histories.back()->Push(line);
+    }
+    auto &pane = panes[i];
+    pane.Size = size;
+    pane.Cells.resize((size_t)size.Rows * size.Cols);
+    pane.History = histories.back().get();
+  }
+  std::string shape;
+  for (size_t i = 1; i < npanes; ++i) {
+    shape += 'V';
+  }
+  for (size_t i = 0; i < npanes; ++i) {
+    shape += 'P';
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  if (!Snapshot::Write(path, shape, panes)) {
+    printf("write failed\n");
+    return EXIT_FAILURE;
+  }
+  auto write = since(start);
+  struct stat st;
+  stat(path, &st);
+  histories.clear();
+
+  start = std::chrono::steady_clock::now();
+  auto snapshot = Snapshot::Open(path);
+  if (!snapshot || snapshot->Panes() != npanes) {
+    printf("open failed\n");
+    return EXIT_FAILURE;
+  }
+  size_t restored = 0;
+  std::vector<CELL> cells;
+  for (size_t i = 0; i < npanes; ++i) {
+    histories.push_back(std::make_unique<Scrollback>(nlines));
+    PANE_SNAPSHOT pane;
+    pane.History = histories.back().get();
+    if (!snapshot->Pane(i, &pane)) {
+      printf("pane %zu failed\n", i);
+      return EXIT_FAILURE;
+    }
+    auto lines = pane.History->Size();
+    for (size_t y = lines - std::min(lines, (size_t)size.Rows); y < lines;
+         ++y) {
+      pane.History->Line(y, &cells);
+    }
+    restored += lines;
+  }
+  auto restore = since(start);
+  unlink(path);
+
+  printf("%zu panes x %zu lines, %.1f MiB\n", npanes, nlines,
+         st.st_size / (1024.0 * 1024.0));
+  printf("write   %8.3f s %8.1f MiB/s\n", write,
+         st.st_size / (1024.0 * 1024.0) / write);
+  printf("restore %8.3f s %8zu lines\n", restore, restored);
+  return restored == npanes * nlines ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -29,6 +29,8 @@ public:
   void WriteString(const char *b);
 
   void Resize(const SIZE &size);
+  // status as returned by waitpid once the child has exited
+  bool Exited(int *status = nullptr) const;
 };
 
 } // namespace term_screen
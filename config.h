@@ -3,6 +3,25 @@
 
 #define COMMAND_KEY 'g'
 #define SCROLLBACK 1000
+/* Input of at least this many bytes in one read is treated as a paste. A
+ * paste arrives in one write of the host terminal, while key repeat at
+ * 30 keys a second, or arrow keys of 3 bytes each, stay below it even when
+ * a slow turn lets them pile up. */
+#define PASTE_THRESHOLD 32
+/* Bytes of a pane waiting for a parse worker before its output is left in
+ * the kernel, so that a flood cannot grow the queue without bound. */
+#define PARSE_BACKLOG (1024 * 1024)
+/* Milliseconds a pane size must be stable before the child is told, unless
+ * -d is given. */
+#define RESIZE_DELAY 100
+/* Bytes kept for a pipe-pane command that falls behind before dropping. */
+#define PIPE_PANE_BUFFER (1024 * 1024)
+/* Lines kept per pane after they scroll off the top, unless -l is given. */
+#define SCROLLBACK_LINES 10000
+/* Also put text copied in copy mode on the host clipboard with OSC 52. */
+#define COPY_TO_HOST 1
+/* Seconds without output before a pane monitored for silence alerts. */
+#define SILENCE_SECONDS 30
 #define DEFAULT_TERMINAL "screen-bce"
 #define DEFAULT_256_COLOR_TERMINAL "screen-256color-bce"
 
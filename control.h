@@ -0,0 +1,55 @@
+#pragma once
+#include "session.h"
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <string>
+
+namespace term_screen {
+
+class Layout;
+
+// Control mode: mtm driven by a program instead of a terminal.
+//
+// Messages are framed as in a session. The client sends COMMANDs, the
+// commands of headless mode, and gets a REPLY for each. mtm sends a LAYOUT
+// whenever the panes change, and the raw output of every pane, batched
+// into one OUTPUT message per event-loop turn and written with one call.
+// What a client does not read right away is queued for it, never waited
+// for; one that falls 16 MiB behind is disconnected.
+class Control {
+
+  struct ControlImpl *m_impl = nullptr;
+
+  Control();
+
+public:
+  Control(const Control &) = delete;
+  Control &operator=(const Control &) = delete;
+  // says BYE to the client and removes the socket
+  ~Control();
+
+  // "-" is stdin and stdout, anything else a Unix socket for one client at
+  // a time, replacing a stale one but never a file or a socket somebody
+  // listens on. nullptr on failure, with errno set.
+  static std::unique_ptr<Control> Open(const char *path);
+
+  // handles what the last Select reported, calling onCommand for every
+  // COMMAND received
+  void Dispatch(const std::function<void(std::string &&line)> &onCommand);
+  // stdin ended, a socket waits for the next client instead
+  bool Closed() const;
+
+  // appended to the OUTPUT of this turn
+  void Output(uint32_t id, std::span<const char> data);
+  void Reply(const std::string &text);
+  // queues a LAYOUT if the panes changed
+  void Send(const Layout &layout);
+  // writes what was queued this turn
+  void Flush();
+  // bytes written that the client has not read yet
+  size_t Backlog() const;
+};
+
+} // namespace term_screen
@@ -0,0 +1,272 @@
+#include "copy_mode.h"
+#include "node.h"
+#include "utf8.h"
+#include <algorithm>
+#include <curses.h>
+#include <limits.h>
+#include <vector>
+
+#define CTL(x) ((x)&0x1f)
+
+namespace term_screen {
+
+enum class SELECT {
+  NONE,
+  // from the anchor to the cursor, like running text
+  CHARS,
+  // every line between the anchor and the cursor
+  LINES,
+  // the columns between the anchor and the cursor on those lines
+  RECT,
+};
+
+// Scrollback::Text for a row of the frozen screen
+static void celltext(const std::vector<CELL> &cells, int from, int to,
+                     std::string *out) {
+  auto kept = out->size();
+  to = std::min(to, (int)cells.size());
+  for (int x = std::max(from, 0); x < to; ++x) {
+    auto c = cells[x].Char;
+    if (cells[x].Width == 0) {
+      continue;
+    }
+    if (c == 0 || c == ' ') {
+      *out += ' ';
+    } else {
+      pututf8(*out, c);
+      kept = out->size();
+    }
+  }
+  out->resize(kept);
+}
+
+struct CopyModeImpl {
+  std::shared_ptr<NODE> m_node;
+  std::shared_ptr<const FRAME> m_frame;
+  // the first history line and the number of them when the mode started.
+  // Lines 0 to m_lines - 1 are history, the frozen screen follows.
+  uint64_t m_first = 0;
+  int64_t m_lines = 0;
+
+  // the line at the top of the view
+  int64_t m_top = 0;
+  int64_t m_y = 0;
+  int m_x = 0;
+  SELECT m_select = SELECT::NONE;
+  int64_t m_anchorY = 0;
+  int m_anchorX = 0;
+  bool m_dirty = true;
+
+  std::vector<CELL> m_cells;
+
+  int64_t Lines() const { return m_lines + m_frame->Size.Rows; }
+  int Rows() const { return m_node->Size.Rows; }
+  int Cols() const { return m_node->Size.Cols; }
+
+  // history line y as it is now, -1 if it has been trimmed since
+  int64_t History(int64_t y) const {
+    auto number = m_first + y;
+    auto dropped = m_node->m_history.Dropped();
+    return number < dropped ? -1 : (int64_t)(number - dropped);
+  }
+
+  // the cells of line y, call with the pane locked
+  const std::vector<CELL> &Cells(int64_t y) {
+    if (y >= m_lines) {
+      return m_frame->Rows[y - m_lines]->Cells;
+    }
+    auto i = History(y);
+    if (i < 0) {
+      m_cells.clear();
+    } else {
+      m_node->m_history.Line(i, &m_cells);
+    }
+    return m_cells;
+  }
+
+  // appends columns from to to of line y, call with the pane locked
+  void Text(int64_t y, int from, int to, std::string *out) {
+    if (y >= m_lines) {
+      celltext(m_frame->Rows[y - m_lines]->Cells, from, to, out);
+    } else if (auto i = History(y); i >= 0) {
+      m_node->m_history.Text(i, from, to, out);
+    }
+  }
+
+  // the selected columns of line y, from >= to if there are none
+  void Selected(int64_t y, int *from, int *to) const {
+    *from = *to = 0;
+    auto top = std::min(m_anchorY, m_y);
+    auto bottom = std::max(m_anchorY, m_y);
+    if (m_select == SELECT::NONE || y < top || y > bottom) {
+      return;
+    }
+    switch (m_select) {
+    case SELECT::NONE:
+      break;
+    case SELECT::LINES:
+      *to = INT_MAX;
+      break;
+    case SELECT::RECT:
+      *from = std::min(m_anchorX, m_x);
+      *to = std::max(m_anchorX, m_x) + 1;
+      break;
+    case SELECT::CHARS: {
+      bool forward = m_anchorY < m_y || (m_anchorY == m_y && m_anchorX <= m_x);
+      auto first = forward ? m_anchorX : m_x;
+      auto last = forward ? m_x : m_anchorX;
+      *from = y == top ? first : 0;
+      *to = y == bottom ? last + 1 : INT_MAX;
+      break;
+    }
+    }
+  }
+
+  std::string Copy() {
+    std::string out;
+    auto top = std::min(m_anchorY, m_y);
+    auto bottom = std::max(m_anchorY, m_y);
+    std::scoped_lock<std::mutex> lock(m_node->m_mutex);
+    for (auto y = top; y <= bottom; ++y) {
+      int from, to;
+      Selected(y, &from, &to);
+      Text(y, from, to, &out);
+      if (y < bottom) {
+        out += '\n';
+      }
+    }
+    return out;
+  }
+
+  void Move(int64_t dy, int dx) {
+    m_y = std::clamp<int64_t>(m_y + dy, 0, Lines() - 1);
+    m_x = std::clamp(m_x + dx, 0, Cols() - 1);
+    if (m_y < m_top) {
+      m_top = m_y;
+    } else if (m_y >= m_top + Rows()) {
+      m_top = m_y - Rows() + 1;
+    }
+    m_dirty = true;
+  }
+
+  void Toggle(SELECT select) {
+    m_select = m_select == select ? SELECT::NONE : select;
+    m_anchorY = m_y;
+    m_anchorX = m_x;
+    m_dirty = true;
+  }
+};
+
+CopyMode::CopyMode() : m_impl(new CopyModeImpl) {}
+
+CopyMode::~CopyMode() {
+  // the next blit redraws every row of the emulator
+  m_impl->m_node->m_drawn.reset();
+  delete m_impl;
+}
+
+std::unique_ptr<CopyMode> CopyMode::Start(const std::shared_ptr<NODE> &node) {
+#if USE_VTERM
+  auto ptr = std::unique_ptr<CopyMode>(new CopyMode);
+  auto &impl = *ptr->m_impl;
+  impl.m_node = node;
+  {
+    std::scoped_lock<std::mutex> lock(node->m_mutex);
+    impl.m_frame = node->m_grid.Acquire();
+    impl.m_first = node->m_history.Dropped();
+    impl.m_lines = node->m_history.Size();
+  }
+  if (!impl.m_frame) {
+    return {};
+  }
+  impl.m_top = impl.m_lines;
+  impl.m_y = impl.m_lines + std::min<int>(impl.m_frame->Cursor.Y,
+                                          impl.m_frame->Size.Rows - 1);
+  impl.m_x = impl.m_frame->Cursor.X;
+  impl.Move(0, 0);
+  return ptr;
+#else
+  return {};
+#endif
+}
+
+NODE *CopyMode::Node() const { return m_impl->m_node.get(); }
+
+bool CopyMode::Key(const Input &input, std::string *copied) {
+  auto &impl = *m_impl;
+  auto page = std::max(impl.Rows() - 1, 1);
+  if (input.CODE(KEY_UP) || input.KEY(L'k')) {
+    impl.Move(-1, 0);
+  } else if (input.CODE(KEY_DOWN) || input.KEY(L'j')) {
+    impl.Move(1, 0);
+  } else if (input.CODE(KEY_LEFT) || input.KEY(L'h')) {
+    impl.Move(0, -1);
+  } else if (input.CODE(KEY_RIGHT) || input.KEY(L'l')) {
+    impl.Move(0, 1);
+  } else if (input.CODE(KEY_PPAGE) || input.KEY(CTL('b'))) {
+    impl.Move(-page, 0);
+  } else if (input.CODE(KEY_NPAGE) || input.KEY(CTL('f'))) {
+    impl.Move(page, 0);
+  } else if (input.KEY(L'g')) {
+    impl.Move(-impl.Lines(), 0);
+  } else if (input.KEY(L'G')) {
+    impl.Move(impl.Lines(), 0);
+  } else if (input.KEY(L'0') || input.CODE(KEY_HOME)) {
+    impl.Move(0, -impl.Cols());
+  } else if (input.KEY(L'$') || input.CODE(KEY_END)) {
+    impl.Move(0, impl.Cols());
+  } else if (input.KEY(L'v') || input.KEY(L' ')) {
+    impl.Toggle(SELECT::CHARS);
+  } else if (input.KEY(L'V')) {
+    impl.Toggle(SELECT::LINES);
+  } else if (input.KEY(L'r') || input.KEY(CTL('v'))) {
+    impl.Toggle(SELECT::RECT);
+  } else if (input.KEY(L'y') || input.KEY(L'\r') || input.KEY(L'\n') ||
+             input.CODE(KEY_ENTER)) {
+    if (impl.m_select != SELECT::NONE) {
+      *copied = impl.Copy();
+    }
+    return false;
+  } else if (input.KEY(L'q') || input.KEY(L'\033')) {
+    return false;
+  }
+  return true;
+}
+
+void CopyMode::Draw() {
+  auto &impl = *m_impl;
+  if (!impl.m_dirty) {
+    return;
+  }
+  impl.m_dirty = false;
+  auto n = impl.m_node.get();
+  auto s = n->s;
+  std::scoped_lock<std::mutex> lock(n->m_mutex);
+  for (int row = 0; row < impl.Rows(); ++row) {
+    auto y = impl.m_top + row;
+    int x = 0;
+    if (y < impl.Lines()) {
+      auto &cells = impl.Cells(y);
+      for (; x < std::min<int>(cells.size(), impl.Cols()); ++x) {
+        if (cells[x].Width == 0) {
+          continue;
+        }
+        s->WriteCell({s->tos + row, x}, cells[x].Char ? cells[x].Char : L' ',
+                     cells[x].Fg, cells[x].Bg);
+      }
+    }
+    for (; x < impl.Cols(); ++x) {
+      s->WriteCell({s->tos + row, x}, L' ', -1, -1);
+    }
+    int from, to;
+    impl.Selected(y, &from, &to);
+    to = std::min(to, impl.Cols());
+    if (from < to) {
+      s->Reverse({s->tos + row, from}, to - from);
+    }
+  }
+  s->MoveCursor({s->tos + (int)(impl.m_y - impl.m_top), impl.m_x});
+  s->vis = 1;
+}
+
+} // namespace term_screen
@@ -0,0 +1,39 @@
+#pragma once
+#include "screen.h"
+#include <memory>
+#include <string>
+
+namespace term_screen {
+
+struct NODE;
+
+// Selects text of a pane and its history with the keyboard.
+//
+// The screen is frozen when the mode starts and the view is drawn into the
+// pad of the pane instead of the emulator output, which keeps running
+// behind it. History lines are remembered by number, so lines trimmed in
+// the meantime show up as blank instead of shifting the view. Copying
+// reads just the selected columns of the selected lines.
+class CopyMode {
+
+  struct CopyModeImpl *m_impl = nullptr;
+
+  CopyMode();
+
+public:
+  CopyMode(const CopyMode &) = delete;
+  CopyMode &operator=(const CopyMode &) = delete;
+  // the pane shows the emulator again
+  ~CopyMode();
+
+  // nullptr if the pane keeps no history
+  static std::unique_ptr<CopyMode> Start(const std::shared_ptr<NODE> &node);
+
+  NODE *Node() const;
+  // false once the mode ends. A copy ends it and sets *copied.
+  bool Key(const Input &input, std::string *copied);
+  // redraws the pad after a key moved the view or the selection
+  void Draw();
+};
+
+} // namespace term_screen
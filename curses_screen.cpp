@@ -33,8 +33,7 @@ void SCRN::scrollbottom() { off = tos; }
 void SCRN::draw(const POS &pos, const SIZE &size) const /* Draw a node. */
 {
   pnoutrefresh(win, off, 0, pos.Y, pos.X, pos.Y + size.Rows - 1,
-               pos.X + size.Rows - 1);
-  doupdate();
+               pos.X + size.Cols - 1);
 }
 
 void SCRN::fixcursor(
@@ -83,4 +82,33 @@ void SCRN::WriteCell(const POS &pos, wchar_t ch, int fg, int bg) {
   waddnwstr(win, &ch, 1);
 }
 
+void SCRN::Reverse(const POS &pos, int cols) {
+  mvwchgat(win, pos.Y, pos.X, cols, A_REVERSE, 0, nullptr);
+}
+
+size_t SCRN::Bytes() const {
+  // a line is its cells and the struct ldat that curses keeps for it
+  return sizeof(WINDOW) +
+         (size_t)getmaxy(win) * (getmaxx(win) * sizeof(cchar_t) +
+                                 4 * sizeof(void *));
+}
+
+void DrawVLine(const POS &pos, uint16_t rows) {
+  mvwvline(stdscr, pos.Y, pos.X, ACS_VLINE, rows);
+  wnoutrefresh(stdscr);
+}
+
+void DrawHLine(const POS &pos, uint16_t cols) {
+  mvwhline(stdscr, pos.Y, pos.X, ACS_HLINE, cols);
+  wnoutrefresh(stdscr);
+}
+
+void DrawStatus(const POS &pos, uint16_t cols, const char *text) {
+  wattron(stdscr, A_REVERSE);
+  mvwhline(stdscr, pos.Y, pos.X, ' ', cols);
+  mvwaddnstr(stdscr, pos.Y, pos.X, text, cols);
+  wattroff(stdscr, A_REVERSE);
+  wnoutrefresh(stdscr);
+}
+
 } // namespace term_screen
@@ -1,13 +1,31 @@
 #include "term.h"
+#include "selector.h"
 #include <curses.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
 
 namespace term_screen {
 
-Term::Term() {}
+// the selector is created first so that it outlives the terminal
+Term::Term() { Selector::Instance(); }
 
-Term::~Term() { endwin(); }
+Term::~Term() {
+  endwin();
+  Selector::Instance().Flush();
+}
 
-bool Term::Initialize() { return initscr(); }
+bool Term::Initialize(bool headless) {
+  if (headless) {
+    // the pads still need a screen, of any type when TERM is not set
+    auto null = fopen("/dev/null", "r+");
+    return null && newterm(getenv("TERM") ? nullptr : "vt100", null, null);
+  }
+  // curses sets the modes of and writes to the fd of the stream, a stream
+  // without one leaves the terminal cooked and blank. It buffers a frame
+  // and writes it in one call by itself.
+  return newterm(nullptr, stdout, stdin);
+}
 
 void Term::RawMode() {
 
@@ -19,6 +37,23 @@ void Term::RawMode() {
   use_default_colors();
 }
 
+SIZE Term::Size() const {
+  return {.Rows = (uint16_t)LINES, .Cols = (uint16_t)COLS};
+}
+
+SIZE Term::Resize() {
+  struct winsize ws = {};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row && ws.ws_col) {
+    resize_term(ws.ws_row, ws.ws_col);
+  }
+  return Size();
+}
+
+size_t Term::Pending() const {
+  int n = 0;
+  return ioctl(STDIN_FILENO, FIONREAD, &n) == 0 && n > 0 ? n : 0;
+}
+
 const int COLOR_MAX = 256;
 
 short Term::AllocPair(int fg, int bg) {
@@ -42,4 +77,27 @@ short Term::AllocPair(int fg, int bg) {
   return m_pairs.size();
 }
 
+void Term::Clipboard(const std::string &text) {
+  static const char digits[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string out = "\033]52;c;";
+  out.reserve(out.size() + (text.size() + 2) / 3 * 4 + 1);
+  for (size_t i = 0; i < text.size(); i += 3) {
+    uint32_t n = (uint8_t)text[i] << 16;
+    if (i + 1 < text.size()) {
+      n |= (uint8_t)text[i + 1] << 8;
+    }
+    if (i + 2 < text.size()) {
+      n |= (uint8_t)text[i + 2];
+    }
+    out += digits[n >> 18];
+    out += digits[(n >> 12) & 0x3f];
+    out += i + 1 < text.size() ? digits[(n >> 6) & 0x3f] : '=';
+    out += i + 2 < text.size() ? digits[n & 0x3f] : '=';
+  }
+  out += '\a';
+  // in the output buffer of curses, never inside a frame
+  putp(out.c_str());
+}
+
 }
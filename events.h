@@ -0,0 +1,55 @@
+#pragma once
+#include <functional>
+#include <spawn.h>
+
+// Delivers signals and child exits to the event loop.
+//
+// SIGWINCH, SIGTERM, SIGHUP and SIGUSR1 arrive through a signalfd and every
+// child is watched through a pidfd, both polled by the Selector next to the
+// ptys.
+// Without signalfd or pidfd a self-pipe written by the signal handlers is
+// used instead. Create
+// the instance before any thread is started, the signals are blocked in the
+// calling thread and the mask is inherited.
+class Events {
+
+  struct EventsImpl *m_impl = nullptr;
+
+  Events();
+
+public:
+  Events(const Events &) = delete;
+  Events &operator=(const Events &) = delete;
+  ~Events();
+
+  static Events &Instance() {
+    static Events s_instance;
+    return s_instance;
+  }
+
+  // restores the signal mask in a forked child
+  static void ResetChild();
+  // the same for a child started by posix_spawn
+  static void ResetSpawn(posix_spawnattr_t *attr);
+
+  // handles what the last Select reported
+  void Dispatch();
+
+  // true once for any number of SIGWINCH since the last call, so that a
+  // window drag reshapes once per frame
+  bool Resized();
+  // SIGTERM or SIGHUP arrived, the loop saves what it can and exits
+  bool Terminated() const;
+  // true once after any number of SIGUSR1, which asks for the metrics and
+  // the trace
+  bool DumpRequested();
+
+  // makes the current or the next Select return, from any thread; a parse
+  // worker calls it so that its output is drawn without waiting for input
+  void Wake();
+
+  // onexit receives the waitpid status
+  void WatchChild(int pid, const std::function<void(int status)> &onexit);
+  // the child is still reaped, without notification
+  void UnwatchChild(int pid);
+};
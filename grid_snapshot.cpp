@@ -0,0 +1,75 @@
+#include "grid_snapshot.h"
+#include <algorithm>
+
+namespace term_screen {
+
+GridSnapshot::GridSnapshot(const SIZE &size) { Resize(size); }
+
+void GridSnapshot::Resize(const SIZE &size) {
+  m_size = size;
+  m_dirty.assign(size.Rows, true);
+  m_anyDirty = true;
+}
+
+void GridSnapshot::Damage(int top, int bottom) {
+  top = std::max(top, 0);
+  bottom = std::min(bottom, (int)m_dirty.size());
+  for (int y = top; y < bottom; ++y) {
+    m_dirty[y] = true;
+  }
+  m_anyDirty = m_anyDirty || top < bottom;
+}
+
+void GridSnapshot::Publish(const FetchFunc &fetch, const POS &cursor,
+                           bool visible) {
+  auto prev = Acquire();
+  auto frame = std::make_shared<FRAME>();
+  frame->Seq = ++m_seq;
+  frame->Size = m_size;
+  frame->Cursor = cursor;
+  frame->CursorVisible = visible;
+  frame->Rows.resize(m_size.Rows);
+
+  bool sameSize = prev && prev->Size == m_size;
+  for (int y = 0; y < m_size.Rows; ++y) {
+    if (sameSize && !m_dirty[y]) {
+      frame->Rows[y] = prev->Rows[y];
+      continue;
+    }
+    auto row = std::make_shared<ROW>();
+    row->Seq = frame->Seq;
+    row->Cells.resize(m_size.Cols);
+    fetch(y, row->Cells);
+    if (sameSize && prev->Rows[y]->Cells == row->Cells) {
+      // damaged but rewritten with the same content
+      frame->Rows[y] = prev->Rows[y];
+    } else {
+      frame->Rows[y] = std::move(row);
+    }
+    m_dirty[y] = false;
+  }
+  m_anyDirty = false;
+
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  m_front = std::move(frame);
+}
+
+std::shared_ptr<const FRAME> GridSnapshot::Acquire() const {
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  return m_front;
+}
+
+size_t GridSnapshot::Bytes() const {
+  auto frame = Acquire();
+  if (!frame) {
+    return 0;
+  }
+  size_t bytes = sizeof(FRAME) +
+                 frame->Rows.capacity() * sizeof(std::shared_ptr<const ROW>);
+  for (auto &row : frame->Rows) {
+    bytes += sizeof(ROW) + row->Cells.capacity() * sizeof(CELL);
+  }
+  return bytes;
+}
+
+} // namespace term_screen
@@ -0,0 +1,80 @@
+#pragma once
+#include "screen.h"
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+namespace term_screen {
+
+enum CELL_ATTR : uint16_t {
+  ATTR_BOLD = 1 << 0,
+  ATTR_UNDERLINE = 1 << 1,
+  ATTR_ITALIC = 1 << 2,
+  ATTR_BLINK = 1 << 3,
+  ATTR_REVERSE = 1 << 4,
+};
+
+struct CELL {
+  uint32_t Char = 0;
+  short Fg = -1;
+  short Bg = -1;
+  uint16_t Attr = 0;
+  uint8_t Width = 1;
+
+  bool operator==(const CELL &rhs) const {
+    return Char == rhs.Char && Fg == rhs.Fg && Bg == rhs.Bg &&
+           Attr == rhs.Attr && Width == rhs.Width;
+  }
+};
+
+// A published row is never modified again, a change produces a new row.
+struct ROW {
+  uint64_t Seq = 0;
+  std::vector<CELL> Cells;
+};
+
+// A consistent view of a pane. Rows that did not change between two frames
+// are shared, so comparing row pointers tells the renderer what to redraw.
+struct FRAME {
+  uint64_t Seq = 0;
+  SIZE Size = {};
+  POS Cursor = {};
+  bool CursorVisible = true;
+  std::vector<std::shared_ptr<const ROW>> Rows;
+};
+
+// Copy-on-write row pages between the emulator and the renderer.
+//
+// The writer marks damaged rows while parsing and publishes a new frame
+// afterwards, copying only the damaged rows. The reader grabs the latest
+// frame at any time; the lock only guards the frame pointer, never a parse.
+class GridSnapshot {
+  mutable std::mutex m_mutex;
+  std::shared_ptr<const FRAME> m_front;
+
+  // writer side
+  SIZE m_size = {};
+  uint64_t m_seq = 0;
+  std::vector<bool> m_dirty;
+  bool m_anyDirty = true;
+
+public:
+  using FetchFunc = std::function<void(int y, std::vector<CELL> &cells)>;
+
+  GridSnapshot(const SIZE &size);
+
+  // writer
+  void Resize(const SIZE &size);
+  void Damage(int top, int bottom);
+  bool Dirty() const { return m_anyDirty; }
+  void Publish(const FetchFunc &fetch, const POS &cursor, bool visible);
+
+  // reader
+  std::shared_ptr<const FRAME> Acquire() const;
+  // heap bytes of the latest frame, rows shared with older frames included
+  size_t Bytes() const;
+};
+
+} // namespace term_screen
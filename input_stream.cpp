@@ -0,0 +1,267 @@
+#include "input_stream.h"
+#include "spsc_ring.h"
+#include <array>
+#include <assert.h>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+#if !defined(_WIN32)
+#include "pipe_pane.h"
+#include "selector.h"
+#include <stdio.h>
+#include <unistd.h>
+#endif
+
+// per handle
+static const size_t RING_SIZE = 256 * 1024;
+static const size_t MAX_HANDLES = 1024;
+
+/* An open addressed table, so that lookups from the producer and the
+ * consumer need no lock. Only Register and Unregister modify it. */
+struct Slot {
+  std::atomic<void *> Handle{nullptr};
+  std::atomic<SpscRing *> Ring{nullptr};
+#if !defined(_WIN32)
+  // only touched by the thread that polls
+  std::unique_ptr<PipePane> Pipe;
+  // the ring was full, the selector leaves the fd alone
+  bool Paused = false;
+#endif
+};
+
+static char g_removed;
+static void *const REMOVED = &g_removed;
+
+struct InputStreamImpl {
+  std::array<Slot, MAX_HANDLES> m_slots;
+#if !defined(_WIN32)
+  // the registered slots, so that Poll does not walk the whole table
+  std::vector<Slot *> m_live;
+#endif
+
+  static size_t Hash(void *handle) {
+    auto h = (uintptr_t)handle;
+    return (h ^ (h >> 12)) * 0x9e3779b97f4a7c15ull;
+  }
+
+  Slot *FindSlot(void *handle) {
+    auto h = Hash(handle);
+    for (size_t i = 0; i < MAX_HANDLES; ++i) {
+      auto &slot = m_slots[(h + i) % MAX_HANDLES];
+      auto key = slot.Handle.load(std::memory_order_acquire);
+      if (key == handle) {
+        return &slot;
+      }
+      if (!key) {
+        break;
+      }
+    }
+    return nullptr;
+  }
+
+  SpscRing *Find(void *handle) {
+    auto slot = FindSlot(handle);
+    return slot ? slot->Ring.load(std::memory_order_acquire) : nullptr;
+  }
+
+  void Register(void *handle) {
+    if (Find(handle)) {
+      return;
+    }
+    auto h = Hash(handle);
+    for (size_t i = 0; i < MAX_HANDLES; ++i) {
+      auto &slot = m_slots[(h + i) % MAX_HANDLES];
+      auto key = slot.Handle.load(std::memory_order_relaxed);
+      if (!key || key == REMOVED) {
+        slot.Ring.store(new SpscRing(RING_SIZE), std::memory_order_relaxed);
+        slot.Handle.store(handle, std::memory_order_release);
+#if !defined(_WIN32)
+        m_live.push_back(&slot);
+#endif
+        return;
+      }
+    }
+    assert(false && "too many handles");
+  }
+
+  void Unregister(void *handle) {
+    auto h = Hash(handle);
+    for (size_t i = 0; i < MAX_HANDLES; ++i) {
+      auto &slot = m_slots[(h + i) % MAX_HANDLES];
+      auto key = slot.Handle.load(std::memory_order_relaxed);
+      if (key == handle) {
+        slot.Handle.store(REMOVED, std::memory_order_release);
+        delete slot.Ring.exchange(nullptr);
+#if !defined(_WIN32)
+        slot.Pipe.reset();
+        slot.Paused = false;
+        for (auto &live : m_live) {
+          if (live == &slot) {
+            live = m_live.back();
+            m_live.pop_back();
+            break;
+          }
+        }
+#endif
+        return;
+      }
+      if (!key) {
+        return;
+      }
+    }
+  }
+
+#if !defined(_WIN32)
+  void Poll(int timeout) {
+    auto &selector = Selector::Instance();
+    for (auto slot : m_live) {
+      auto ring = slot->Ring.load(std::memory_order_acquire);
+      if (slot->Paused && ring && ring->Free() >= BUFSIZ) {
+        selector.Resume((int)(intptr_t)slot->Handle.load());
+        slot->Paused = false;
+      }
+    }
+    selector.Select(timeout);
+    for (auto slot : m_live) {
+      auto handle = slot->Handle.load(std::memory_order_acquire);
+      auto ring = slot->Ring.load(std::memory_order_acquire);
+      if (!ring || ring->Closed()) {
+        continue;
+      }
+      int fd = (int)(intptr_t)handle;
+      auto pipe = slot->Pipe.get();
+      // io_uring reads the pty by itself, splice only works beside the
+      // readiness backends
+      bool splice = pipe && pipe->CanSplice() &&
+                    selector.Current() != Selector::Backend::Uring &&
+                    selector.Ready(fd);
+      // leave the rest in the kernel until the consumer catches up
+      while (ring->Free() >= BUFSIZ) {
+        auto data = splice ? pipe->Splice(fd) : selector.Read(fd);
+        if (!data) {
+          selector.Unregister(fd);
+          ring->Close();
+          break;
+        }
+        if (data->empty()) {
+          break;
+        }
+        if (pipe && !splice) {
+          pipe->Copy(*data);
+        }
+        auto n = ring->Write(*data);
+        assert(n == data->size());
+      }
+      if (pipe) {
+        pipe->Flush();
+      }
+      if (ring->Free() < BUFSIZ && !ring->Closed()) {
+        // not polled in vain until the consumer catches up
+        selector.Pause(fd);
+        slot->Paused = true;
+      }
+    }
+  }
+
+  bool Pipe(void *handle, const char *command) {
+    auto slot = FindSlot(handle);
+    if (!slot) {
+      return false;
+    }
+    slot->Pipe.reset();
+    if (command && *command) {
+      slot->Pipe = PipePane::Open(command);
+      return slot->Pipe != nullptr;
+    }
+    return true;
+  }
+#endif
+};
+
+InputStream::InputStream() : m_impl(new InputStreamImpl) {
+#if !defined(_WIN32)
+  // keyboard input wakes up Poll
+  Selector::Instance().Watch(STDIN_FILENO);
+#endif
+}
+
+InputStream::~InputStream() {
+  for (auto &slot : m_impl->m_slots) {
+    delete slot.Ring.load();
+  }
+  delete m_impl;
+}
+
+void InputStream::Register(void *handle) {
+#if !defined(_WIN32)
+  Selector::Instance().Register((int)(intptr_t)handle);
+#endif
+  m_impl->Register(handle);
+}
+
+void InputStream::Unregister(void *handle) {
+#if !defined(_WIN32)
+  Selector::Instance().Unregister((int)(intptr_t)handle);
+#endif
+  m_impl->Unregister(handle);
+}
+
+void InputStream::Poll(int timeout) {
+#if !defined(_WIN32)
+  m_impl->Poll(timeout);
+#endif
+}
+
+bool InputStream::Pipe(void *handle, const char *command) {
+#if !defined(_WIN32)
+  return m_impl->Pipe(handle, command);
+#else
+  return false;
+#endif
+}
+
+const PipePane *InputStream::GetPipe(void *handle) {
+#if !defined(_WIN32)
+  auto slot = m_impl->FindSlot(handle);
+  return slot ? slot->Pipe.get() : nullptr;
+#else
+  return nullptr;
+#endif
+}
+
+size_t InputStream::Enqueue(void *handle, std::span<const char> data) {
+  auto ring = m_impl->Find(handle);
+  return ring ? ring->Write(data) : 0;
+}
+
+void InputStream::Close(void *handle) {
+  if (auto ring = m_impl->Find(handle)) {
+    ring->Close();
+  }
+}
+
+std::optional<std::span<const char>> InputStream::Peek(void *handle) {
+  auto ring = m_impl->Find(handle);
+  if (!ring) {
+    return std::nullopt;
+  }
+  // bytes written before Close are visible once Closed is
+  auto closed = ring->Closed();
+  auto data = ring->Peek();
+  if (data.empty() && closed) {
+    return std::nullopt;
+  }
+  return data;
+}
+
+void InputStream::Consume(void *handle, size_t n) {
+  if (auto ring = m_impl->Find(handle)) {
+    ring->Consume(n);
+  }
+}
+
+size_t InputStream::Bytes(void *handle) {
+  auto ring = m_impl->Find(handle);
+  return ring ? sizeof(SpscRing) + ring->Capacity() : 0;
+}
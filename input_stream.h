@@ -1,8 +1,13 @@
 #pragma once
+#include <optional>
 #include <span>
 #include <stdint.h>
-#include <vector>
 
+// Hands child output from the thread that reads it to the main loop.
+//
+// Every registered handle owns a single producer, single consumer ring, so
+// Enqueue and Peek/Consume never lock or allocate. Register and Unregister
+// must not race a producer of the same handle.
 class InputStream {
 
   struct InputStreamImpl *m_impl = nullptr;
@@ -21,7 +26,32 @@ public:
 
   void Register(void *handle);
   void Unregister(void *handle);
-  void Poll();
-  void Enqueue(void *handle, std::span<const char> data);
-  size_t Read(void *handle, std::vector<char> &buf);
+  // POSIX: waits up to timeout milliseconds and moves pty output of every
+  // registered handle into its ring. Other platforms enqueue from their
+  // reader threads and this does nothing.
+  void Poll(int timeout = -1);
+
+  // POSIX: copies the raw output of handle into the stdin of command, see
+  // PipePane. nullptr stops it. Call from the thread that polls.
+  bool Pipe(void *handle, const char *command);
+  const class PipePane *GetPipe(void *handle);
+
+  //
+  // producer
+  //
+  // returns the number of bytes that fitted
+  size_t Enqueue(void *handle, std::span<const char> data);
+  // the handle reached end of file
+  void Close(void *handle);
+
+  //
+  // consumer
+  //
+  // nullopt once the handle is closed and drained, an empty span if nothing
+  // is pending. The bytes stay valid until Consume.
+  std::optional<std::span<const char>> Peek(void *handle);
+  void Consume(void *handle, size_t n);
+
+  // the memory of the ring of handle, 0 if it is not registered
+  size_t Bytes(void *handle);
 };
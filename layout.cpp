@@ -0,0 +1,411 @@
+#include "layout.h"
+#include "node.h"
+#include <algorithm>
+
+namespace term_screen {
+
+/* A leaf holds a pane, a split holds two boxes and the border between. */
+struct BOX {
+  BOX *Parent = nullptr;
+  POS Pos = {};
+  SIZE Size = {};
+
+  std::shared_ptr<NODE> Pane;
+
+  SPLIT Split = SPLIT::HORIZONTAL;
+  std::unique_ptr<BOX> First;
+  std::unique_ptr<BOX> Second;
+
+  bool Contains(const POS &pos) const {
+    return pos.Y >= Pos.Y && pos.Y < Pos.Y + Size.Rows && pos.X >= Pos.X &&
+           pos.X < Pos.X + Size.Cols;
+  }
+};
+
+struct LayoutImpl {
+  POS m_pos;
+  SIZE m_size;
+  std::unique_ptr<BOX> m_root;
+  std::vector<std::shared_ptr<NODE>> m_panes;
+  BOX *m_focused = nullptr;
+  std::weak_ptr<NODE> m_last;
+
+  // a split needs a row or column for each half and one for the border
+  static bool CanSplit(const BOX *box, SPLIT split) {
+    return (split == SPLIT::HORIZONTAL ? box->Size.Cols : box->Size.Rows) >=
+           3;
+  }
+
+  // geometry of the halves of a split box
+  static void Halves(const BOX *box, POS *pos1, SIZE *size1, POS *pos2,
+                     SIZE *size2) {
+    *pos1 = box->Pos;
+    if (box->Split == SPLIT::HORIZONTAL) {
+      uint16_t w1 = (box->Size.Cols - 1) / 2;
+      *size1 = {box->Size.Rows, w1};
+      *pos2 = {box->Pos.Y, box->Pos.X + w1 + 1};
+      *size2 = {box->Size.Rows, (uint16_t)(box->Size.Cols - w1 - 1)};
+    } else {
+      uint16_t h1 = (box->Size.Rows - 1) / 2;
+      *size1 = {h1, box->Size.Cols};
+      *pos2 = {box->Pos.Y + h1 + 1, box->Pos.X};
+      *size2 = {(uint16_t)(box->Size.Rows - h1 - 1), box->Size.Cols};
+    }
+  }
+
+  static BORDER Border(const BOX *box) {
+    POS pos1, pos2;
+    SIZE size1, size2;
+    Halves(box, &pos1, &size1, &pos2, &size2);
+    if (box->Split == SPLIT::HORIZONTAL) {
+      return {{box->Pos.Y, pos2.X - 1}, box->Size.Rows, true};
+    } else {
+      return {{pos2.Y - 1, box->Pos.X}, box->Size.Cols, false};
+    }
+  }
+
+  static void DrawBorder(const BOX *box) {
+    auto border = Border(box);
+    if (border.Vertical) {
+      DrawVLine(border.Pos, border.Length);
+    } else {
+      DrawHLine(border.Pos, border.Length);
+    }
+  }
+
+  // lays out the children of a split box
+  void Arrange(BOX *box) {
+    POS pos1, pos2;
+    SIZE size1, size2;
+    Halves(box, &pos1, &size1, &pos2, &size2);
+    Reshape(box->First.get(), pos1, size1);
+    Reshape(box->Second.get(), pos2, size2);
+    DrawBorder(box);
+  }
+
+  // stops at boxes that keep their geometry
+  void Reshape(BOX *box, const POS &pos, const SIZE &size) {
+    if (box->Pos == pos && box->Size == size) {
+      return;
+    }
+    box->Pos = pos;
+    box->Size = size;
+    if (box->Pane) {
+      box->Pane->reshape(pos, size);
+    } else {
+      Arrange(box);
+    }
+  }
+
+  // the boxes of shape from *p on, false if a split does not fit
+  std::unique_ptr<BOX> Build(const std::string &shape, size_t *p, BOX *parent,
+                             const POS &pos, const SIZE &size,
+                             std::vector<BOX *> *leaves) {
+    if (*p >= shape.size()) {
+      return {};
+    }
+    auto box = std::make_unique<BOX>();
+    box->Parent = parent;
+    box->Pos = pos;
+    box->Size = size;
+    auto c = shape[(*p)++];
+    if (c == 'P') {
+      leaves->push_back(box.get());
+      return box;
+    }
+    if (c != 'H' && c != 'V') {
+      return {};
+    }
+    box->Split = c == 'H' ? SPLIT::HORIZONTAL : SPLIT::VERTICAL;
+    if (!CanSplit(box.get(), box->Split)) {
+      return {};
+    }
+    POS pos1, pos2;
+    SIZE size1, size2;
+    Halves(box.get(), &pos1, &size1, &pos2, &size2);
+    box->First = Build(shape, p, box.get(), pos1, size1, leaves);
+    if (!box->First) {
+      return {};
+    }
+    box->Second = Build(shape, p, box.get(), pos2, size2, leaves);
+    if (!box->Second) {
+      return {};
+    }
+    return box;
+  }
+
+  BOX *FindBox(const POS &pos) const {
+    auto box = m_root.get();
+    if (!box || !box->Contains(pos)) {
+      return nullptr;
+    }
+    while (!box->Pane) {
+      if (box->First->Contains(pos)) {
+        box = box->First.get();
+      } else if (box->Second->Contains(pos)) {
+        box = box->Second.get();
+      } else {
+        // on a border
+        return nullptr;
+      }
+    }
+    return box;
+  }
+
+  BOX *FindBox(const std::shared_ptr<NODE> &node) const {
+    if (!node) {
+      return nullptr;
+    }
+    // the center of a pane is inside its box
+    auto box = FindBox(POS{node->Pos.Y + node->Size.Rows / 2,
+                           node->Pos.X + node->Size.Cols / 2});
+    return box && box->Pane == node ? box : nullptr;
+  }
+
+  void Focus(BOX *box) {
+    if (box == m_focused || !box) {
+      return;
+    }
+    if (m_focused) {
+      m_last = m_focused->Pane;
+    }
+    m_focused = box;
+  }
+};
+
+Layout::Layout(const POS &pos, const SIZE &size) : m_impl(new LayoutImpl) {
+  m_impl->m_pos = pos;
+  m_impl->m_size = size;
+}
+
+Layout::~Layout() { delete m_impl; }
+
+bool Layout::Empty() const { return !m_impl->m_root; }
+
+const std::vector<std::shared_ptr<NODE>> &Layout::Panes() const {
+  return m_impl->m_panes;
+}
+
+void Layout::Reshape(const POS &pos, const SIZE &size) {
+  m_impl->m_pos = pos;
+  m_impl->m_size = size;
+  if (m_impl->m_root) {
+    m_impl->Reshape(m_impl->m_root.get(), pos, size);
+  }
+}
+
+static void borders(const BOX *box, std::vector<BORDER> *out) {
+  if (box->Pane) {
+    return;
+  }
+  out->push_back(LayoutImpl::Border(box));
+  borders(box->First.get(), out);
+  borders(box->Second.get(), out);
+}
+
+std::vector<BORDER> Layout::Borders() const {
+  std::vector<BORDER> out;
+  if (m_impl->m_root) {
+    borders(m_impl->m_root.get(), &out);
+  }
+  return out;
+}
+
+void Layout::DrawBorders() const {
+  for (auto &border : Borders()) {
+    if (border.Vertical) {
+      DrawVLine(border.Pos, border.Length);
+    } else {
+      DrawHLine(border.Pos, border.Length);
+    }
+  }
+}
+
+static void shape(const BOX *box, std::string *out) {
+  if (box->Pane) {
+    *out += 'P';
+    return;
+  }
+  *out += box->Split == SPLIT::HORIZONTAL ? 'H' : 'V';
+  shape(box->First.get(), out);
+  shape(box->Second.get(), out);
+}
+
+std::string Layout::Shape() const {
+  std::string out;
+  if (m_impl->m_root) {
+    shape(m_impl->m_root.get(), &out);
+  }
+  return out;
+}
+
+bool Layout::Restore(const std::string &shape, const CreateFunc &create) {
+  if (m_impl->m_root) {
+    return false;
+  }
+  size_t p = 0;
+  std::vector<BOX *> leaves;
+  auto root =
+      m_impl->Build(shape, &p, nullptr, m_impl->m_pos, m_impl->m_size, &leaves);
+  if (!root || p != shape.size()) {
+    return false;
+  }
+  std::vector<std::shared_ptr<NODE>> panes;
+  for (auto leaf : leaves) {
+    leaf->Pane = create(leaf->Pos, leaf->Size);
+    if (!leaf->Pane) {
+      return false;
+    }
+    panes.push_back(leaf->Pane);
+  }
+  m_impl->m_root = std::move(root);
+  m_impl->m_panes = std::move(panes);
+  m_impl->Focus(leaves.front());
+  return true;
+}
+
+std::shared_ptr<NODE> Layout::Split(SPLIT split, const CreateFunc &create) {
+  if (!m_impl->m_root) {
+    auto pane = create(m_impl->m_pos, m_impl->m_size);
+    if (!pane) {
+      return {};
+    }
+    m_impl->m_root.reset(new BOX{
+        .Pos = m_impl->m_pos,
+        .Size = m_impl->m_size,
+        .Pane = pane,
+    });
+    m_impl->m_panes.push_back(pane);
+    m_impl->Focus(m_impl->m_root.get());
+    return pane;
+  }
+
+  auto box = m_impl->m_focused;
+  if (!LayoutImpl::CanSplit(box, split)) {
+    return {};
+  }
+
+  // the leaf becomes a split, its pane moves into the first half
+  POS pos1, pos2;
+  SIZE size1, size2;
+  box->Split = split;
+  LayoutImpl::Halves(box, &pos1, &size1, &pos2, &size2);
+  auto pane = create(pos2, size2);
+  if (!pane) {
+    return {};
+  }
+  box->First.reset(new BOX{
+      .Parent = box,
+      .Pos = box->Pos,
+      .Size = box->Size,
+      .Pane = std::move(box->Pane),
+  });
+  box->Second.reset(new BOX{
+      .Parent = box,
+      .Pos = pos2,
+      .Size = size2,
+      .Pane = pane,
+  });
+  m_impl->m_focused = box->First.get();
+  m_impl->Arrange(box);
+  m_impl->m_panes.push_back(pane);
+  m_impl->Focus(box->Second.get());
+  return pane;
+}
+
+void Layout::Close(const std::shared_ptr<NODE> &node) {
+  auto box = m_impl->FindBox(node);
+  if (!box) {
+    return;
+  }
+  std::erase(m_impl->m_panes, node);
+  bool focused = box == m_impl->m_focused;
+  if (focused) {
+    m_impl->m_focused = nullptr;
+  }
+
+  auto parent = box->Parent;
+  if (!parent) {
+    m_impl->m_root.reset();
+    return;
+  }
+
+  // the sibling replaces the parent and grows into its space
+  auto sibling = std::move(box == parent->First.get() ? parent->Second
+                                                      : parent->First);
+  auto pos = parent->Pos;
+  auto size = parent->Size;
+  sibling->Parent = parent->Parent;
+  auto target = sibling.get();
+  if (!parent->Parent) {
+    m_impl->m_root = std::move(sibling);
+  } else if (parent->Parent->First.get() == parent) {
+    parent->Parent->First = std::move(sibling);
+  } else {
+    parent->Parent->Second = std::move(sibling);
+  }
+  // box and parent are gone now
+  m_impl->Reshape(target, pos, size);
+
+  if (focused) {
+    auto last = m_impl->FindBox(m_impl->m_last.lock());
+    if (!last) {
+      // a pane that took over the space
+      last = target;
+      while (!last->Pane) {
+        last = last->First.get();
+      }
+    }
+    m_impl->m_focused = last;
+  }
+}
+
+std::shared_ptr<NODE> Layout::Focused() const {
+  return m_impl->m_focused ? m_impl->m_focused->Pane : nullptr;
+}
+
+void Layout::Focus(const std::shared_ptr<NODE> &node) {
+  m_impl->Focus(m_impl->FindBox(node));
+}
+
+void Layout::FocusLast() {
+  m_impl->Focus(m_impl->FindBox(m_impl->m_last.lock()));
+}
+
+bool Layout::FocusDirection(DIRECTION direction) {
+  auto box = m_impl->m_focused;
+  if (!box) {
+    return false;
+  }
+  // a point just past the border on that side
+  auto pos = box->Pos;
+  auto size = box->Size;
+  POS target;
+  switch (direction) {
+  case DIRECTION::UP:
+    target = {pos.Y - 2, pos.X + size.Cols / 2};
+    break;
+  case DIRECTION::DOWN:
+    target = {pos.Y + size.Rows + 1, pos.X + size.Cols / 2};
+    break;
+  case DIRECTION::LEFT:
+    target = {pos.Y + size.Rows / 2, pos.X - 2};
+    break;
+  case DIRECTION::RIGHT:
+    target = {pos.Y + size.Rows / 2, pos.X + size.Cols + 1};
+    break;
+  }
+  auto found = m_impl->FindBox(target);
+  if (!found) {
+    return false;
+  }
+  m_impl->Focus(found);
+  return true;
+}
+
+std::shared_ptr<NODE> Layout::Find(const POS &pos) const {
+  auto box = m_impl->FindBox(pos);
+  return box ? box->Pane : nullptr;
+}
+
+} // namespace term_screen
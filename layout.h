@@ -0,0 +1,84 @@
+#pragma once
+#include "screen.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace term_screen {
+
+struct NODE;
+
+enum class SPLIT {
+  // side by side, the new pane to the right
+  HORIZONTAL,
+  // stacked, the new pane below
+  VERTICAL,
+};
+
+// a border between the two halves of a split
+struct BORDER {
+  POS Pos;
+  uint16_t Length;
+  bool Vertical;
+};
+
+enum class DIRECTION {
+  UP,
+  DOWN,
+  LEFT,
+  RIGHT,
+};
+
+// Arranges the panes in a tree of splits.
+//
+// Every split halves a box and draws a one cell border between the halves.
+// Splitting, closing and resizing only lay out the boxes whose geometry
+// changed, so NODE::reshape is called just for the panes that moved or
+// changed size. Panes are found by position by descending the tree.
+class Layout {
+
+  struct LayoutImpl *m_impl = nullptr;
+
+public:
+  using CreateFunc =
+      std::function<std::shared_ptr<NODE>(const POS &, const SIZE &)>;
+
+  Layout(const POS &pos, const SIZE &size);
+  Layout(const Layout &) = delete;
+  Layout &operator=(const Layout &) = delete;
+  ~Layout();
+
+  bool Empty() const;
+  // in creation order
+  const std::vector<std::shared_ptr<NODE>> &Panes() const;
+
+  // the whole layout moved or the host terminal was resized
+  void Reshape(const POS &pos, const SIZE &size);
+  // outermost split first
+  std::vector<BORDER> Borders() const;
+  // draws every border again, after the screen was cleared
+  void DrawBorders() const;
+
+  // creates the first pane, or splits the focused one. nullptr if create
+  // fails or the pane is too small to split.
+  std::shared_ptr<NODE> Split(SPLIT split, const CreateFunc &create);
+  // the sibling takes over the space of node
+  void Close(const std::shared_ptr<NODE> &node);
+
+  // the splits in preorder, H and V for a split and P for a pane
+  std::string Shape() const;
+  // rebuilds an empty layout from Shape, creating the panes in preorder.
+  // false if a split does not fit or create fails.
+  bool Restore(const std::string &shape, const CreateFunc &create);
+
+  std::shared_ptr<NODE> Focused() const;
+  void Focus(const std::shared_ptr<NODE> &node);
+  // the previously focused pane
+  void FocusLast();
+  // the pane next to the focused one, false if there is none
+  bool FocusDirection(DIRECTION direction);
+  std::shared_ptr<NODE> Find(const POS &pos) const;
+};
+
+} // namespace term_screen
@@ -0,0 +1,611 @@
+#include "selector_impl.h"
+#include <deque>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <memory>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#ifndef IORING_OP_READ_MULTISHOT
+#define IORING_OP_READ_MULTISHOT 49
+#endif
+
+/* ring sizes; BUFFERS must be a power of two */
+const unsigned ENTRIES = 256;
+const unsigned BUFFERS = 256;
+const unsigned BUFFER_SIZE = 4096;
+const uint16_t BUFFER_GROUP = 0;
+
+/* operation kind, stored in the low bits of user_data */
+enum : uint64_t {
+  OP_READ = 1,
+  OP_POLL = 2,
+  OP_WRITE = 3,
+  OP_CANCEL = 4,
+  OP_HANGUP = 5,
+  // an fd that took no more, writable again
+  OP_WRITABLE = 6,
+  OP_MASK = 7,
+};
+
+struct Completion {
+  uint16_t Bid;
+  uint32_t Len;
+};
+
+struct FdState {
+  int Fd = -1;
+  bool Registered = false;
+  bool Watched = false;
+  bool Paused = false;
+  // removed by the owner, freed once nothing is in flight
+  bool Dead = false;
+
+  // reads
+  bool Armed = false;
+  // multishot reads never report a pty hangup, a poll does
+  bool Watching = false;
+  bool Hangup = false;
+  bool Starved = false;
+  bool Error = false;
+  std::deque<Completion> Completions;
+  // buffer handed out by the last Read, recycled on the next one
+  int Held = -1;
+
+  // watch
+  bool Polling = false;
+  bool Ready = false;
+
+  // writes, one in flight per fd to keep the order
+  std::string Out;
+  std::string Inflight;
+  size_t InflightOff = 0;
+  bool Writing = false;
+  // the fd was full, the rest of Inflight waits for POLLOUT
+  bool Blocked = false;
+
+  bool Idle() const {
+    return !Armed && !Watching && !Polling && !Writing && !Blocked;
+  }
+};
+
+/* io_uring backend. Registered fds keep a multishot read posted that picks
+ * kernel-provided buffers from a registered buffer ring, watched fds keep a
+ * poll posted, and every queued write plus the wait for completions go to
+ * the kernel in a single io_uring_enter per Select. */
+struct UringSelector : SelectorImpl {
+  int m_ring = -1;
+  io_uring_params m_params = {};
+
+  void *m_rings = MAP_FAILED;
+  size_t m_ringsSize = 0;
+  io_uring_sqe *m_sqes = (io_uring_sqe *)MAP_FAILED;
+  size_t m_sqesSize = 0;
+  unsigned *m_sqHead, *m_sqTail, *m_sqMask, *m_sqArray;
+  unsigned *m_cqHead, *m_cqTail, *m_cqMask;
+  io_uring_cqe *m_cqes;
+  unsigned m_toSubmit = 0;
+
+  io_uring_buf_ring *m_bufRing = (io_uring_buf_ring *)MAP_FAILED;
+  char *m_buffers = (char *)MAP_FAILED;
+  uint16_t m_bufTail = 0;
+  unsigned m_free = 0;
+  bool m_multishot = true;
+
+  std::unordered_map<int, std::unique_ptr<FdState>> m_fds;
+  std::vector<std::unique_ptr<FdState>> m_retired;
+
+  ~UringSelector() {
+    if (m_ring >= 0) {
+      // let queued host output reach the terminal
+      for (int i = 0; i < 100 && Busy(); ++i) {
+        Flush();
+        Enter(1, 10);
+        Reap();
+      }
+      close(m_ring);
+    }
+    if (m_buffers != MAP_FAILED) {
+      munmap(m_buffers, BUFFERS * BUFFER_SIZE);
+    }
+    if (m_bufRing != MAP_FAILED) {
+      munmap(m_bufRing, BUFFERS * sizeof(io_uring_buf));
+    }
+    if (m_sqes != MAP_FAILED) {
+      munmap(m_sqes, m_sqesSize);
+    }
+    if (m_rings != MAP_FAILED) {
+      munmap(m_rings, m_ringsSize);
+    }
+  }
+
+  bool Initialize() {
+    m_ring = syscall(__NR_io_uring_setup, ENTRIES, &m_params);
+    if (m_ring < 0) {
+      return false;
+    }
+    if (!(m_params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(m_params.features & IORING_FEAT_EXT_ARG)) {
+      return false;
+    }
+
+    auto &p = m_params;
+    m_ringsSize = std::max(p.sq_off.array + p.sq_entries * sizeof(unsigned),
+                           p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe));
+    m_rings = mmap(nullptr, m_ringsSize, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, m_ring, IORING_OFF_SQ_RING);
+    if (m_rings == MAP_FAILED) {
+      return false;
+    }
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe *)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, m_ring,
+                                  IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED) {
+      return false;
+    }
+    auto base = (char *)m_rings;
+    m_sqHead = (unsigned *)(base + p.sq_off.head);
+    m_sqTail = (unsigned *)(base + p.sq_off.tail);
+    m_sqMask = (unsigned *)(base + p.sq_off.ring_mask);
+    m_sqArray = (unsigned *)(base + p.sq_off.array);
+    m_cqHead = (unsigned *)(base + p.cq_off.head);
+    m_cqTail = (unsigned *)(base + p.cq_off.tail);
+    m_cqMask = (unsigned *)(base + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe *)(base + p.cq_off.cqes);
+
+    m_bufRing = (io_uring_buf_ring *)mmap(
+        nullptr, BUFFERS * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    m_buffers = (char *)mmap(nullptr, BUFFERS * BUFFER_SIZE,
+                             PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m_bufRing == MAP_FAILED || m_buffers == MAP_FAILED) {
+      return false;
+    }
+    io_uring_buf_reg reg = {
+        .ring_addr = (uint64_t)m_bufRing,
+        .ring_entries = BUFFERS,
+        .bgid = BUFFER_GROUP,
+    };
+    if (syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_PBUF_RING,
+                &reg, 1) < 0) {
+      return false;
+    }
+    for (unsigned i = 0; i < BUFFERS; ++i) {
+      Recycle(i);
+    }
+    return true;
+  }
+
+  Selector::Backend Backend() const override {
+    return Selector::Backend::Uring;
+  }
+
+  //
+  // rings
+  //
+  void Recycle(uint16_t bid) {
+    // not m_bufRing->bufs, whose offset differs between C and C++
+    auto &buf = ((io_uring_buf *)m_bufRing)[m_bufTail & (BUFFERS - 1)];
+    buf.addr = (uint64_t)(m_buffers + bid * BUFFER_SIZE);
+    buf.len = BUFFER_SIZE;
+    buf.bid = bid;
+    __atomic_store_n(&m_bufRing->tail, ++m_bufTail, __ATOMIC_RELEASE);
+    ++m_free;
+  }
+
+  io_uring_sqe *GetSqe() {
+    unsigned tail = *m_sqTail;
+    if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >=
+        m_params.sq_entries) {
+      Enter(0, 0);
+    }
+    unsigned idx = tail & *m_sqMask;
+    auto sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_toSubmit;
+    return sqe;
+  }
+
+  void Enter(unsigned wait, int timeout) {
+    if (!m_toSubmit && !wait) {
+      return;
+    }
+    unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+    __kernel_timespec ts = {
+        .tv_sec = timeout / 1000,
+        .tv_nsec = (timeout % 1000) * 1000000LL,
+    };
+    io_uring_getevents_arg arg = {
+        .sigmask = 0,
+        .sigmask_sz = _NSIG / 8,
+        .ts = (uint64_t)&ts,
+    };
+    if (wait && timeout >= 0) {
+      flags |= IORING_ENTER_EXT_ARG;
+    }
+    ++m_syscalls;
+    int r = syscall(__NR_io_uring_enter, m_ring, m_toSubmit, wait, flags,
+                    (flags & IORING_ENTER_EXT_ARG) ? &arg : nullptr,
+                    sizeof(arg));
+    if (r > 0) {
+      m_toSubmit -= std::min((unsigned)r, m_toSubmit);
+    }
+  }
+
+  void Reap() {
+    unsigned head = *m_cqHead;
+    unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      Complete(m_cqes[head & *m_cqMask]);
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+  }
+
+  bool Busy() const {
+    for (auto &[fd, state] : m_fds) {
+      if (state->Writing || state->Blocked || !state->Out.empty()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  //
+  // operations
+  //
+  void ArmRead(FdState *state) {
+    bool multishot = m_multishot && !state->Hangup;
+    auto sqe = GetSqe();
+    sqe->opcode = multishot ? IORING_OP_READ_MULTISHOT : IORING_OP_READ;
+    sqe->fd = state->Fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->off = (uint64_t)-1;
+    sqe->len = multishot ? 0 : BUFFER_SIZE;
+    sqe->user_data = (uint64_t)state | OP_READ;
+    state->Armed = true;
+    state->Starved = false;
+  }
+
+  void ArmPoll(FdState *state) {
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = state->Fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = (uint64_t)state | OP_POLL;
+    state->Polling = true;
+  }
+
+  void ArmHangup(FdState *state) {
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = state->Fd;
+    sqe->poll32_events = POLLRDHUP;
+    sqe->user_data = (uint64_t)state | OP_HANGUP;
+    state->Watching = true;
+  }
+
+  void Cancel(FdState *state, uint64_t op) {
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)state | op;
+    // the state may be gone by the time this completes
+    sqe->user_data = OP_CANCEL;
+  }
+
+  void PrepWrite(FdState *state) {
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = state->Fd;
+    sqe->addr = (uint64_t)(state->Inflight.data() + state->InflightOff);
+    sqe->len = state->Inflight.size() - state->InflightOff;
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = (uint64_t)state | OP_WRITE;
+    state->Writing = true;
+  }
+
+  void ArmWritable(FdState *state) {
+    auto sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = state->Fd;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = (uint64_t)state | OP_WRITABLE;
+    state->Blocked = true;
+  }
+
+  void StartWrite(FdState *state) {
+    if (state->Writing || state->Blocked || state->Out.empty()) {
+      return;
+    }
+    state->Inflight.swap(state->Out);
+    state->Out.clear();
+    state->InflightOff = 0;
+    PrepWrite(state);
+  }
+
+  void Complete(const io_uring_cqe &cqe) {
+    auto state = (FdState *)(cqe.user_data & ~OP_MASK);
+    auto op = cqe.user_data & OP_MASK;
+    if (op == OP_CANCEL) {
+      return;
+    }
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    switch (op) {
+    case OP_READ: {
+      bool hasBuffer = cqe.flags & IORING_CQE_F_BUFFER;
+      uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+      if (hasBuffer) {
+        --m_free;
+      }
+      if (!more) {
+        state->Armed = false;
+      }
+      if (state->Dead) {
+        if (hasBuffer) {
+          Recycle(bid);
+        }
+      } else if (cqe.res > 0) {
+        state->Completions.push_back({bid, (uint32_t)cqe.res});
+      } else if (cqe.res == -EINVAL && m_multishot) {
+        // kernel without multishot reads, re-armed one shot at a time
+        m_multishot = false;
+      } else if (cqe.res == -ENOBUFS) {
+        // re-armed once the reader hands buffers back
+        state->Starved = true;
+      } else if (cqe.res != -EAGAIN && cqe.res != -EINTR &&
+                 cqe.res != -ECANCELED) {
+        // end of file or error
+        state->Error = true;
+        if (hasBuffer) {
+          Recycle(bid);
+        }
+      }
+      break;
+    }
+
+    case OP_POLL:
+      state->Polling = false;
+      state->Ready = !state->Dead;
+      break;
+
+    case OP_HANGUP:
+      state->Watching = false;
+      if (!state->Dead && cqe.res > 0) {
+        // drain the rest with one shot reads, which do see the end of file
+        state->Hangup = true;
+        if (state->Armed) {
+          Cancel(state, OP_READ);
+        }
+      }
+      break;
+
+    case OP_WRITE:
+    case OP_WRITABLE:
+      if (op == OP_WRITABLE) {
+        state->Blocked = false;
+      } else if (cqe.res > 0) {
+        state->InflightOff += cqe.res;
+      } else if (cqe.res != -EAGAIN && cqe.res != -EINTR) {
+        // drop the rest, the fd is gone
+        state->InflightOff = state->Inflight.size();
+      }
+      state->Writing = false;
+      if (state->Dead) {
+        // released, the fd number may already belong to another file
+        state->Inflight.clear();
+        state->InflightOff = 0;
+      } else if (op == OP_WRITE && cqe.res == -EAGAIN) {
+        // a non-blocking fd that is full, written again once it drains
+        ArmWritable(state);
+      } else if (state->InflightOff < state->Inflight.size()) {
+        PrepWrite(state);
+      } else {
+        state->Inflight.clear();
+        state->InflightOff = 0;
+        StartWrite(state);
+      }
+      break;
+    }
+
+    if (state->Dead && state->Idle()) {
+      std::erase_if(m_retired, [state](auto &s) { return s.get() == state; });
+    }
+  }
+
+  //
+  // SelectorImpl
+  //
+  FdState *Find(int fd) const {
+    auto found = m_fds.find(fd);
+    return found == m_fds.end() ? nullptr : found->second.get();
+  }
+
+  FdState *Get(int fd) {
+    auto &state = m_fds[fd];
+    if (!state) {
+      state = std::make_unique<FdState>();
+      state->Fd = fd;
+    }
+    return state.get();
+  }
+
+  void Release(int fd) {
+    auto found = m_fds.find(fd);
+    if (found == m_fds.end()) {
+      return;
+    }
+    auto state = found->second.get();
+    if (state->Registered || state->Watched || !state->Out.empty()) {
+      return;
+    }
+    if (state->Held >= 0) {
+      Recycle(state->Held);
+    }
+    for (auto &c : state->Completions) {
+      Recycle(c.Bid);
+    }
+    state->Dead = true;
+    // nothing more reaches the fd, it is closed right after
+    state->Out.clear();
+    if (state->Writing) {
+      Cancel(state, OP_WRITE);
+    }
+    if (state->Blocked) {
+      Cancel(state, OP_WRITABLE);
+    }
+    if (state->Armed) {
+      Cancel(state, OP_READ);
+    }
+    if (state->Polling) {
+      Cancel(state, OP_POLL);
+    }
+    if (state->Watching) {
+      Cancel(state, OP_HANGUP);
+    }
+    if (!state->Idle()) {
+      m_retired.push_back(std::move(found->second));
+      // the owner closes the fd right after, so cancel now
+      Enter(0, 0);
+    }
+    m_fds.erase(found);
+  }
+
+  void Register(int fd) override {
+    auto state = Get(fd);
+    state->Registered = true;
+    ArmHangup(state);
+  }
+
+  void Unregister(int fd) override {
+    if (auto state = Find(fd)) {
+      state->Registered = false;
+      state->Out.clear();
+      Release(fd);
+    }
+  }
+
+  void Watch(int fd) override { Get(fd)->Watched = true; }
+
+  void Unwatch(int fd) override {
+    if (auto state = Find(fd)) {
+      state->Watched = false;
+      Release(fd);
+    }
+  }
+
+  // a multishot read would take buffers that other fds need
+  void Pause(int fd) override {
+    auto state = Find(fd);
+    if (state && !state->Paused) {
+      state->Paused = true;
+      if (state->Armed) {
+        Cancel(state, OP_READ);
+      }
+    }
+  }
+
+  void Resume(int fd) override {
+    if (auto state = Find(fd)) {
+      state->Paused = false;
+    }
+  }
+
+  void Flush() override {
+    for (auto &[fd, state] : m_fds) {
+      StartWrite(state.get());
+    }
+    Enter(0, 0);
+  }
+
+  void Select(int timeout) override {
+    Reap();
+    bool pending = false;
+    for (auto &[fd, state] : m_fds) {
+      if (state->Watched) {
+        state->Ready = false;
+        if (!state->Polling) {
+          ArmPoll(state.get());
+        }
+      }
+      if (state->Registered && !state->Paused && !state->Armed &&
+          !state->Error && (!state->Starved || m_free > 0)) {
+        ArmRead(state.get());
+      }
+      pending = pending || (!state->Paused && (!state->Completions.empty() ||
+                                               state->Error));
+      StartWrite(state.get());
+    }
+    Enter(pending ? 0 : 1, timeout);
+    Reap();
+  }
+
+  bool Ready(int fd) const override {
+    auto state = Find(fd);
+    return state &&
+           (state->Ready || !state->Completions.empty() || state->Error);
+  }
+
+  std::optional<std::span<char>> Read(int fd) override {
+    auto state = Find(fd);
+    if (!state || !state->Registered) {
+      // error
+      return std::nullopt;
+    }
+    if (state->Held >= 0) {
+      Recycle(state->Held);
+      state->Held = -1;
+    }
+    if (!state->Completions.empty()) {
+      auto c = state->Completions.front();
+      state->Completions.pop_front();
+      state->Held = c.Bid;
+      return std::span<char>(m_buffers + c.Bid * BUFFER_SIZE, c.Len);
+    }
+    if (state->Error) {
+      return std::nullopt;
+    }
+    // empty
+    return std::span<char>{};
+  }
+
+  void Write(int fd, std::span<const char> data) override {
+    Get(fd)->Out.append(data.data(), data.size());
+  }
+
+  size_t Pending(int fd) const override {
+    auto state = Find(fd);
+    return state ? state->Out.size() + state->Inflight.size() -
+                       state->InflightOff
+                 : 0;
+  }
+
+  // an in-flight write is cancelled by the Release that follows
+  void Discard(int fd) override {
+    if (auto state = Find(fd)) {
+      state->Out.clear();
+    }
+  }
+};
+
+SelectorImpl *CreateUringSelector() {
+  auto impl = new UringSelector;
+  if (!impl->Initialize()) {
+    delete impl;
+    return nullptr;
+  }
+  return impl;
+}
@@ -1,30 +1,71 @@
 #include "child_process.h"
 #include "config.h"
+#include "copy_mode.h"
 #include "input_stream.h"
+#include "layout.h"
+#include "metrics.h"
 #include "node.h"
+#include "pane_log.h"
+#include "parse_pool.h"
+#include "recording.h"
 #include "screen.h"
+#include "shell_pool.h"
 #include "term.h"
+#include "timer_queue.h"
+#include "trace.h"
+#include "utf8.h"
 #if defined(_WIN32)
 #else
+#include "control.h"
+#include "events.h"
+#include "pipe_pane.h"
+#include "selector.h"
+#include "session.h"
+#include "snapshot.h"
 #include "vtparser.h"
 #include <curses.h>
+#include <sys/ioctl.h>
 #endif
+#include <chrono>
+#include <deque>
+#include <errno.h>
 #include <iostream>
 #include <signal.h>
 #include <string.h>
+#include <unordered_map>
 #include <vterm.h>
 
-#define USAGE "usage: mtm [-T NAME] [-t NAME] [-c KEY]\n"
+#define USAGE "usage: mtm [-T NAME] [-t NAME] [-c KEY] [-j THREADS] [-b BACKEND]\n" \
+              "           [-p COMMAND] [-L FILE] [-S SOCKET] [-R FILE] [-P COUNT]\n" \
+              "           [-w FILE] [-r FILE [-f]] [-H ROWSxCOLS] [-s SECONDS]\n" \
+              "           [-C PATH] [-M FILE] [-X FILE] [-l LINES] [-d MS]\n"
 #define CTL(x) ((x)&0x1f)
 
 /*** GLOBALS AND PROTOTYPES */
 int commandkey = CTL(COMMAND_KEY);
+static const char *term = nullptr;
+static const char *logpath = nullptr;
+static const char *recordpath = nullptr;
+static const char *snapshotpath = nullptr;
+static const char *metricspath = nullptr;
+static const char *tracepath = nullptr;
+static ParsePool *pool = nullptr;
+static term_screen::ShellPool *shells = nullptr;
+static int npanes = 0;
+static int silence = SILENCE_SECONDS;
+#if !defined(_WIN32)
+/* Set in the process that keeps a session. */
+static term_screen::SessionServer *server = nullptr;
+#endif
 
 /* The scrollback keys. */
 #define SCROLLUP input.CODE(KEY_PPAGE)
 #define SCROLLDOWN input.CODE(KEY_NPAGE)
 #define RECENTER input.CODE(KEY_END)
 
+/* The pipe-pane key. */
+#define PIPEPANE input.KEY(L'p')
+
 /* The split terminal keys. */
 #define HSPLIT input.KEY(L'h')
 #define VSPLIT input.KEY(L'v')
@@ -35,8 +76,203 @@ int commandkey = CTL(COMMAND_KEY);
 /* The force redraw key. */
 #define REDRAW input.KEY(L'l')
 
+/* The detach key. */
+#define DETACH input.KEY(L'd')
+
+/* The copy mode and paste keys. */
+#define COPYMODE input.KEY(L'[')
+#define PASTE input.KEY(L']')
+
+/* The broadcast keys, for the focused pane and for all of them. */
+#define BROADCAST input.KEY(L'b')
+#define BROADCAST_ALL input.KEY(L'B')
+
+/* The monitor keys, for output and for silence. */
+#define MONITOR_ACTIVITY input.KEY(L'a')
+#define MONITOR_SILENCE input.KEY(L's')
+
+/* The metrics overlay key. */
+#define METRICS input.KEY(L'm')
+
+/* The memory view key. */
+#define MEMORY input.KEY(L'M')
+
+/* The pane in copy mode, and what was copied last. */
+static std::unique_ptr<term_screen::CopyMode> copymode;
+static std::string pastebuffer;
+
+/* Start or stop copying the raw output of n into pipecommand. */
+static const char *pipecommand = nullptr;
+static void togglepipe(const std::shared_ptr<term_screen::NODE> &n) {
+  auto handle = n->Process->Handle();
+  auto &stream = InputStream::Instance();
+  if (stream.GetPipe(handle)) {
+    stream.Pipe(handle, nullptr);
+  } else if (pipecommand) {
+    stream.Pipe(handle, pipecommand);
+  }
+}
+
+/* The panes typed input goes to, the broadcast group when the focused pane
+ * is in it. Text is encoded once into pending and copied to each of them
+ * before the next key that is not text. */
+static std::vector<std::shared_ptr<term_screen::NODE>> targets;
+static std::string pending;
+
+static void findtargets(const term_screen::Layout &layout,
+                        const std::shared_ptr<term_screen::NODE> &n) {
+  targets.clear();
+  if (!n->m_broadcast) {
+    targets.push_back(n);
+    return;
+  }
+  for (auto &node : layout.Panes()) {
+    if (node->m_broadcast) {
+      targets.push_back(node);
+    }
+  }
+}
+
+static void sendpending() {
+  if (pending.empty()) {
+    return;
+  }
+  for (auto &node : targets) {
+    node->s->scrollbottom();
+    node->queue(pending.data(), pending.size());
+  }
+  pending.clear();
+}
+
+/* The keys the pane encodes itself, since the sequence depends on its
+ * modes. */
+static bool functionkey(const term_screen::Input &input,
+                        term_screen::KEY *key) {
+  using term_screen::KEY;
+  static const std::pair<int, KEY> codes[] = {
+      {KEY_ENTER, KEY::ENTER},    {KEY_BACKSPACE, KEY::BACKSPACE},
+      {KEY_BTAB, KEY::BACKTAB},   {KEY_UP, KEY::UP},
+      {KEY_DOWN, KEY::DOWN},      {KEY_LEFT, KEY::LEFT},
+      {KEY_RIGHT, KEY::RIGHT},    {KEY_HOME, KEY::HOME},
+      {KEY_END, KEY::END},        {KEY_PPAGE, KEY::PAGEUP},
+      {KEY_NPAGE, KEY::PAGEDOWN}, {KEY_IC, KEY::INSERT},
+      {KEY_DC, KEY::DELETE},
+  };
+  if (input.KEY(L'\r')) {
+    *key = KEY::ENTER;
+    return true;
+  }
+  for (auto [code, k] : codes) {
+    if (input.CODE(code)) {
+      *key = k;
+      return true;
+    }
+  }
+  for (int i = 1; i <= 12; ++i) {
+    if (input.CODE(KEY_F(i))) {
+      *key = (KEY)((int)KEY::F1 + i - 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+/* The screen the panes are laid out on, and the status line on its last
+ * row while any pane is monitored or the memory of the panes is shown. */
+static term_screen::SIZE screensize;
+static bool statusshown = false;
+static std::string status;
+static uint64_t statusgeneration = 0;
+static bool memoryshown = false;
+/* counts the refreshes of the memory view */
+static uint64_t memoryticks = 0;
+static TimerQueue::TimerId memorytimer = 0;
+
+static bool statuswanted() {
+  return term_screen::Activity::Monitored() > 0 || memoryshown;
+}
+
+/* changes whenever the status line would look different */
+static uint64_t statusgen() {
+  return term_screen::Activity::Generation() + memoryticks;
+}
+
+static void reshape(term_screen::Layout &layout,
+                    const term_screen::SIZE &size) {
+  screensize = size;
+  statusshown = statuswanted() && size.Rows > 1;
+  layout.Reshape({0, 0}, {(uint16_t)(size.Rows - statusshown), size.Cols});
+  /* drawn again by the next updatestatus */
+  statusgeneration = statusgen() - 1;
+}
+
+static void tickmemory() {
+  ++memoryticks;
+  memorytimer = TimerQueue::Instance().Add(1000, tickmemory);
+}
+
+static void togglememory() {
+  memoryshown = !memoryshown;
+  if (memoryshown) {
+    tickmemory();
+  } else {
+    TimerQueue::Instance().Cancel(memorytimer);
+  }
+}
+
+static void togglemonitor(const std::shared_ptr<term_screen::NODE> &n,
+                          term_screen::MONITOR monitor) {
+  auto &activity = n->m_activity;
+  activity.Monitor(activity.Monitoring() == monitor
+                       ? term_screen::MONITOR::NONE
+                       : monitor,
+                   std::chrono::seconds(silence));
+}
+
+static std::shared_ptr<term_screen::NODE> newnode(const term_screen::POS &pos,
+                                                  const term_screen::SIZE &size);
+static void deletenode(term_screen::Layout &layout,
+                       const std::shared_ptr<term_screen::NODE> &n);
+static void redraw(const term_screen::Layout &layout);
+
+/* The metrics overlay, shown over the top right corner, and the timer that
+ * refreshes it while nothing else happens. */
+static bool metricsshown = false;
+static TimerQueue::TimerId metricstimer = 0;
+
+static void tickmetrics() {
+  metricstimer = TimerQueue::Instance().Add(1000, tickmetrics);
+}
+
+static void togglemetrics(const term_screen::Layout &layout) {
+  metricsshown = !metricsshown;
+  if (metricsshown) {
+    tickmetrics();
+  } else {
+    TimerQueue::Instance().Cancel(metricstimer);
+    redraw(layout);
+  }
+}
+
+static void drawmetrics() {
+  auto text = Metrics::Text();
+  std::vector<std::string> lines;
+  size_t width = 0;
+  for (size_t start = 0, end;
+       (end = text.find('\n', start)) != std::string::npos; start = end + 1) {
+    lines.push_back(' ' + text.substr(start, end - start));
+    width = std::max(width, lines.back().size() + 1);
+  }
+  width = std::min<size_t>(width, screensize.Cols);
+  for (int y = 0; y < (int)lines.size() && y < screensize.Rows; ++y) {
+    term_screen::DrawStatus({y, screensize.Cols - (int)width}, width,
+                            lines[y].c_str());
+  }
+}
+
 /* Handle a single input character. */
-static bool handlechar(const std::shared_ptr<term_screen::NODE> &n,
+static bool handlechar(term_screen::Layout &layout,
+                       const std::shared_ptr<term_screen::NODE> &n,
                        const term_screen::Input &input /*int r, int k*/) {
   const char cmdstr[] = {(char)commandkey, 0};
   static bool cmd = false;
@@ -119,80 +355,1186 @@ static bool handlechar(const std::shared_ptr<term_screen::NODE> &n,
   //   DO(true, RECENTER, n->s->scrollbottom())
   //   DO(true, input.KEY(commandkey), n->Process->Write(cmdstr, 1));
 
+  if (input.KERR()) {
+    return false;
+  }
+
+  if (copymode && copymode->Node() == n.get()) {
+    std::string copied;
+    if (!copymode->Key(input, &copied)) {
+      copymode.reset();
+    }
+    if (!copied.empty()) {
+      pastebuffer = copied;
+#if COPY_TO_HOST
+      term_screen::Term::Insance().Clipboard(copied);
+#endif
+    }
+    return true;
+  }
+
+  if (!cmd && input.KEY(commandkey)) {
+    return cmd = true;
+  }
+  if (cmd) {
+    cmd = false;
+    sendpending();
+    if (PIPEPANE) {
+      togglepipe(n);
+    } else if (HSPLIT || VSPLIT) {
+      layout.Split(HSPLIT ? term_screen::SPLIT::HORIZONTAL
+                          : term_screen::SPLIT::VERTICAL,
+                   newnode);
+    } else if (DELETE_NODE) {
+      deletenode(layout, n);
+    } else if (REDRAW) {
+      redraw(layout);
+    } else if (COPYMODE) {
+      copymode = term_screen::CopyMode::Start(n);
+    } else if (PASTE && !pastebuffer.empty()) {
+      for (auto &node : targets) {
+        node->beginpaste();
+        node->queue(pastebuffer.data(), pastebuffer.size());
+        node->endpaste();
+      }
+    } else if (MONITOR_ACTIVITY) {
+      togglemonitor(n, term_screen::MONITOR::ACTIVITY);
+    } else if (MONITOR_SILENCE) {
+      togglemonitor(n, term_screen::MONITOR::SILENCE);
+    } else if (METRICS) {
+      togglemetrics(layout);
+    } else if (MEMORY) {
+      togglememory();
+    } else if (BROADCAST) {
+      n->m_broadcast = !n->m_broadcast;
+      findtargets(layout, n);
+    } else if (BROADCAST_ALL) {
+      /* all of them join, or leave if they all were in */
+      bool all = true;
+      for (auto &node : layout.Panes()) {
+        all = all && node->m_broadcast;
+      }
+      for (auto &node : layout.Panes()) {
+        node->m_broadcast = !all;
+      }
+      findtargets(layout, n);
+#if !defined(_WIN32)
+    } else if (DETACH && server) {
+      server->Detach();
+#endif
+    } else if (input.CODE(KEY_UP)) {
+      layout.FocusDirection(term_screen::DIRECTION::UP);
+    } else if (input.CODE(KEY_DOWN)) {
+      layout.FocusDirection(term_screen::DIRECTION::DOWN);
+    } else if (input.CODE(KEY_LEFT)) {
+      layout.FocusDirection(term_screen::DIRECTION::LEFT);
+    } else if (input.CODE(KEY_RIGHT)) {
+      layout.FocusDirection(term_screen::DIRECTION::RIGHT);
+    } else if (input.KEY(L'o')) {
+      layout.FocusLast();
+    } else if (input.KEY(commandkey)) {
+      /* the command key twice sends it */
+      goto send;
+    }
+    /* false hands the rest of this turn's input to the new focus */
+    return layout.Focused() == n;
+  }
+
+  term_screen::KEY key;
+  if (functionkey(input, &key)) {
+    sendpending();
+    for (auto &node : targets) {
+      node->s->scrollbottom();
+      node->sendkey(key);
+    }
+    return true;
+  }
+
+send:
+
   char c[MB_LEN_MAX + 1] = {0};
-  if (wctomb(c, input.Char) > 0) {
-    n->s->scrollbottom();
-    n->Process->WriteString(c);
+  int len = wctomb(c, input.Char);
+  if (len > 0) {
+    pending.append(c, len);
   }
   cmd = false;
   return true;
 }
 
-static void run(const std::shared_ptr<term_screen::NODE> &node) {
-  node->s->draw(node->Pos, node->Size);
+/* Gather every input character available this turn, encode them into
+ * the input buffers of the focused node, or of its broadcast group, and
+ * write each of them to its child in a single call. A burst of bytes is a
+ * paste and gets bracketed if the child asked for it. */
+static void handleinput(term_screen::Layout &layout) {
+  static std::vector<term_screen::Input> inputs;
+  inputs.clear();
+  auto n = layout.Focused();
+  /* what the host terminal sent in one go; a client sends the keys of a
+   * turn in one message and each of them is a byte at least */
+  size_t burst = 0;
+#if !defined(_WIN32)
+  if (server) {
+    server->Inputs(&inputs);
+  } else
+#endif
+  {
+    burst = term_screen::Term::Insance().Pending();
+    while (true) {
+      auto input = n->s->getchar();
+      if (input.KERR()) {
+        break;
+      }
+      inputs.push_back(input);
+    }
+  }
+
+  bool paste = std::max(burst, inputs.size()) >= PASTE_THRESHOLD;
+  auto begin = [&]() {
+    findtargets(layout, n);
+    if (paste) {
+      for (auto &node : targets) {
+        node->beginpaste();
+      }
+    }
+  };
+  auto end = [&]() {
+    sendpending();
+    if (paste) {
+      for (auto &node : targets) {
+        node->endpaste();
+      }
+    }
+    for (auto &node : targets) {
+      node->flush();
+    }
+    targets.clear();
+  };
 
-  std::vector<char> readBuf;
+  begin();
+  for (auto &input : inputs) {
+    if (handlechar(layout, n, input)) {
+      continue;
+    }
+    /* a command moved the focus, the rest goes to the new one */
+    end();
+    if (!(n = layout.Focused())) {
+      return;
+    }
+    begin();
+  }
+  end();
+}
 
-  while (true) {
+/* The file of the next pane for pattern, false if it gets none. A %d in the
+ * pattern is the pane number, without it only the first pane has a file. */
+static bool panepath(const char *pattern, char *path, size_t size) {
+  if (!pattern) {
+    return false;
+  }
+  snprintf(path, size, pattern, npanes);
+  return npanes == 0 || strcmp(path, pattern);
+}
 
-    InputStream::Instance().Poll();
+/* Create a pane, restore pane index of snapshot into it and start a shell. */
+static std::shared_ptr<term_screen::NODE>
+startnode(const term_screen::POS &pos, const term_screen::SIZE &size,
+          const term_screen::Snapshot *snapshot, size_t index) {
+  auto n = std::make_shared<term_screen::NODE>(pos, size);
+#if !defined(_WIN32)
+  if (snapshot) {
+    n->restore(*snapshot, index);
+  }
+#endif
+  char path[PATH_MAX];
+  if (panepath(logpath, path, sizeof(path))) {
+    n->m_log = PaneLog::Open(path);
+  }
+  if (panepath(recordpath, path, sizeof(path))) {
+    n->m_recording = Recording::Create(path, n->Size);
+  }
+  n->Process = shells ? shells->Take(n->Size)
+                       : term_screen::Process::Fork(n->Size, term);
+  if (!n->Process) {
+    return {};
+  }
+  ++npanes;
+  pool->Register(n.get(),
+                 [n = n.get()](const char *b, size_t len) { n->parse(b, len); });
+  n->s->draw(n->Pos, n->Size);
+  return n;
+}
 
-    while (true) {
-      auto input = node->s->getchar();
-      if (!handlechar(node, input)) {
-        break;
-      }
+/* Create a pane and start a shell in it. */
+static std::shared_ptr<term_screen::NODE> newnode(const term_screen::POS &pos,
+                                                  const term_screen::SIZE &size) {
+  return startnode(pos, size, nullptr, 0);
+}
+
+#if !defined(_WIN32)
+/* Write the metrics to the -M file, replacing what a SIGUSR1 before wrote. */
+static void savemetrics() {
+  auto text = Metrics::Text();
+  auto tmp = std::string(metricspath) + ".tmp";
+  auto fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    return;
+  }
+  fwrite(text.data(), 1, text.size(), fp);
+  if (fclose(fp) == 0) {
+    rename(tmp.c_str(), metricspath);
+  }
+}
+
+/* Write every pane into snapshotpath. */
+static void savesnapshot(const term_screen::Layout &layout) {
+  auto panes = layout.Panes();
+  std::vector<std::unique_lock<std::mutex>> locks;
+  std::vector<term_screen::PANE_SNAPSHOT> snapshots;
+  for (auto &n : panes) {
+    /* held until written, the parse threads must not touch the histories */
+    locks.emplace_back(n->m_mutex);
+    snapshots.push_back(n->snapshot());
+  }
+  term_screen::Snapshot::Write(snapshotpath, layout.Shape(), snapshots);
+}
+#endif
+
+/* Remove a pane, its sibling takes over the space. */
+static void deletenode(term_screen::Layout &layout,
+                       const std::shared_ptr<term_screen::NODE> &n) {
+  if (copymode && copymode->Node() == n.get()) {
+    copymode.reset();
+  }
+  layout.Close(n);
+  pool->Unregister(n.get());
+}
+
+/* Repaint the whole screen. */
+static void redraw(const term_screen::Layout &layout) {
+#if !defined(_WIN32)
+  if (server) {
+    /* the client clears its screen when it gets the layout */
+    server->Resend();
+    return;
+  }
+  clearok(curscr, TRUE);
+  werase(stdscr);
+  wnoutrefresh(stdscr);
+  layout.DrawBorders();
+  if (statusshown) {
+    term_screen::DrawStatus({screensize.Rows - 1, 0}, screensize.Cols,
+                            status.c_str());
+  }
+  for (auto &n : layout.Panes()) {
+    touchwin(n->s->win);
+    n->s->draw(n->Pos, n->Size);
+  }
+#endif
+}
+
+#if !defined(_WIN32)
+/* Headless: no host terminal, commands come from stdin one per line. */
+struct HEADLESS {
+  term_screen::SIZE Size;
+  std::string Partial;
+  std::deque<std::string> Commands;
+  bool Eof = false;
+  /* a sleep or idle command holds the ones after it back */
+  std::chrono::steady_clock::time_point Until;
+  std::chrono::milliseconds Idle{0};
+  /* the last time any pane had output */
+  std::chrono::steady_clock::time_point Output;
+  /* wakes the loop when a wait may be over */
+  TimerQueue::TimerId Timer = 0;
+};
+static HEADLESS *headless = nullptr;
+/* headless, with commands and pane output framed, see Control */
+static term_screen::Control *control = nullptr;
+
+/* C escapes in the argument of send: \n \r \t \e \\ and \xHH. */
+static std::string unescape(const std::string &in) {
+  std::string out;
+  for (size_t i = 0; i < in.size(); ++i) {
+    if (in[i] != '\\' || i + 1 == in.size()) {
+      out += in[i];
+      continue;
     }
+    switch (in[++i]) {
+    case 'n':
+      out += '\n';
+      break;
+    case 'r':
+      out += '\r';
+      break;
+    case 't':
+      out += '\t';
+      break;
+    case 'e':
+      out += '\033';
+      break;
+    case 'x':
+      out += (char)strtoul(in.substr(i + 1, 2).c_str(), nullptr, 16);
+      i += 2;
+      break;
+    default:
+      out += in[i];
+      break;
+    }
+  }
+  return out;
+}
 
-    readBuf.clear();
-    if (InputStream::Instance().Read(node->Process->Handle(), readBuf)) {
+/* Put the characters on the screen of n, relative to its top left. */
+template <typename F>
+static void drawpane(const term_screen::NODE &n, const F &put) {
 #if USE_VTERM
-      vterm_input_write(node->m_vterm, readBuf.data(), readBuf.size());
-#else
-      vtwrite(node->vp.get(), readBuf.data(), readBuf.size());
+  auto frame = n.m_grid.Acquire();
+  if (!frame) {
+    return;
+  }
+  auto rows = std::min(frame->Size.Rows, n.Size.Rows);
+  for (int y = 0; y < rows; ++y) {
+    auto &cells = frame->Rows[y]->Cells;
+    auto cols = std::min<int>(cells.size(), n.Size.Cols);
+    for (int x = 0, col = 0; x < cols; ++x) {
+      if (cells[x].Width == 0) {
+        /* the right half of a wide character */
+        continue;
+      }
+      put(y, col++, cells[x].Char ? cells[x].Char : ' ');
+    }
+  }
 #endif
+}
+
+/* Append rows of cols characters as UTF-8 lines, without trailing blanks. */
+static void puttext(std::string &out, const std::vector<uint32_t> &screen,
+                    int cols) {
+  for (size_t y = 0; cols && y < screen.size() / cols; ++y) {
+    auto row = &screen[y * cols];
+    int end = cols;
+    while (end > 0 && row[end - 1] == ' ') {
+      --end;
+    }
+    for (int x = 0; x < end; ++x) {
+      pututf8(out, row[x]);
+    }
+    out += '\n';
+  }
+}
+
+/* The composed screen, borders included, as UTF-8 text. */
+static void dump(const term_screen::Layout &layout, std::string &out) {
+  auto size = headless->Size;
+  std::vector<uint32_t> screen((size_t)size.Rows * size.Cols, ' ');
+  auto put = [&](int y, int x, uint32_t c) {
+    if (y < size.Rows && x < size.Cols) {
+      screen[(size_t)y * size.Cols + x] = c;
+    }
+  };
+  /* every byte read so far is on the screen */
+  pool->Drain();
+  for (auto &n : layout.Panes()) {
+    drawpane(*n, [&](int y, int x, uint32_t c) {
+      put(n->Pos.Y + y, n->Pos.X + x, c);
+    });
+  }
+  for (auto &border : layout.Borders()) {
+    for (int i = 0; i < border.Length; ++i) {
+      if (border.Vertical) {
+        put(border.Pos.Y + i, border.Pos.X, 0x2502);
+      } else {
+        put(border.Pos.Y, border.Pos.X + i, 0x2500);
+      }
+    }
+  }
+  if (statusshown) {
+    for (int x = 0; x < (int)status.size(); ++x) {
+      put(size.Rows - 1, x, (unsigned char)status[x]);
+    }
+  }
+
+  puttext(out, screen, size.Cols);
+}
+
+/* The screen of one pane as UTF-8 text. */
+static void capture(const term_screen::NODE &n, std::string &out) {
+  std::vector<uint32_t> screen((size_t)n.Size.Rows * n.Size.Cols, ' ');
+  pool->Drain();
+  drawpane(n, [&](int y, int x, uint32_t c) {
+    screen[(size_t)y * n.Size.Cols + x] = c;
+  });
+  puttext(out, screen, n.Size.Cols);
+}
+
+/* The memory of a pane together with its queues in the main loop. */
+static term_screen::PANE_MEMORY panememory(term_screen::NODE &n) {
+  auto memory = n.memory();
+  memory.Queues += pool->Bytes(&n) +
+                   InputStream::Instance().Bytes(n.Process->Handle());
+  return memory;
+}
+
+/* Pane numbers with their memory, the largest first. */
+static std::vector<std::pair<size_t, term_screen::PANE_MEMORY>>
+memoryusage(const term_screen::Layout &layout) {
+  std::vector<std::pair<size_t, term_screen::PANE_MEMORY>> usage;
+  auto &panes = layout.Panes();
+  for (size_t i = 0; i < panes.size(); ++i) {
+    usage.push_back({i, panememory(*panes[i])});
+  }
+  std::stable_sort(usage.begin(), usage.end(), [](auto &a, auto &b) {
+    return a.second.Total() > b.second.Total();
+  });
+  return usage;
+}
+
+/* A line per pane, the largest first: its number and the bytes of its
+ * emulator, screens, scrollback and queues, and their total. */
+static void memory(const term_screen::Layout &layout, std::string &out) {
+  for (auto &[i, m] : memoryusage(layout)) {
+    char line[128];
+    snprintf(line, sizeof(line), "%zu %zu %zu %zu %zu %zu\n", i, m.Emulator,
+             m.Screens, m.Scrollback, m.Queues, m.Total());
+    out += line;
+  }
+}
+
+/* A line per pane: its number, the bytes and lines it printed, the
+ * milliseconds since it last did (-1 if it never did), what it is monitored
+ * for and whether that alerted. */
+static void report(const term_screen::Layout &layout, std::string &out) {
+  static const char *monitors[] = {"none", "activity", "silence"};
+  auto now = std::chrono::steady_clock::now();
+  auto &panes = layout.Panes();
+  for (size_t i = 0; i < panes.size(); ++i) {
+    auto &activity = panes[i]->m_activity;
+    long long idle = -1;
+    if (activity.Last() != term_screen::Activity::Clock::time_point()) {
+      idle = std::chrono::duration_cast<std::chrono::milliseconds>(
+                 now - activity.Last())
+                 .count();
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "%zu %llu %llu %lld %s%s\n", i,
+             (unsigned long long)activity.Bytes(),
+             (unsigned long long)activity.Lines(), idle,
+             monitors[(int)activity.Monitoring()],
+             activity.Alert() ? " alert" : "");
+    out += line;
+  }
+}
+
+static void wakein(std::chrono::steady_clock::duration delay) {
+  if (headless->Timer) {
+    TimerQueue::Instance().Cancel(headless->Timer);
+  }
+  auto ms = std::chrono::ceil<std::chrono::milliseconds>(delay).count();
+  headless->Timer =
+      TimerQueue::Instance().Add(ms, []() { headless->Timer = 0; });
+}
+
+/* Run one command, false for quit. What it prints is appended to out. */
+static bool command(term_screen::Layout &layout, const std::string &line,
+                    std::string &out) {
+  auto space = line.find(' ');
+  auto name = line.substr(0, space);
+  auto arg = space == std::string::npos ? "" : line.substr(space + 1);
+  auto focused = layout.Focused();
+  using namespace std::chrono;
+  if (name == "split") {
+    if (!layout.Split(arg == "v" ? term_screen::SPLIT::VERTICAL
+                                 : term_screen::SPLIT::HORIZONTAL,
+                      newnode)) {
+      fprintf(stderr, "split: does not fit\n");
+    }
+  } else if (name == "close") {
+    deletenode(layout, focused);
+  } else if (name == "focus") {
+    auto &panes = layout.Panes();
+    auto i = strtoul(arg.c_str(), nullptr, 10);
+    if (i < panes.size()) {
+      layout.Focus(panes[i]);
+    }
+  } else if (name == "send") {
+    auto bytes = unescape(arg);
+    findtargets(layout, focused);
+    for (auto &node : targets) {
+      node->queue(bytes.data(), bytes.size());
+      node->flush();
+    }
+    targets.clear();
+  } else if (name == "keys") {
+    /* the bytes as they are, to the pane with that id */
+    char *end;
+    auto id = strtoul(arg.c_str(), &end, 10);
+    auto bytes = *end ? std::string_view(end + 1) : std::string_view();
+    for (auto &node : layout.Panes()) {
+      if (node->m_id == id) {
+        node->queue(bytes.data(), bytes.size());
+        node->flush();
+      }
+    }
+  } else if (name == "capture") {
+    auto &panes = layout.Panes();
+    auto i = strtoul(arg.c_str(), nullptr, 10);
+    if (i < panes.size()) {
+      capture(*panes[i], out);
+    }
+  } else if (name == "pipe") {
+    /* N and a command to pipe the Nth pane into, without one it stops */
+    char *end;
+    auto i = strtoul(arg.c_str(), &end, 10);
+    auto &panes = layout.Panes();
+    if (end != arg.c_str() && i < panes.size()) {
+      auto handle = panes[i]->Process->Handle();
+      auto &stream = InputStream::Instance();
+      if (auto pipe = stream.GetPipe(handle)) {
+        char line[64];
+        snprintf(line, sizeof(line), "%llu %llu\n",
+                 (unsigned long long)pipe->Piped(),
+                 (unsigned long long)(pipe->Dropped() + pipe->Pending()));
+        out += line;
+      }
+      auto command = *end ? end + 1 : "";
+      if (!stream.Pipe(handle, command)) {
+        fprintf(stderr, "pipe: could not start %s\n", command);
+      }
+    }
+  } else if (name == "broadcast") {
+    for (auto &node : layout.Panes()) {
+      node->m_broadcast = arg != "off";
+    }
+  } else if (name == "resize") {
+    int rows = 0, cols = 0;
+    if (sscanf(arg.c_str(), "%d %d", &rows, &cols) == 2 && rows > 0 &&
+        cols > 0) {
+      headless->Size = {(uint16_t)rows, (uint16_t)cols};
+      reshape(layout, headless->Size);
+    }
+  } else if (name == "sleep") {
+    headless->Until = steady_clock::now() + milliseconds(atoi(arg.c_str()));
+  } else if (name == "idle") {
+    headless->Idle = milliseconds(atoi(arg.c_str()));
+  } else if (name == "monitor") {
+    auto &activity = focused->m_activity;
+    if (arg == "activity") {
+      activity.Monitor(term_screen::MONITOR::ACTIVITY);
+    } else if (arg.starts_with("silence")) {
+      auto seconds = arg.size() > 7 ? atoi(arg.c_str() + 7) : silence;
+      activity.Monitor(term_screen::MONITOR::SILENCE, seconds * 1s);
     } else {
-      // error exit
-      break;
+      activity.Monitor(term_screen::MONITOR::NONE);
     }
+  } else if (name == "status") {
+    report(layout, out);
+  } else if (name == "metrics") {
+    out += Metrics::Text();
+  } else if (name == "memory") {
+    if (arg == "on" || arg == "off") {
+      if ((arg == "on") != memoryshown) {
+        togglememory();
+      }
+    } else {
+      memory(layout, out);
+    }
+  } else if (name == "dump") {
+    dump(layout, out);
+  } else if (name == "quit") {
+    return false;
+  } else if (!name.empty()) {
+    fprintf(stderr, "unknown command: %s\n", name.c_str());
+  }
+  return true;
+}
 
-#if USE_VTERM
-    vterm_screen_flush_damage(node->m_vtscreen);
-    int rows, cols;
-    vterm_get_size(node->m_vterm, &rows, &cols);
-    for (int y = 0; y < rows; ++y) {
-      for (int x = 0; x < cols; ++x) {
-        VTermScreenCell cell;
-        vterm_screen_get_cell(node->m_vtscreen, {y, x}, &cell);
-
-        wchar_t ch = cell.chars[0];
-        if (ch > 0 && ch < 128) {
-          if (ch != ' ') {
-            auto a = 0;
+/* Read and run the commands on stdin, or from the control client, up to the
+ * next wait, false once mtm should end. */
+static bool commands(term_screen::Layout &layout) {
+  auto &h = *headless;
+  if (control) {
+    control->Dispatch(
+        [&h](std::string &&line) { h.Commands.push_back(std::move(line)); });
+    h.Eof = control->Closed();
+  } else if (!h.Eof && Selector::Instance().Ready(STDIN_FILENO)) {
+    char buf[4096];
+    auto r = read(STDIN_FILENO, buf, sizeof(buf));
+    if (r > 0) {
+      h.Partial.append(buf, r);
+      for (size_t end; (end = h.Partial.find('\n')) != std::string::npos;) {
+        h.Commands.push_back(h.Partial.substr(0, end));
+        h.Partial.erase(0, end + 1);
+      }
+    } else if (r == 0 || errno != EINTR) {
+      h.Eof = true;
+      Selector::Instance().Unwatch(STDIN_FILENO);
+    }
+  }
+
+  using namespace std::chrono;
+  auto now = steady_clock::now();
+  while (!h.Commands.empty()) {
+    if (h.Until > now) {
+      wakein(h.Until - now);
+      return true;
+    }
+    if (h.Idle.count()) {
+      auto quiet = now - h.Output;
+      if (quiet < h.Idle) {
+        /* checked again when the pane could have been quiet long enough */
+        wakein(h.Idle - quiet);
+        return true;
+      }
+      h.Idle = milliseconds(0);
+    }
+    auto line = h.Commands.front();
+    h.Commands.pop_front();
+    std::string out;
+    if (!control && !line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    bool more = command(layout, line, out);
+    if (control) {
+      /* every command is answered, so that a client can wait for one */
+      control->Reply(out);
+    } else if (!out.empty()) {
+      fwrite(out.data(), 1, out.size(), stdout);
+      fflush(stdout);
+    }
+    if (!more) {
+      return false;
+    }
+    if (layout.Empty()) {
+      return false;
+    }
+  }
+  return !h.Eof;
+}
+#endif
+
+/* A size in bytes the way the status line shows it, e.g. 5.6M. */
+static std::string humansize(size_t bytes) {
+  const char *units = "BKMGT";
+  double size = (double)bytes;
+  while (size >= 1024 && units[1]) {
+    size /= 1024;
+    ++units;
+  }
+  char text[16];
+  snprintf(text, sizeof(text), *units == 'B' ? "%.0f%c" : "%.1f%c", size,
+           *units);
+  return text;
+}
+
+/* The monitored panes by number, with # after one that printed and ~
+ * after one that went quiet; then, when shown, the memory of all the panes
+ * and of each, the largest first. */
+static std::string statustext(const term_screen::Layout &layout) {
+  std::string text;
+  auto &panes = layout.Panes();
+  for (size_t i = 0; i < panes.size(); ++i) {
+    auto &activity = panes[i]->m_activity;
+    if (activity.Monitoring() == term_screen::MONITOR::NONE) {
+      continue;
+    }
+    text += ' ';
+    text += std::to_string(i);
+    if (activity.Alert()) {
+      text += activity.Monitoring() == term_screen::MONITOR::ACTIVITY ? '#'
+                                                                      : '~';
+    }
+  }
+  if (memoryshown) {
+    auto usage = memoryusage(layout);
+    size_t total = 0;
+    for (auto &[i, m] : usage) {
+      total += m.Total();
+    }
+    text += (text.empty() ? " mem " : " | mem ") + humansize(total);
+    for (auto &[i, m] : usage) {
+      text += ' ' + std::to_string(i) + ':' + humansize(m.Total());
+    }
+  }
+  return text;
+}
+
+/* Show or hide the status line as monitors and the memory view come and
+ * go, and redraw it when an alert changed or the memory was counted again. */
+static void updatestatus(term_screen::Layout &layout) {
+  if (statuswanted() != statusshown) {
+    reshape(layout, screensize);
+#if !defined(_WIN32)
+    if (!server && !headless)
+#endif
+      redraw(layout);
+  }
+  auto generation = statusgen();
+  if (generation == statusgeneration) {
+    return;
+  }
+  statusgeneration = generation;
+  status = statusshown ? statustext(layout) : "";
+#if !defined(_WIN32)
+  if (server) {
+    server->Status(status);
+    return;
+  }
+  if (headless) {
+    return;
+  }
+#endif
+  if (statusshown) {
+    term_screen::DrawStatus({screensize.Rows - 1, 0}, screensize.Cols,
+                            status.c_str());
+  }
+}
+
+static void run(term_screen::Layout &layout) {
+  std::vector<std::shared_ptr<term_screen::NODE>> dead;
+  while (!layout.Empty()) {
+
+    InputStream::Instance().Poll(TimerQueue::Instance().Timeout());
+    TimerQueue::Instance().Run();
+
+#if !defined(_WIN32)
+    Events::Instance().Dispatch();
+    if (Events::Instance().Terminated()) {
+      if (snapshotpath) {
+        savesnapshot(layout);
+      }
+      return;
+    }
+    if (Events::Instance().DumpRequested()) {
+      if (metricspath) {
+        savemetrics();
+      }
+      if (tracepath) {
+        Trace::Write();
+      }
+    }
+    if (server) {
+      server->Dispatch();
+      term_screen::SIZE size;
+      if (server->Resized(&size)) {
+        /* the layout follows the terminal of the attached client */
+        reshape(layout, size);
+      }
+    } else if (Events::Instance().Resized()) {
+      /* one reshape per frame however many SIGWINCH arrived */
+      auto size = term_screen::Term::Insance().Resize();
+      reshape(layout, size);
+      redraw(layout);
+    }
+#endif
+
+#if !defined(_WIN32)
+    if (!headless)
+#endif
+      handleinput(layout);
+
+    dead.clear();
+    /* one clock read per turn stamps the output of every pane */
+    auto now = std::chrono::steady_clock::now();
+    auto focused = layout.Focused();
+    {
+      TRACE("read");
+      for (auto &node : layout.Panes()) {
+        auto handle = node->Process->Handle();
+
+        /* checked before draining, so that the last output is still parsed */
+        bool exited = node->Process->Exited();
+
+        /* parse the bytes in place, the pool copies what it queues */
+        auto data = InputStream::Instance().Peek(handle);
+        if (!data) {
+          // end of file
+          dead.push_back(node);
+          continue;
+        }
+#if !defined(_WIN32)
+        if (headless && !data->empty()) {
+          headless->Output = now;
+        }
+#endif
+        /* over the backlog the rest waits in the ring, until a worker
+         * takes the bytes and wakes the loop */
+        while (!data->empty()) {
+          if (pool->Full(node.get())) {
+            Metrics::Add(COUNTER::PARSE_STALLS);
+            break;
+          }
+          Metrics::Add(COUNTER::PANE_READS);
+          Metrics::Add(COUNTER::PANE_BYTES, data->size());
+          node->m_activity.Output(*data, now, node == focused);
+#if !defined(_WIN32)
+          if (control) {
+            control->Output(node->m_id, *data);
           }
-          node->s->WriteCell({y + node->s->tos, x}, ch, cell.fg.indexed.idx,
-                             cell.bg.indexed.idx);
+#endif
+          if (node->m_recording) {
+            node->m_recording->Output(*data);
+          }
+          pool->Submit(node.get(), *data);
+          InputStream::Instance().Consume(handle, data->size());
+          data = InputStream::Instance().Peek(handle).value_or(
+              std::span<const char>{});
+        }
+        if (exited && data->empty()) {
+          /* a background job may keep the pty open, do not wait for its end */
+          dead.push_back(node);
         }
       }
     }
-#else
+    for (auto &node : dead) {
+      deletenode(layout, node);
+    }
+    Metrics::Set(GAUGE::PANES, layout.Panes().size());
+
+    /* a pane that is looked at has nothing to alert about */
+    if ((focused = layout.Focused())) {
+      focused->m_activity.Clear();
+    }
+    updatestatus(layout);
+
+#if !defined(_WIN32)
+    if (server) {
+      for (auto &node : layout.Panes()) {
+        node->flush();
+      }
+      server->Send(layout);
+      continue;
+    }
+    if (headless) {
+      for (auto &node : layout.Panes()) {
+        node->flush();
+      }
+      if (layout.Empty() || !commands(layout)) {
+        break;
+      }
+      if (control) {
+        control->Send(layout);
+        control->Flush();
+      }
+      continue;
+    }
+#endif
+
+    Metrics::Timer render(HISTOGRAM::RENDER);
+    Metrics::Add(COUNTER::FRAMES);
+    {
+      TRACE("compose");
+      for (auto &node : layout.Panes()) {
+        if (copymode && copymode->Node() == node.get()) {
+          copymode->Draw();
+        } else {
+          TRACE("blit", node->m_id);
+          node->blit();
+        }
+        /* replies to queries raised while parsing */
+        node->flush();
+        node->s->draw(node->Pos, node->Size);
+      }
+      if (metricsshown) {
+        drawmetrics();
+      }
+
+      /* the focused pane goes last, it owns the cursor */
+      if (auto focused = layout.Focused()) {
+        focused->s->fixcursor(focused->Size);
+        focused->s->draw(focused->Pos, focused->Size);
+      }
+    }
+#if !defined(_WIN32)
+    TRACE("update");
+    doupdate();
 #endif
-    node->s->draw(node->Pos, node->Size);
-    node->s->fixcursor(node->Size);
-    node->s->draw(node->Pos, node->Size);
   }
 }
 
+#if !defined(_WIN32)
+static bool selectbackend(const char *name) {
+  for (auto backend : {Selector::Backend::Auto, Selector::Backend::Select,
+                       Selector::Backend::Epoll, Selector::Backend::Uring}) {
+    if (!strcmp(name, Selector::Name(backend))) {
+      return Selector::Instance().Initialize(backend);
+    }
+  }
+  return false;
+}
+
+/* The size of the terminal mtm was started in, before curses knows it. */
+static term_screen::SIZE hostsize() {
+  struct winsize ws = {};
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || !ws.ws_row ||
+      !ws.ws_col) {
+    return {24, 80};
+  }
+  return {ws.ws_row, ws.ws_col};
+}
+
+/* A pane of a session, as shown by a client. */
+struct VIEW {
+  std::unique_ptr<term_screen::SCRN> s;
+  term_screen::POS Pos;
+  term_screen::SIZE Size;
+};
+
+/* Show a session kept by another mtm process until it is detached or
+ * ends. */
+static int attach(term_screen::SessionClient &client) {
+  Events::Instance();
+  auto &host = term_screen::Term::Insance();
+  if (!host.Initialize()) {
+    std::cout << "could not initialize terminal" << std::endl;
+    return EXIT_FAILURE;
+  }
+  host.RawMode();
+  Selector::Instance().Watch(STDIN_FILENO);
+  client.Attach(host.Size());
+
+  std::unordered_map<uint32_t, VIEW> views;
+  uint32_t focused = 0;
+  /* keys are read through a pad, as from a pane */
+  term_screen::SCRN keyboard({1, 1});
+
+  /* the server leaves the last row to it while it is not empty */
+  std::string status;
+  auto drawstatus = [&]() {
+    if (!status.empty()) {
+      auto size = host.Size();
+      term_screen::DrawStatus({size.Rows - 1, 0}, size.Cols, status.c_str());
+    }
+  };
+
+  term_screen::SessionView view;
+  view.OnLayout = [&](std::span<const term_screen::PANE_INFO> panes,
+                      uint32_t id,
+                      std::span<const term_screen::BORDER> borders) {
+    std::unordered_map<uint32_t, VIEW> next;
+    for (auto &pane : panes) {
+      auto &v = next[pane.Id];
+      if (auto found = views.find(pane.Id); found != views.end()) {
+        v = std::move(found->second);
+      }
+      /* a spare row, so that writing the last cell does not scroll */
+      term_screen::SIZE padsize{(uint16_t)(pane.Size.Rows + 1),
+                                pane.Size.Cols};
+      if (!v.s) {
+        v.s = std::make_unique<term_screen::SCRN>(padsize);
+        v.s->tos = v.s->off = 0;
+        v.s->vis = 1;
+      } else if (!(v.Size == pane.Size)) {
+        v.s->Resize(padsize);
+      }
+      v.Pos = pane.Pos;
+      v.Size = pane.Size;
+      touchwin(v.s->win);
+    }
+    views = std::move(next);
+    focused = id;
+
+    werase(stdscr);
+    wnoutrefresh(stdscr);
+    for (auto &border : borders) {
+      if (border.Vertical) {
+        term_screen::DrawVLine(border.Pos, border.Length);
+      } else {
+        term_screen::DrawHLine(border.Pos, border.Length);
+      }
+    }
+    drawstatus();
+  };
+  view.OnCells = [&](uint32_t id, const term_screen::POS &pos,
+                     std::span<const term_screen::CELL> cells) {
+    auto found = views.find(id);
+    if (found == views.end()) {
+      return;
+    }
+    auto &s = found->second.s;
+    for (int i = 0; i < (int)cells.size(); ++i) {
+      auto &cell = cells[i];
+      if (cell.Width == 0) {
+        // right half of a wide character
+        continue;
+      }
+      s->WriteCell({pos.Y, pos.X + i}, cell.Char ? cell.Char : L' ', cell.Fg,
+                   cell.Bg);
+    }
+  };
+  view.OnStatus = [&](const std::string &text) {
+    status = text;
+    drawstatus();
+  };
+  view.OnCursor = [&](uint32_t id, const term_screen::POS &cursor,
+                      bool visible) {
+    if (auto found = views.find(id); found != views.end()) {
+      found->second.s->MoveCursor(cursor);
+      found->second.s->vis = visible ? 1 : 0;
+    }
+  };
+
+  std::vector<term_screen::Input> inputs;
+  while (true) {
+    Selector::Instance().Select();
+
+    Events::Instance().Dispatch();
+    if (Events::Instance().Resized()) {
+      /* the server answers with a new layout */
+      client.Resize(host.Resize());
+    }
+
+    inputs.clear();
+    for (auto input = keyboard.getchar(); !input.KERR();
+         input = keyboard.getchar()) {
+      inputs.push_back(input);
+    }
+    client.Send(inputs);
+
+    if (!client.Receive(view)) {
+      break;
+    }
+
+    /* the focused pane goes last, it owns the cursor */
+    for (auto &[id, v] : views) {
+      if (id != focused) {
+        v.s->draw(v.Pos, v.Size);
+      }
+    }
+    if (auto found = views.find(focused); found != views.end()) {
+      auto &v = found->second;
+      v.s->fixcursor(v.Size);
+      v.s->draw(v.Pos, v.Size);
+    }
+    doupdate();
+  }
+
+  endwin();
+  switch (client.Reason()) {
+  case term_screen::BYE::DETACHED:
+    std::cout << "[detached]" << std::endl;
+    break;
+  case term_screen::BYE::EXITED:
+    std::cout << "[exited]" << std::endl;
+    break;
+  case term_screen::BYE::REPLACED:
+    std::cout << "[detached by another client]" << std::endl;
+    break;
+  case term_screen::BYE::VERSION:
+    std::cout << "[the session runs another version of mtm]" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/* Play a recording back into one pane at the recorded sizes, at the
+ * recorded pace or as fast as the emulator and the screen allow. Any key
+ * stops it. */
+static int replay(const char *path, bool fast) {
+  auto recording = Replay::Open(path);
+  if (!recording) {
+    endwin();
+    std::cout << "not a recording: " << path << std::endl;
+    return EXIT_FAILURE;
+  }
+  auto n = std::make_shared<term_screen::NODE>(term_screen::POS{0, 0},
+                                               recording->Size());
+  pool->Register(n.get(),
+                 [n = n.get()](const char *b, size_t len) { n->parse(b, len); });
+
+  auto show = [&n]() {
+    auto screen = term_screen::Term::Insance().Size();
+    term_screen::SIZE visible = {std::min(n->Size.Rows, screen.Rows),
+                                 std::min(n->Size.Cols, screen.Cols)};
+    n->blit();
+    n->flush();
+    n->s->fixcursor(visible);
+    n->s->draw(n->Pos, visible);
+    doupdate();
+  };
+  auto pressed = [&n]() {
+    bool any = false;
+    while (!n->s->getchar().KERR()) {
+      any = true;
+    }
+    return any;
+  };
+
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  uint64_t bytes = 0;
+  bool stopped = false;
+  REPLAY_EVENT event;
+  while (!stopped && recording->Next(&event)) {
+    while (!fast) {
+      auto due = start + std::chrono::microseconds(event.Time);
+      auto wait =
+          std::chrono::ceil<std::chrono::milliseconds>(due - Clock::now());
+      if (wait.count() <= 0) {
+        break;
+      }
+      InputStream::Instance().Poll(wait.count());
+      Events::Instance().Dispatch();
+      if (pressed()) {
+        stopped = true;
+        break;
+      }
+    }
+    if (fast) {
+      /* there are no waits to look for a key in */
+      InputStream::Instance().Poll(0);
+      Events::Instance().Dispatch();
+      stopped = pressed();
+    }
+    if (stopped) {
+      break;
+    }
+    switch (event.Type) {
+    case REPLAY_EVENT::OUTPUT:
+      pool->Submit(n.get(), event.Data);
+      bytes += event.Data.size();
+      break;
+    case REPLAY_EVENT::RESIZE:
+      n->reshape(n->Pos, event.Size);
+      break;
+    }
+    show();
+  }
+  pool->Drain();
+  show();
+  auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  if (!fast && !stopped) {
+    /* the last screen stays until a key is pressed */
+    while (!pressed()) {
+      InputStream::Instance().Poll(-1);
+      Events::Instance().Dispatch();
+    }
+  }
+  pool->Unregister(n.get());
+  endwin();
+  printf("[replayed %llu bytes in %.3f s, %.1f MiB/s]\n",
+         (unsigned long long)bytes, seconds, bytes / seconds / (1024 * 1024));
+  return EXIT_SUCCESS;
+}
+#endif
+
 int main(int argc, char **argv) {
   setlocale(LC_ALL, "");
 
-  /* automatically reap children */
-  const char *term = nullptr;
+  size_t threads = 0;
+  size_t nshells = 0;
+  const char *replaypath = nullptr;
+  bool fast = false;
+  term_screen::SIZE size = {};
 #if !defined(_WIN32)
-  signal(SIGCHLD, SIG_IGN);
+  HEADLESS nohost;
+  const char *backend = nullptr;
+  const char *session = nullptr;
+  const char *controlpath = nullptr;
 
   int c = 0;
-  while ((c = getopt(argc, argv, "c:T:t:")) != -1) {
+  while ((c = getopt(argc, argv, "c:T:t:j:b:p:L:S:R:P:w:r:fH:s:C:M:X:l:d:")) !=
+         -1) {
     switch (c) {
     case 'c':
       commandkey = CTL(optarg[0]);
@@ -203,40 +1545,230 @@ int main(int argc, char **argv) {
     case 't':
       term = optarg;
       break;
+    case 'j':
+      threads = strtoul(optarg, nullptr, 10);
+      break;
+    case 'p':
+      pipecommand = optarg;
+      break;
+    case 'L':
+      logpath = optarg;
+      break;
+    case 'b':
+      backend = optarg;
+      break;
+    case 'S':
+      session = optarg;
+      break;
+    case 'R':
+      snapshotpath = optarg;
+      break;
+    case 'M':
+      metricspath = optarg;
+      break;
+    case 'X':
+      tracepath = optarg;
+      break;
+    case 'P':
+      nshells = strtoul(optarg, nullptr, 10);
+      break;
+    case 'l': {
+      char *end;
+      auto lines = strtoul(optarg, &end, 10);
+      if (*end || lines == 0) {
+        std::cout << USAGE << std::endl;
+        return EXIT_FAILURE;
+      }
+      term_screen::NODE::s_historyLines = lines;
+      break;
+    }
+    case 'd': {
+      char *end;
+      auto ms = strtol(optarg, &end, 10);
+      if (*end || end == optarg || ms < 0 || ms > 10000) {
+        std::cout << USAGE << std::endl;
+        return EXIT_FAILURE;
+      }
+      term_screen::NODE::s_resizeDelay = (int)ms;
+      break;
+    }
+    case 'w':
+      recordpath = optarg;
+      break;
+    case 'r':
+      replaypath = optarg;
+      break;
+    case 'f':
+      fast = true;
+      break;
+    case 's':
+      silence = atoi(optarg);
+      break;
+    case 'C':
+      controlpath = optarg;
+      /* 80x24 until a resize, unless -H says otherwise */
+      if (!headless) {
+        nohost.Size = {24, 80};
+        headless = &nohost;
+      }
+      break;
+    case 'H': {
+      int rows = 0, cols = 0;
+      if (sscanf(optarg, "%dx%d", &rows, &cols) != 2 || rows <= 0 ||
+          cols <= 0) {
+        std::cout << USAGE << std::endl;
+        return EXIT_FAILURE;
+      }
+      nohost.Size = {(uint16_t)rows, (uint16_t)cols};
+      headless = &nohost;
+      break;
+    }
     default:
       std::cout << USAGE << std::endl;
       return EXIT_FAILURE;
     }
   }
-#endif
 
-  if (!term_screen::Term::Insance().Initialize()) {
-    std::cout << "could not initialize terminal" << std::endl;
+  /* attach to the session, or start a server that keeps it; nothing that
+   * owns descriptors (the selector, signals, curses) may exist before the
+   * fork */
+  std::unique_ptr<term_screen::SessionServer> listener;
+  std::unique_ptr<term_screen::SessionClient> client;
+  std::unique_ptr<term_screen::Control> controller;
+  if (session && !(client = term_screen::SessionClient::Connect(session))) {
+    listener = term_screen::SessionServer::Listen(session);
+    if (!listener) {
+      std::cout << "could not listen on " << session << ": "
+                << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+    /* the server starts with the size of this terminal */
+    size = hostsize();
+    int pid = listener->Fork();
+    if (pid == 0) {
+      server = listener.get();
+    } else {
+      listener.reset();
+      if (pid < 0 || !(client = term_screen::SessionClient::Connect(session))) {
+        std::cout << "could not start a server for " << session << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+  }
+
+  if (backend && !selectbackend(backend)) {
+    std::cout << "unsupported backend: " << backend << std::endl;
     return EXIT_FAILURE;
   }
-  term_screen::Term::Insance().RawMode();
-  auto size = term_screen::Term::Insance().Size();
-
-  auto node = std::make_shared<term_screen::NODE>(
-      term_screen::POS{
-          .Y = 2,
-          .X = 2,
-      },
-      term_screen::SIZE{
-          .Rows = static_cast<uint16_t>(size.Rows - 4),
-          .Cols = static_cast<uint16_t>(size.Cols - 4),
-      });
-  if (!node) {
+  if (client) {
+    return attach(*client);
+  }
+
+  /* signals and child exits come through the selector; blocks the signals,
+   * so it has to run before the parse pool starts its threads */
+  Events::Instance();
+  if (tracepath) {
+#if !HAVE_TRACING
+    std::cout << "built without tracing, -X records nothing" << std::endl;
+#endif
+    /* in the process that runs the panes, after a -S fork */
+    Trace::Start(tracepath);
+  }
+#endif
+
+#if !defined(_WIN32)
+  if (server) {
+    /* keyboard input comes from the client, stdin is /dev/null */
+    InputStream::Instance();
+    Selector::Instance().Unwatch(STDIN_FILENO);
+    if (!term_screen::Term::Insance().Initialize(true)) {
+      return EXIT_FAILURE;
+    }
+  } else if (headless) {
+    /* stdin stays watched, it carries the commands */
+    if (!term_screen::Term::Insance().Initialize(true)) {
+      std::cout << "could not initialize the in-memory screen" << std::endl;
+      return EXIT_FAILURE;
+    }
+    size = headless->Size;
+    if (controlpath &&
+        !(controller = term_screen::Control::Open(controlpath))) {
+      std::cout << "could not listen on " << controlpath << ": "
+                << strerror(errno) << std::endl;
+      return EXIT_FAILURE;
+    }
+    control = controller.get();
+  } else
+#endif
+  {
+    if (!term_screen::Term::Insance().Initialize()) {
+      std::cout << "could not initialize terminal" << std::endl;
+      return EXIT_FAILURE;
+    }
+    term_screen::Term::Insance().RawMode();
+    size = term_screen::Term::Insance().Size();
+  }
+
+#if !USE_VTERM
+  /* the vtparser handlers draw straight into curses pads */
+  threads = 0;
+#endif
+  ParsePool parsepool(threads);
+  pool = &parsepool;
+
+#if !defined(_WIN32)
+  if (parsepool.Threads()) {
+    /* output parsed on a worker is drawn without waiting for more input */
+    parsepool.OnParsed([](void *) { Events::Instance().Wake(); });
+  }
+  if (replaypath) {
+    return replay(replaypath, fast);
+  }
+#endif
+
+  std::unique_ptr<term_screen::ShellPool> shellpool;
+  if (nshells) {
+    shellpool = std::make_unique<term_screen::ShellPool>(nshells, size, term);
+    shells = shellpool.get();
+  }
+
+  screensize = size;
+  term_screen::Layout layout({0, 0}, size);
+#if !defined(_WIN32)
+  /* the panes of the last run, each with a new shell */
+  std::unique_ptr<term_screen::Snapshot> snapshot;
+  if (snapshotpath && (snapshot = term_screen::Snapshot::Open(snapshotpath))) {
+    size_t index = 0;
+    layout.Restore(snapshot->Shape(),
+                   [&](const term_screen::POS &pos,
+                       const term_screen::SIZE &size) {
+                     return startnode(pos, size, snapshot.get(), index++);
+                   });
+  }
+  if (layout.Empty() &&
+      !layout.Split(term_screen::SPLIT::HORIZONTAL,
+                    [&](const term_screen::POS &pos,
+                        const term_screen::SIZE &size) {
+                      /* a layout that no longer fits keeps its first pane */
+                      return startnode(pos, size, snapshot.get(), 0);
+                    })) {
+#else
+  if (!layout.Split(term_screen::SPLIT::HORIZONTAL, newnode)) {
+#endif
     std::cout << "could not open root window" << std::endl;
     return EXIT_FAILURE;
   }
+  run(layout);
 
-  node->Process = term_screen::Process::Fork(node->Size, term);
-  if (!node->Process) {
-    return 0;
+#if !defined(_WIN32)
+  if (tracepath) {
+    Trace::Write();
   }
-
-  run(node);
+  if (snapshotpath && layout.Empty()) {
+    /* every shell exited, there is nothing to restore */
+    unlink(snapshotpath);
+  }
+#endif
 
   return EXIT_SUCCESS;
 }
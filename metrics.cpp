@@ -0,0 +1,95 @@
+#include "metrics.h"
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+thread_local Metrics::BLOCK *Metrics::t_block = nullptr;
+
+static std::mutex g_mutex;
+// never freed, a block outlives its thread
+static std::vector<Metrics::BLOCK *> g_blocks;
+static std::atomic<uint64_t> g_gauges[(int)GAUGE::COUNT];
+
+static const char *COUNTER_NAMES[] = {
+    "pane_bytes",  "pane_reads",   "parsed_bytes", "parse_stalls",
+    "piped_bytes", "pipe_dropped", "frames",       "resizes",
+    "resizes_suppressed",
+};
+static_assert(std::size(COUNTER_NAMES) == (size_t)COUNTER::COUNT);
+
+static const char *GAUGE_NAMES[] = {"panes", "parse_queue", "syscalls"};
+static_assert(std::size(GAUGE_NAMES) == (size_t)GAUGE::COUNT);
+
+static const char *HISTOGRAM_NAMES[] = {"parse_us", "render_us", "wait_us"};
+static_assert(std::size(HISTOGRAM_NAMES) == (size_t)HISTOGRAM::COUNT);
+
+Metrics::BLOCK *Metrics::Register() {
+  t_block = new BLOCK;
+  std::scoped_lock<std::mutex> lock(g_mutex);
+  g_blocks.push_back(t_block);
+  return t_block;
+}
+
+void Metrics::Set(GAUGE gauge, uint64_t value) {
+  g_gauges[(int)gauge].store(value, std::memory_order_relaxed);
+}
+
+std::string Metrics::Text() {
+  uint64_t counters[(int)COUNTER::COUNT] = {};
+  uint64_t buckets[(int)HISTOGRAM::COUNT][BUCKETS] = {};
+  uint64_t sums[(int)HISTOGRAM::COUNT] = {};
+  {
+    std::scoped_lock<std::mutex> lock(g_mutex);
+    for (auto block : g_blocks) {
+      for (int i = 0; i < (int)COUNTER::COUNT; ++i) {
+        counters[i] += block->Counters[i].load(std::memory_order_relaxed);
+      }
+      for (int h = 0; h < (int)HISTOGRAM::COUNT; ++h) {
+        for (int i = 0; i < BUCKETS; ++i) {
+          buckets[h][i] += block->Buckets[h][i].load(std::memory_order_relaxed);
+        }
+        sums[h] += block->Sums[h].load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  std::string text;
+  char line[256];
+  for (int i = 0; i < (int)COUNTER::COUNT; ++i) {
+    snprintf(line, sizeof(line), "%s %llu\n", COUNTER_NAMES[i],
+             (unsigned long long)counters[i]);
+    text += line;
+  }
+  for (int i = 0; i < (int)GAUGE::COUNT; ++i) {
+    snprintf(line, sizeof(line), "%s %llu\n", GAUGE_NAMES[i],
+             (unsigned long long)g_gauges[i].load(std::memory_order_relaxed));
+    text += line;
+  }
+  for (int h = 0; h < (int)HISTOGRAM::COUNT; ++h) {
+    uint64_t count = 0;
+    for (auto n : buckets[h]) {
+      count += n;
+    }
+    // the upper bound of the bucket holding the q-th duration
+    auto bound = [&](double q) -> unsigned long long {
+      uint64_t seen = 0;
+      int last = 0;
+      for (int i = 0; i < BUCKETS; ++i) {
+        seen += buckets[h][i];
+        if (buckets[h][i]) {
+          last = i;
+        }
+        if (q < 1 && seen > q * count) {
+          return 1ull << i;
+        }
+      }
+      return count ? 1ull << last : 0;
+    };
+    snprintf(line, sizeof(line), "%s count=%llu sum=%llu p50=%llu p99=%llu "
+             "max=%llu\n",
+             HISTOGRAM_NAMES[h], (unsigned long long)count,
+             (unsigned long long)sums[h], bound(0.5), bound(0.99), bound(1));
+    text += line;
+  }
+  return text;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <stdint.h>
+#include <string>
+
+enum class COUNTER : uint8_t {
+  // pane output read by the loop, and the reads it took
+  PANE_BYTES,
+  PANE_READS,
+  // bytes run through an emulator
+  PARSED_BYTES,
+  // turns a pane was not read because its parse backlog was full
+  PARSE_STALLS,
+  // pane output taken by pipe-pane commands, and what they left
+  PIPED_BYTES,
+  PIPE_DROPPED,
+  FRAMES,
+  // sizes told to children, and those superseded within the resize delay
+  RESIZES,
+  RESIZES_SUPPRESSED,
+  COUNT,
+};
+
+// the last value set, from the one place that owns it
+enum class GAUGE : uint8_t {
+  PANES,
+  // panes with output waiting for a parse worker
+  PARSE_QUEUE,
+  // system calls made by the selector so far
+  SYSCALLS,
+  COUNT,
+};
+
+// in microseconds
+enum class HISTOGRAM : uint8_t {
+  // a batch of one pane on the emulator
+  PARSE,
+  // drawing every pane and updating the host terminal
+  RENDER,
+  // the loop blocked in the selector
+  WAIT,
+  COUNT,
+};
+
+// Counters and latency histograms of the running mtm.
+//
+// Every thread adds to a block of its own, which only it writes, so the hot
+// paths take no lock and do not share cache lines. A block is registered on
+// the first use in a thread and kept after the thread ends, so that totals
+// do not shrink. Text sums the blocks; it is for the rare reader, the
+// metrics command, the dump and the overlay.
+class Metrics {
+public:
+  using Clock = std::chrono::steady_clock;
+  // bucket i counts durations below 2^i microseconds, the last one the rest
+  static const int BUCKETS = 24;
+
+  struct BLOCK {
+    std::atomic<uint64_t> Counters[(int)COUNTER::COUNT] = {};
+    std::atomic<uint64_t> Buckets[(int)HISTOGRAM::COUNT][BUCKETS] = {};
+    std::atomic<uint64_t> Sums[(int)HISTOGRAM::COUNT] = {};
+  };
+
+private:
+  static thread_local BLOCK *t_block;
+  static BLOCK *Register();
+
+  static BLOCK &Block() { return t_block ? *t_block : *Register(); }
+
+  // a plain add, nobody else writes the value
+  static void Bump(std::atomic<uint64_t> &value, uint64_t n) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  }
+
+public:
+  static void Add(COUNTER counter, uint64_t n = 1) {
+    Bump(Block().Counters[(int)counter], n);
+  }
+
+  static void Set(GAUGE gauge, uint64_t value);
+
+  static void Record(HISTOGRAM histogram, Clock::duration duration) {
+    auto us = (uint64_t)std::max<int64_t>(
+        0, std::chrono::duration_cast<std::chrono::microseconds>(duration)
+               .count());
+    auto bucket = std::min<int>(std::bit_width(us), BUCKETS - 1);
+    auto &block = Block();
+    Bump(block.Buckets[(int)histogram][bucket], 1);
+    Bump(block.Sums[(int)histogram], us);
+  }
+
+  // records the time from its construction to its end
+  class Timer {
+    HISTOGRAM m_histogram;
+    Clock::time_point m_start;
+
+  public:
+    explicit Timer(HISTOGRAM histogram)
+        : m_histogram(histogram), m_start(Clock::now()) {}
+    Timer(const Timer &) = delete;
+    Timer &operator=(const Timer &) = delete;
+    ~Timer() { Record(m_histogram, Clock::now() - m_start); }
+  };
+
+  // a line per counter and gauge, "name value", and per histogram
+  // "name_us count=N sum=S p50=A p99=B max=C", where the percentiles and
+  // the maximum are the upper bounds of their buckets
+  static std::string Text();
+};
@@ -22,6 +22,8 @@
 #include <assert.h>
 #include <curses.h>
 
+using namespace term_screen;
+
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
@@ -128,7 +130,7 @@ wmove(win, py, MIN(x + P1(0), mx - 1));
 ENDHANDLER
 
 HANDLER(ack) /* ACK - Acknowledge Enquiry */
-n->Process->WriteString("\006");
+n->queuestring("\006");
 ENDHANDLER
 
 HANDLER(hts) /* HTS - Horizontal Tab Set */
@@ -146,9 +148,9 @@ ENDHANDLER
 
 HANDLER(decid) /* DECID - Send Terminal Identification */
 if (w == L'c')
-  n->Process->WriteString(iw == L'>' ? "\033[>1;10;0c" : "\033[?1;2c");
+  n->queuestring(iw == L'>' ? "\033[>1;10;0c" : "\033[?1;2c");
 else if (w == L'Z')
-  n->Process->WriteString("\033[?6c");
+  n->queuestring("\033[?6c");
 ENDHANDLER
 
 HANDLER(hpa) /* HPA - Cursor Horizontal Absolute */
@@ -324,7 +326,7 @@ if (P0(0) == 6)
            x + 1);
 else
   snprintf(buf, sizeof(buf) - 1, "\033[0n");
-n->Process->WriteString(buf);
+n->queuestring(buf);
 ENDHANDLER
 
 HANDLER(idl) /* IL or DL - Insert/Delete Line */
@@ -344,8 +346,7 @@ if (wsetscrreg(win, tos + P1(0) - 1, tos + PD(1, my) - 1) == OK)
 ENDHANDLER
 
 HANDLER(decreqtparm) /* DECREQTPARM - Request Device Parameters */
-n->Process->WriteString(P0(0) ? "\033[3;1;2;120;1;0x"
-                              : "\033[2;1;2;120;128;1;0x");
+n->queuestring(P0(0) ? "\033[3;1;2;120;1;0x" : "\033[2;1;2;120;128;1;0x");
 ENDHANDLER
 
 HANDLER(sgr0) /* Reset SGR to default */
@@ -366,7 +367,7 @@ n->gs = n->gc = n->g0 = CSET_US;
 n->g1 = CSET_GRAPH;
 n->g2 = CSET_US;
 n->g3 = CSET_GRAPH;
-n->decom = s->insert = s->oxenl = s->xenl = n->lnm = false;
+n->decom = s->insert = s->oxenl = s->xenl = n->lnm = n->bpaste = false;
 CALL(cls);
 CALL(sgr0);
 n->am = true;
@@ -411,6 +412,9 @@ for (int i = 0; i < argc; i++)
   case 1048:
     CALL((set ? sc : rc));
     break;
+  case 2004:
+    n->bpaste = set;
+    break;
   case 1049:
     CALL((set ? sc : rc)); /* fall-through */
   case 47:
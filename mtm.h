@@ -1,3 +1,7 @@
 #pragma once
 
-void setupevents(struct VTPARSER *vp, struct NODE *n);
+namespace term_screen {
+struct NODE;
+}
+
+void setupevents(struct VTPARSER *vp, term_screen::NODE *n);
@@ -3,11 +3,58 @@
 #include "screen.h"
 #include "mtm.h"
 #include "child_process.h"
+#include "metrics.h"
+#include "pane_log.h"
+#include "recording.h"
+#include "snapshot.h"
+#include "timer_queue.h"
+#include "trace.h"
+#include "utf8.h"
 #include "vtparser.h"
+#include <string.h>
 #include <vterm.h>
 
 namespace term_screen {
 
+#if USE_VTERM
+static CELL tocell(const VTermScreenCell &c) {
+  CELL cell;
+  // the right half of a wide character comes as -1, width 1
+  bool half = c.chars[0] == (uint32_t)-1;
+  cell.Char = half ? 0 : c.chars[0];
+  // -1 for the default colors, direct colors are not kept
+  cell.Fg = VTERM_COLOR_IS_INDEXED(&c.fg) ? c.fg.indexed.idx : -1;
+  cell.Bg = VTERM_COLOR_IS_INDEXED(&c.bg) ? c.bg.indexed.idx : -1;
+  cell.Width = half ? 0 : c.width;
+  cell.Attr = (c.attrs.bold ? ATTR_BOLD : 0) |
+              (c.attrs.underline ? ATTR_UNDERLINE : 0) |
+              (c.attrs.italic ? ATTR_ITALIC : 0) |
+              (c.attrs.blink ? ATTR_BLINK : 0) |
+              (c.attrs.reverse ? ATTR_REVERSE : 0);
+  return cell;
+}
+
+static void fromcell(const CELL &cell, const VTermColor &fg,
+                     const VTermColor &bg, VTermScreenCell *c) {
+  *c = {};
+  c->chars[0] = cell.Char;
+  c->width = std::max(cell.Width, (uint8_t)1);
+  c->attrs.bold = !!(cell.Attr & ATTR_BOLD);
+  c->attrs.underline = !!(cell.Attr & ATTR_UNDERLINE);
+  c->attrs.italic = !!(cell.Attr & ATTR_ITALIC);
+  c->attrs.blink = !!(cell.Attr & ATTR_BLINK);
+  c->attrs.reverse = !!(cell.Attr & ATTR_REVERSE);
+  c->fg = fg;
+  c->bg = bg;
+  if (cell.Fg >= 0) {
+    vterm_color_indexed(&c->fg, cell.Fg);
+  }
+  if (cell.Bg >= 0) {
+    vterm_color_indexed(&c->bg, cell.Bg);
+  }
+}
+#endif
+
 SIZE SIZE::Max(const SIZE &rhs) const {
   return {
       std::max(Rows, rhs.Rows),
@@ -15,17 +62,25 @@ SIZE SIZE::Max(const SIZE &rhs) const {
   };
 }
 
+size_t NODE::s_historyLines = SCROLLBACK_LINES;
+int NODE::s_resizeDelay = RESIZE_DELAY;
+
 NODE::NODE(const POS &pos, const SIZE &size)
     : Pos(pos), Size(size),
       pri(new SCRN({std::max(size.Rows, (uint16_t)SCROLLBACK), size.Cols})),
       alt(new SCRN(size)),
 #if USE_VTERM
-      m_vterm(vterm_new(size.Rows, size.Cols))
+      m_vterm(vterm_new(size.Rows, size.Cols)), m_grid(size),
+      m_history(s_historyLines)
 #else
       vp(new VTPARSER),
 #endif
 {
+  static uint32_t nextId = 1;
+  m_id = nextId++;
   this->tabs.resize(Size.Cols, 0);
+  /* the child is forked with this size */
+  this->m_childSize = size;
 
   if (this->pri->win && this->alt->win) {
     this->pri->tos = this->pri->off = std::max(0, SCROLLBACK - size.Rows);
@@ -34,14 +89,78 @@ NODE::NODE(const POS &pos, const SIZE &size)
 
 #if USE_VTERM
   m_vtscreen = vterm_obtain_screen(m_vterm);
+  static VTermScreenCallbacks callbacks = {
+      .damage =
+          [](VTermRect rect, void *user) {
+            ((NODE *)user)->m_grid.Damage(rect.start_row, rect.end_row);
+            return 1;
+          },
+      .settermprop =
+          [](VTermProp prop, VTermValue *val, void *user) {
+            auto n = (NODE *)user;
+            if (prop == VTERM_PROP_CURSORVISIBLE) {
+              n->m_cursorVisible = val->boolean;
+            } else if (prop == VTERM_PROP_ALTSCREEN) {
+              n->m_altScreen = val->boolean;
+            } else if (prop == VTERM_PROP_REVERSE) {
+              n->m_reverse = val->boolean;
+            }
+            return 1;
+          },
+      .sb_pushline =
+          [](int cols, const VTermScreenCell *cells, void *user) {
+            auto n = (NODE *)user;
+            if (n->m_log) {
+              n->m_log->Push(cols, cells);
+            }
+            thread_local std::vector<CELL> line;
+            line.resize(cols);
+            for (int x = 0; x < cols; ++x) {
+              line[x] = tocell(cells[x]);
+            }
+            n->m_history.Push(line);
+            return 1;
+          },
+      .sb_popline =
+          [](int cols, VTermScreenCell *cells, void *user) {
+            // the screen grew taller, the newest history line comes back
+            auto n = (NODE *)user;
+            thread_local std::vector<CELL> line;
+            if (!n->m_history.Pop(&line)) {
+              return 0;
+            }
+            VTermColor fg, bg;
+            vterm_state_get_default_colors(vterm_obtain_state(n->m_vterm), &fg,
+                                           &bg);
+            for (int x = 0; x < cols; ++x) {
+              fromcell(x < (int)line.size() ? line[x] : CELL{}, fg, bg,
+                       &cells[x]);
+            }
+            return 1;
+          },
+  };
+  vterm_screen_set_callbacks(m_vtscreen, &callbacks, this);
+  vterm_screen_set_damage_merge(m_vtscreen, VTERM_DAMAGE_SCROLL);
+  // without it ?1049h and friends are refused and the program draws over
+  // the shell
+  vterm_screen_enable_altscreen(m_vtscreen, 1);
   vterm_screen_reset(m_vtscreen, true);
   vterm_set_utf8(m_vterm, true);
+  vterm_output_set_callback(
+      m_vterm,
+      [](const char *s, size_t len, void *user) {
+        ((NODE *)user)->queue(s, len);
+      },
+      this);
 #else
   setupevents(this);
 #endif
 }
 
-NODE::~NODE() { vterm_free(m_vterm); }
+NODE::~NODE() {
+  TimerQueue::Instance().Cancel(m_resizeTimer);
+  vterm_free(m_vterm);
+}
 
 void NODE::reshape(const POS &pos, const SIZE &size) {
   if (this->Pos == pos && this->Size == size) {
@@ -56,10 +175,317 @@ void NODE::reshape(const POS &pos, const SIZE &size) {
   this->s->draw(Pos, Size);
 }
 
+#if USE_VTERM
+/* Publish the damaged rows and the cursor for the renderer. */
+static void publish(NODE *n) {
+  vterm_screen_flush_damage(n->m_vtscreen);
+  VTermPos cursor;
+  vterm_state_get_cursorpos(vterm_obtain_state(n->m_vterm), &cursor);
+  POS pos{cursor.row, cursor.col};
+
+  auto front = n->m_grid.Acquire();
+  if (!n->m_grid.Dirty() && front && front->Cursor == pos &&
+      front->CursorVisible == n->m_cursorVisible) {
+    return;
+  }
+
+  n->m_grid.Publish(
+      [n](int y, std::vector<CELL> &cells) {
+        for (int x = 0; x < (int)cells.size(); ++x) {
+          VTermScreenCell cell;
+          vterm_screen_get_cell(n->m_vtscreen, {y, x}, &cell);
+          cells[x] = tocell(cell);
+        }
+      },
+      pos, n->m_cursorVisible);
+}
+#endif
+
+void NODE::parse(const char *b, size_t n) {
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  TRACE("parse", m_id);
+#if USE_VTERM
+  vterm_input_write(m_vterm, b, n);
+  TRACE("publish", m_id);
+  publish(this);
+#else
+  vtwrite(vp.get(), b, n);
+#endif
+}
+
+#if USE_VTERM
+/* What libvterm keeps per cell of its screen buffer; its ScreenCell is not
+ * public, this is the size of the chars and pen it holds. */
+static const size_t VTERM_CELL_BYTES =
+    VTERM_MAX_CHARS_PER_CELL * sizeof(uint32_t) + 12;
+#endif
+
+PANE_MEMORY NODE::memory() {
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  PANE_MEMORY memory;
+  memory.Screens = pri->Bytes() + alt->Bytes();
+  memory.Emulator = tabs.capacity() / 8;
+#if USE_VTERM
+  int rows = 0, cols = 0;
+  vterm_get_size(m_vterm, &rows, &cols);
+  /* the screen buffer, the line infos of the state and the row that
+   * scrolls off the top */
+  memory.Emulator += (size_t)rows * cols * VTERM_CELL_BYTES + rows * 2 +
+                     cols * sizeof(VTermScreenCell) + m_grid.Bytes();
+  memory.Scrollback = m_history.Bytes();
+#else
+  memory.Emulator += sizeof(VTPARSER);
+#endif
+  {
+    std::scoped_lock<std::mutex> input(m_inputMutex);
+    memory.Queues = m_input.capacity();
+  }
+  return memory;
+}
+
+/* Copy the rows that changed since the last frame into the pad. */
+void NODE::blit() {
+#if USE_VTERM
+  auto frame = m_grid.Acquire();
+  if (!frame || frame == m_drawn) {
+    return;
+  }
+
+  bool full = !m_drawn || !(m_drawn->Size == frame->Size);
+  for (int y = 0; y < frame->Size.Rows; ++y) {
+    auto &row = frame->Rows[y];
+    if (!full && row == m_drawn->Rows[y]) {
+      continue;
+    }
+    for (int x = 0; x < (int)row->Cells.size(); ++x) {
+      auto &cell = row->Cells[x];
+      if (cell.Width == 0) {
+        // right half of a wide character
+        continue;
+      }
+      s->WriteCell({y + s->tos, x}, cell.Char ? cell.Char : L' ', cell.Fg,
+                   cell.Bg);
+    }
+  }
+  s->MoveCursor({frame->Cursor.Y + s->tos, frame->Cursor.X});
+  s->vis = frame->CursorVisible ? 1 : 0;
+  m_drawn = frame;
+#endif
+}
+
+PANE_SNAPSHOT NODE::snapshot() {
+  PANE_SNAPSHOT pane;
+  pane.Size = Size;
+  pane.Cells.reserve((size_t)Size.Rows * Size.Cols);
+#if USE_VTERM
+  publish(this);
+  auto frame = m_grid.Acquire();
+  pane.Cursor = frame->Cursor;
+  for (auto &row : frame->Rows) {
+    pane.Cells.insert(pane.Cells.end(), row->Cells.begin(), row->Cells.end());
+  }
+  // libvterm keeps its tabs and charsets to itself, the defaults are written
+  pane.Modes = (m_cursorVisible ? MODE_CURSOR_VISIBLE : 0) |
+               (m_altScreen ? MODE_ALTSCREEN : 0) |
+               (m_reverse ? MODE_REVERSE : 0) | MODE_AUTOWRAP;
+  pane.History = &m_history;
+#else
+  pane.Cursor = s->GetPos();
+  pane.Modes = (s->vis ? MODE_CURSOR_VISIBLE : 0) |
+               (s == alt ? MODE_ALTSCREEN : 0) |
+               (pnm ? MODE_APPLICATION_CURSOR : 0) |
+               (decom ? MODE_ORIGIN : 0) | (am ? MODE_AUTOWRAP : 0) |
+               (lnm ? MODE_NEWLINE : 0) | (bpaste ? MODE_BRACKETED_PASTE : 0);
+  for (int x = 0; x < (int)tabs.size(); ++x) {
+    if (tabs[x]) {
+      pane.Tabs.push_back(x);
+    }
+  }
+  wchar_t *sets[4] = {g0, g1, g2, g3};
+  for (int i = 0; i < 4; ++i) {
+    pane.Charsets[i] = sets[i] == CSET_UK      ? CHARSET::UK
+                       : sets[i] == CSET_GRAPH ? CHARSET::GRAPH
+                                               : CHARSET::US;
+    if (gs == sets[i]) {
+      pane.Shift = i;
+    }
+  }
+#endif
+  return pane;
+}
+
+#if !defined(_WIN32)
+#if USE_VTERM
+static void putsgr(std::string &out, const CELL &cell) {
+  out += "\033[0";
+  if (cell.Attr & ATTR_BOLD) {
+    out += ";1";
+  }
+  if (cell.Attr & ATTR_ITALIC) {
+    out += ";3";
+  }
+  if (cell.Attr & ATTR_UNDERLINE) {
+    out += ";4";
+  }
+  if (cell.Attr & ATTR_BLINK) {
+    out += ";5";
+  }
+  if (cell.Attr & ATTR_REVERSE) {
+    out += ";7";
+  }
+  if (cell.Fg >= 0) {
+    out += ";38;5;" + std::to_string(cell.Fg);
+  }
+  if (cell.Bg >= 0) {
+    out += ";48;5;" + std::to_string(cell.Bg);
+  }
+  out += 'm';
+}
+#endif
+
+/* The history is mapped as is, the screen is drawn into the emulator. The
+ * modes belonged to the old child and are left at their defaults for the new
+ * one. */
+bool NODE::restore(const Snapshot &snapshot, size_t i) {
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  PANE_SNAPSHOT pane;
+#if USE_VTERM
+  pane.History = &m_history;
+#endif
+  if (!snapshot.Pane(i, &pane)) {
+    return false;
+  }
+#if USE_VTERM
+  std::string out = "\033[H\033[2J";
+  auto rows = std::min(pane.Size.Rows, Size.Rows);
+  auto cols = std::min(pane.Size.Cols, Size.Cols);
+  for (int y = 0; y < rows; ++y) {
+    out += "\033[" + std::to_string(y + 1) + "H";
+    const CELL *last = nullptr;
+    for (int x = 0; x < cols; ++x) {
+      auto &cell = pane.Cells[(size_t)y * pane.Size.Cols + x];
+      if (cell.Width == 0) {
+        continue;
+      }
+      if (cell.Width == 2 && x + 1 >= cols) {
+        // the right half does not fit
+        break;
+      }
+      if (!last || last->Fg != cell.Fg || last->Bg != cell.Bg ||
+          last->Attr != cell.Attr) {
+        putsgr(out, cell);
+        last = &cell;
+      }
+      pututf8(out, cell.Char ? cell.Char : ' ');
+    }
+  }
+  // the new shell prompts below the old screen
+  auto cursor = POS{std::min<int>(pane.Cursor.Y, Size.Rows - 1), 0};
+  out += "\033[0m\033[" + std::to_string(cursor.Y + 1) + "H\r\n";
+  vterm_input_write(m_vterm, out.data(), out.size());
+  publish(this);
+#endif
+  return true;
+}
+#endif
+
+void NODE::queue(const char *b, size_t n) {
+  std::scoped_lock<std::mutex> lock(m_inputMutex);
+  m_input.append(b, n);
+}
+
+void NODE::queuestring(const char *s) { queue(s, strlen(s)); }
+
+void NODE::flush() {
+  std::scoped_lock<std::mutex> lock(m_inputMutex);
+  if (!Process) {
+    // a replay has no child to answer
+    m_input.clear();
+    return;
+  }
+  if (m_input.empty()) {
+    return;
+  }
+  Process->Write(m_input.data(), m_input.size());
+  m_input.clear();
+}
+
+void NODE::beginpaste() {
+#if USE_VTERM
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  vterm_keyboard_start_paste(m_vterm);
+#else
+  if (bpaste) {
+    queuestring("\033[200~");
+  }
+#endif
+}
+
+void NODE::endpaste() {
+#if USE_VTERM
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  vterm_keyboard_end_paste(m_vterm);
+#else
+  if (bpaste) {
+    queuestring("\033[201~");
+  }
+#endif
+}
+
 void NODE::sendarrow(const char *k) {
   char buf[100] = {0};
   snprintf(buf, sizeof(buf) - 1, "\033%s%s", this->pnm ? "O" : "[", k);
-  Process->WriteString(buf);
+  queuestring(buf);
+}
+
+void NODE::sendkey(KEY key) {
+#if USE_VTERM
+  static const VTermKey keys[] = {
+      VTERM_KEY_ENTER, VTERM_KEY_BACKSPACE, VTERM_KEY_TAB,
+      VTERM_KEY_UP,    VTERM_KEY_DOWN,      VTERM_KEY_LEFT,
+      VTERM_KEY_RIGHT, VTERM_KEY_HOME,      VTERM_KEY_END,
+      VTERM_KEY_PAGEUP, VTERM_KEY_PAGEDOWN, VTERM_KEY_INS,
+      VTERM_KEY_DEL,
+  };
+  auto i = (size_t)key;
+  auto vtkey = i < std::size(keys) ? keys[i]
+                                   : (VTermKey)VTERM_KEY_FUNCTION(
+                                         i - (size_t)KEY::F1 + 1);
+  // libvterm knows the modes, its output callback queues the bytes
+  std::scoped_lock<std::mutex> lock(m_mutex);
+  vterm_keyboard_key(m_vterm, vtkey,
+                     key == KEY::BACKTAB ? VTERM_MOD_SHIFT : VTERM_MOD_NONE);
+#else
+  static const char *sequences[] = {
+      nullptr,   "\177",     "\033[Z",   nullptr,     nullptr,
+      nullptr,   nullptr,    "\033[1~",  "\033[4~",   "\033[5~",
+      "\033[6~", "\033[2~",  "\033[3~",  "\033OP",    "\033OQ",
+      "\033OR",  "\033OS",   "\033[15~", "\033[17~",  "\033[18~",
+      "\033[19~", "\033[20~", "\033[21~", "\033[23~", "\033[24~",
+  };
+  switch (key) {
+  case KEY::ENTER:
+    queuestring(lnm ? "\r\n" : "\r");
+    break;
+  case KEY::UP:
+    sendarrow("A");
+    break;
+  case KEY::DOWN:
+    sendarrow("B");
+    break;
+  case KEY::RIGHT:
+    sendarrow("C");
+    break;
+  case KEY::LEFT:
+    sendarrow("D");
+    break;
+  default:
+    if ((size_t)key < std::size(sequences)) {
+      queuestring(sequences[(size_t)key]);
+    }
+    break;
+  }
+#endif
 }
 
 void NODE::reshapeview(int d) {
@@ -81,7 +507,34 @@ void NODE::reshapeview(int d) {
   }
   this->s->Update();
 
-  this->Process->Resize(this->Size);
+#if USE_VTERM
+  {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    vterm_set_size(m_vterm, Size.Rows, Size.Cols);
+    m_grid.Resize(Size);
+    publish(this);
+  }
+#endif
+  if (m_recording) {
+    m_recording->Resize(Size);
+  }
+
+  resizechild();
+}
+
+void NODE::resizechild() {
+  if (m_resizeTimer) {
+    TimerQueue::Instance().Cancel(m_resizeTimer);
+    Metrics::Add(COUNTER::RESIZES_SUPPRESSED);
+  }
+  m_resizeTimer = TimerQueue::Instance().Add(s_resizeDelay, [this]() {
+    m_resizeTimer = 0;
+    if (Process && !(m_childSize == Size)) {
+      m_childSize = Size;
+      Metrics::Add(COUNTER::RESIZES);
+      this->Process->Resize(Size);
+    }
+  });
 }
 
 }
@@ -1,17 +1,58 @@
 #pragma once
+#include "activity.h"
+#include "grid_snapshot.h"
 #include "screen.h"
+#include "scrollback.h"
 #include <memory>
+#include <mutex>
 #include <stdint.h>
+#include <string>
 #include <vector>
 
 #define USE_VTERM 1
 
 struct VTerm;
 struct VTermScreen;
+class PaneLog;
+class Recording;
 
 namespace term_screen {
 
 class Process;
+class Snapshot;
+struct PANE_SNAPSHOT;
+
+// keys whose encoding depends on the modes of the pane
+enum class KEY : uint8_t {
+  ENTER,
+  BACKSPACE,
+  BACKTAB,
+  UP,
+  DOWN,
+  LEFT,
+  RIGHT,
+  HOME,
+  END,
+  PAGEUP,
+  PAGEDOWN,
+  INSERT,
+  DELETE,
+  // F2 to F12 follow
+  F1,
+};
+
+// bytes owned by a pane, some of them estimated
+struct PANE_MEMORY {
+  // the state of libvterm or vtparser, and the published frame
+  size_t Emulator = 0;
+  // the curses pads
+  size_t Screens = 0;
+  size_t Scrollback = 0;
+  // output waiting to be parsed and input waiting for the child
+  size_t Queues = 0;
+
+  size_t Total() const { return Emulator + Screens + Scrollback + Queues; }
+};
 
 struct NODE {
   POS Pos;
@@ -23,6 +64,7 @@ struct NODE {
   bool decom;
   bool am;
   bool lnm;
+  bool bpaste = false;
   std::vector<bool> tabs;
   wchar_t repc;
   std::shared_ptr<SCRN> pri;
@@ -33,17 +75,75 @@ struct NODE {
 #if USE_VTERM
   VTerm *m_vterm;
   VTermScreen *m_vtscreen = nullptr;
+  bool m_cursorVisible = true;
+  bool m_altScreen = false;
+  bool m_reverse = false;
+  // published by the parsing thread after each chunk
+  GridSnapshot m_grid;
+  // last frame copied into the pad, only touched by the renderer
+  std::shared_ptr<const FRAME> m_drawn;
+  // lines scrolling off the top, set before the first parse
+  std::unique_ptr<PaneLog> m_log;
+  // lines scrolled off the top, guarded by m_mutex
+  Scrollback m_history;
 #else
   std::shared_ptr<struct VTPARSER> vp;
 #endif
+  // history lines kept by panes created from now on, SCROLLBACK_LINES
+  // unless -l says otherwise
+  static size_t s_historyLines;
+  // milliseconds, RESIZE_DELAY unless -d says otherwise
+  static int s_resizeDelay;
 
   NODE(const POS &pos, const SIZE &size);
   NODE(const NODE &) = delete;
   NODE &operator=(const NODE &) = delete;
   ~NODE();
 
+  // held while the emulator state is parsed or copied out
+  std::mutex m_mutex;
+
+  // the size the child was last told about. TIOCSWINSZ waits until the
+  // layout has been stable for s_resizeDelay, so a drag is one SIGWINCH.
+  SIZE m_childSize;
+  uint64_t m_resizeTimer = 0;
+
+  // raw output and emulator resizes, fed from the main loop
+  std::unique_ptr<Recording> m_recording;
+
+  // input typed into any pane of the group goes to all of them
+  bool m_broadcast = false;
+
+  // counts the output read from the child
+  Activity m_activity;
+
+  // never reused, names the pane in control mode
+  uint32_t m_id;
+
+  // bytes for the child, written once per event-loop turn by flush()
+  std::mutex m_inputMutex;
+  std::string m_input;
+
+  // emulator
+  void parse(const char *b, size_t n);
+  void blit();
+  // what the pane itself holds, the queues of the main loop not included
+  PANE_MEMORY memory();
+  // the state worth keeping across a restart, call with m_mutex held
+  PANE_SNAPSHOT snapshot();
+  // the screen and history of pane i, before the child is started
+  bool restore(const Snapshot &snapshot, size_t i);
+
   // pty
+  void queue(const char *b, size_t n);
+  void queuestring(const char *s);
+  void flush();
+  void beginpaste();
+  void endpaste();
   void sendarrow(const char *k);
+  // encodes key for the cursor key and newline modes of the pane
+  void sendkey(KEY key);
+  void resizechild();
   // curses
   void reshape(const POS &pos, const SIZE &size);
   void reshapeview(int d);
@@ -0,0 +1,229 @@
+#include "pane_log.h"
+#include "spsc_ring.h"
+#include "utf8.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+// per log, lines that do not fit are dropped
+static const size_t RING_SIZE = 4 * 1024 * 1024;
+// bytes gathered before a write
+static const size_t WRITE_SIZE = 256 * 1024;
+// the writer wakes up this often, and writes whatever it has after a second
+static const auto DRAIN_INTERVAL = std::chrono::milliseconds(50);
+static const auto WRITE_INTERVAL = std::chrono::seconds(1);
+
+struct PaneLogImpl {
+  FILE *m_fp = nullptr;
+  SpscRing m_ring{RING_SIZE};
+  std::atomic<uint64_t> m_lines{0};
+  std::atomic<uint64_t> m_dropped{0};
+  // the writer was woken up and has not drained yet
+  std::atomic<bool> m_woken{false};
+
+  // only touched by the writer
+  std::string m_out;
+  bool m_dirty = false;
+  Clock::time_point m_lastWrite = Clock::now();
+#if HAVE_ZLIB
+  bool m_gzip = false;
+  z_stream m_z = {};
+#endif
+
+  ~PaneLogImpl() {
+#if HAVE_ZLIB
+    if (m_gzip) {
+      deflateEnd(&m_z);
+    }
+#endif
+    if (m_fp) {
+      fclose(m_fp);
+    }
+  }
+
+#if HAVE_ZLIB
+  void Deflate(const char *data, size_t size, int flush) {
+    const size_t CHUNK = 64 * 1024;
+    m_z.next_in = (Bytef *)data;
+    m_z.avail_in = (uInt)size;
+    do {
+      auto used = m_out.size();
+      m_out.resize(used + CHUNK);
+      m_z.next_out = (Bytef *)m_out.data() + used;
+      m_z.avail_out = CHUNK;
+      deflate(&m_z, flush);
+      m_out.resize(used + CHUNK - m_z.avail_out);
+    } while (m_z.avail_out == 0);
+  }
+#endif
+
+  void Append(std::span<const char> data) {
+#if HAVE_ZLIB
+    if (m_gzip) {
+      Deflate(data.data(), data.size(), Z_NO_FLUSH);
+      return;
+    }
+#endif
+    m_out.append(data.data(), data.size());
+  }
+
+  void Drain(bool finish) {
+    m_woken = false;
+    for (auto data = m_ring.Peek(); !data.empty(); data = m_ring.Peek()) {
+      Append(data);
+      m_ring.Consume(data.size());
+      m_dirty = true;
+    }
+
+    auto now = Clock::now();
+    bool late = m_dirty && now - m_lastWrite >= WRITE_INTERVAL;
+#if HAVE_ZLIB
+    if (m_gzip && (finish || late)) {
+      // a sync flush makes what was logged so far readable with zcat
+      Deflate(nullptr, 0, finish ? Z_FINISH : Z_SYNC_FLUSH);
+    }
+#endif
+    if (m_out.size() >= WRITE_SIZE || finish || late) {
+      fwrite(m_out.data(), 1, m_out.size(), m_fp);
+      m_out.clear();
+      m_dirty = false;
+      m_lastWrite = now;
+    }
+  }
+};
+
+/* The thread that drains every log. */
+class LogWriter {
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::vector<PaneLogImpl *> m_logs;
+  bool m_stop = false;
+  std::thread m_thread;
+
+  LogWriter() : m_thread([this]() { Run(); }) {}
+
+  void Run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop) {
+      m_wake.wait_for(lock, DRAIN_INTERVAL);
+      for (auto log : m_logs) {
+        log->Drain(false);
+      }
+    }
+  }
+
+public:
+  ~LogWriter() {
+    {
+      std::scoped_lock<std::mutex> lock(m_mutex);
+      m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+  }
+
+  static LogWriter &Instance() {
+    static LogWriter s_instance;
+    return s_instance;
+  }
+
+  // a ring filled up before the next interval
+  void Wake() { m_wake.notify_one(); }
+
+  void Add(PaneLogImpl *log) {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    m_logs.push_back(log);
+  }
+
+  void Remove(PaneLogImpl *log) {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    std::erase(m_logs, log);
+    log->Drain(true);
+  }
+};
+
+PaneLog::PaneLog() : m_impl(new PaneLogImpl) {}
+
+PaneLog::~PaneLog() {
+  LogWriter::Instance().Remove(m_impl);
+  delete m_impl;
+}
+
+std::unique_ptr<PaneLog> PaneLog::Open(const char *path) {
+  auto fp = fopen(path, "wb");
+  if (!fp) {
+    return {};
+  }
+  // the writer already batches
+  setvbuf(fp, nullptr, _IONBF, 0);
+
+  auto ptr = std::unique_ptr<PaneLog>(new PaneLog);
+  ptr->m_impl->m_fp = fp;
+#if HAVE_ZLIB
+  auto len = strlen(path);
+  if (len > 3 && !strcmp(path + len - 3, ".gz")) {
+    // 16 asks for a gzip header
+    ptr->m_impl->m_gzip =
+        deflateInit2(&ptr->m_impl->m_z, Z_BEST_SPEED, Z_DEFLATED,
+                     15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+  }
+#endif
+  LogWriter::Instance().Add(ptr->m_impl);
+  return ptr;
+}
+
+void PaneLog::Push(int cols, const VTermScreenCell *cells) {
+  thread_local std::string line;
+  // room for every character of every cell and the newline
+  line.resize(cols * VTERM_MAX_CHARS_PER_CELL * 4 + 1);
+  auto begin = line.data();
+  auto p = begin;
+  auto end = begin;
+  for (int i = 0; i < cols; ++i) {
+    auto c = cells[i].chars[0];
+    if (c == (uint32_t)-1) {
+      // the right half of a wide character
+      continue;
+    }
+    if (c <= ' ') {
+      *p++ = ' ';
+      continue;
+    }
+    if (c < 0x80) {
+      *p++ = (char)c;
+    } else {
+      for (int j = 0; j < VTERM_MAX_CHARS_PER_CELL && cells[i].chars[j];
+           ++j) {
+        p += encodeutf8(cells[i].chars[j], p);
+      }
+    }
+    end = p;
+  }
+  *end++ = '\n';
+  std::span<const char> data(begin, end);
+
+  auto &ring = m_impl->m_ring;
+  if (ring.Free() < data.size()) {
+    ++m_impl->m_dropped;
+    return;
+  }
+  ring.Write(data);
+  ++m_impl->m_lines;
+  if (ring.Free() < ring.Capacity() / 2 && !m_impl->m_woken.exchange(true)) {
+    LogWriter::Instance().Wake();
+  }
+}
+
+uint64_t PaneLog::Lines() const { return m_impl->m_lines; }
+uint64_t PaneLog::Dropped() const { return m_impl->m_dropped; }
@@ -0,0 +1,34 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <vterm.h>
+
+// Writes the rendered text of the lines that scroll off a pane to a file.
+//
+// The emulator thread encodes a line into a lock-free ring and never waits.
+// A single writer thread shared by every log drains the rings, optionally
+// gzips, and writes in large sequential chunks. A line that does not fit
+// into a full ring is dropped and counted.
+class PaneLog {
+
+  struct PaneLogImpl *m_impl = nullptr;
+
+  PaneLog();
+
+public:
+  PaneLog(const PaneLog &) = delete;
+  PaneLog &operator=(const PaneLog &) = delete;
+  // writes everything that is still queued
+  ~PaneLog();
+
+  // a path ending in .gz is compressed when built with zlib.
+  // nullptr if the file could not be created.
+  static std::unique_ptr<PaneLog> Open(const char *path);
+
+  // emulator thread, one line without its trailing blanks
+  void Push(int cols, const VTermScreenCell *cells);
+
+  uint64_t Lines() const;
+  uint64_t Dropped() const;
+};
@@ -0,0 +1,184 @@
+#include "parse_pool.h"
+#include "config.h"
+#include "metrics.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct ParseJob {
+  void *Key = nullptr;
+  ParsePool::ParseFunc Parse;
+  // appended by Submit, swapped into Working by the worker
+  std::vector<char> Pending;
+  std::vector<char> Working;
+  // in the ready queue or being parsed
+  bool Queued = false;
+};
+
+struct ParsePoolImpl {
+  std::mutex m_mutex;
+  std::condition_variable m_ready_cv;
+  std::condition_variable m_idle_cv;
+  std::unordered_map<void *, std::unique_ptr<ParseJob>> m_jobs;
+  std::deque<ParseJob *> m_ready;
+  size_t m_queued = 0;
+  bool m_quit = false;
+  std::function<void(void *)> m_notify;
+  std::vector<std::thread> m_threads;
+
+  ParsePoolImpl(size_t threads) {
+    for (size_t i = 0; i < threads; ++i) {
+      m_threads.emplace_back([this]() { Worker(); });
+    }
+  }
+
+  ~ParsePoolImpl() {
+    {
+      std::scoped_lock<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_ready_cv.notify_all();
+    for (auto &t : m_threads) {
+      t.join();
+    }
+  }
+
+  static void Parse(ParseJob &job, std::span<const char> data) {
+    Metrics::Timer timer(HISTOGRAM::PARSE);
+    Metrics::Add(COUNTER::PARSED_BYTES, data.size());
+    job.Parse(data.data(), data.size());
+  }
+
+  void Worker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+      m_ready_cv.wait(lock, [this]() { return m_quit || !m_ready.empty(); });
+      if (m_quit) {
+        return;
+      }
+      auto job = m_ready.front();
+      m_ready.pop_front();
+      bool full = job->Pending.size() >= PARSE_BACKLOG;
+      job->Working.swap(job->Pending);
+
+      lock.unlock();
+      if (full && m_notify) {
+        // the loop reads the key again while this batch is parsed
+        m_notify(job->Key);
+      }
+      Parse(*job, job->Working);
+      job->Working.clear();
+      if (m_notify) {
+        m_notify(job->Key);
+      }
+      lock.lock();
+
+      if (!job->Pending.empty()) {
+        // more bytes arrived while parsing, keep the order by requeueing
+        m_ready.push_back(job);
+        m_ready_cv.notify_one();
+      } else {
+        job->Queued = false;
+        Metrics::Set(GAUGE::PARSE_QUEUE, --m_queued);
+        // Unregister waits for this job, Drain for all of them
+        m_idle_cv.notify_all();
+      }
+    }
+  }
+
+  void Register(void *key, const ParsePool::ParseFunc &parse) {
+    auto job = std::make_unique<ParseJob>();
+    job->Key = key;
+    job->Parse = parse;
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    m_jobs[key] = std::move(job);
+  }
+
+  void Unregister(void *key) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto found = m_jobs.find(key);
+    if (found == m_jobs.end()) {
+      return;
+    }
+    auto job = found->second.get();
+    m_idle_cv.wait(lock, [job]() { return !job->Queued; });
+    m_jobs.erase(found);
+  }
+
+  void Submit(void *key, std::span<const char> data) {
+    if (data.empty()) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto found = m_jobs.find(key);
+    if (found == m_jobs.end()) {
+      return;
+    }
+    auto job = found->second.get();
+
+    if (m_threads.empty()) {
+      lock.unlock();
+      Parse(*job, data);
+      if (m_notify) {
+        m_notify(key);
+      }
+      return;
+    }
+
+    job->Pending.insert(job->Pending.end(), data.begin(), data.end());
+    if (!job->Queued) {
+      job->Queued = true;
+      Metrics::Set(GAUGE::PARSE_QUEUE, ++m_queued);
+      m_ready.push_back(job);
+      m_ready_cv.notify_one();
+    }
+  }
+
+  bool Full(void *key) {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    auto found = m_jobs.find(key);
+    return found != m_jobs.end() &&
+           found->second->Pending.size() >= PARSE_BACKLOG;
+  }
+
+  void Drain() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock, [this]() { return m_queued == 0; });
+  }
+
+  size_t Bytes(void *key) {
+    std::scoped_lock<std::mutex> lock(m_mutex);
+    auto found = m_jobs.find(key);
+    if (found == m_jobs.end()) {
+      return 0;
+    }
+    auto job = found->second.get();
+    return sizeof(ParseJob) + job->Pending.capacity() +
+           job->Working.capacity();
+  }
+};
+
+ParsePool::ParsePool(size_t threads) : m_impl(new ParsePoolImpl(threads)) {}
+ParsePool::~ParsePool() { delete m_impl; }
+
+size_t ParsePool::Threads() const { return m_impl->m_threads.size(); }
+
+void ParsePool::OnParsed(const std::function<void(void *)> &notify) {
+  std::scoped_lock<std::mutex> lock(m_impl->m_mutex);
+  m_impl->m_notify = notify;
+}
+
+void ParsePool::Register(void *key, const ParseFunc &parse) {
+  m_impl->Register(key, parse);
+}
+void ParsePool::Unregister(void *key) { m_impl->Unregister(key); }
+void ParsePool::Submit(void *key, std::span<const char> data) {
+  m_impl->Submit(key, data);
+}
+bool ParsePool::Full(void *key) { return m_impl->Full(key); }
+void ParsePool::Drain() { m_impl->Drain(); }
+size_t ParsePool::Bytes(void *key) { return m_impl->Bytes(key); }
@@ -0,0 +1,39 @@
+#pragma once
+#include <functional>
+#include <span>
+#include <stddef.h>
+
+// Parses pane output on a pool of worker threads.
+//
+// Every registered key (a pane) owns its own emulator, so different keys are
+// parsed concurrently while bytes of one key are always parsed in order by a
+// single worker at a time. With zero threads Submit parses inline.
+class ParsePool {
+
+  struct ParsePoolImpl *m_impl = nullptr;
+
+public:
+  using ParseFunc = std::function<void(const char *, size_t)>;
+
+  explicit ParsePool(size_t threads);
+  ParsePool(const ParsePool &) = delete;
+  ParsePool &operator=(const ParsePool &) = delete;
+  ~ParsePool();
+
+  size_t Threads() const;
+
+  // notify is called from a worker after a batch of a key has been parsed,
+  // and when it takes the bytes of a key that was Full.
+  void OnParsed(const std::function<void(void *)> &notify);
+
+  void Register(void *key, const ParseFunc &parse);
+  // waits for pending bytes of key to be parsed
+  void Unregister(void *key);
+  void Submit(void *key, std::span<const char> data);
+  // PARSE_BACKLOG bytes of key wait for a worker, hold back until notified
+  bool Full(void *key);
+  // waits until every submitted byte has been parsed
+  void Drain();
+  // the buffers of key for bytes on their way to a worker
+  size_t Bytes(void *key);
+};
@@ -0,0 +1,46 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdint.h>
+
+// Copies the raw output of a pane into the stdin of a command.
+//
+// Where the kernel allows it the pty is spliced into a pipe and duplicated
+// for the command with tee, so those bytes never pass through user space.
+// Otherwise, and whenever the command falls behind, the bytes go through a
+// bounded buffer. What does not fit is dropped and counted, the pane never
+// waits for the command.
+class PipePane {
+
+  struct PipePaneImpl *m_impl = nullptr;
+
+  PipePane();
+
+public:
+  PipePane(const PipePane &) = delete;
+  PipePane &operator=(const PipePane &) = delete;
+  ~PipePane();
+
+  // runs command with /bin/sh, nullptr if it could not be started
+  static std::unique_ptr<PipePane> Open(const char *command);
+
+  // false if the pty can not be spliced, use Copy then
+  bool CanSplice() const;
+  // reads the pending output of a readable pty and tees it to the command.
+  // nullopt on error or end of file, an empty span if nothing is pending.
+  std::optional<std::span<char>> Splice(int fd);
+  // output that was read without Splice
+  void Copy(std::span<const char> data);
+  // retries buffered bytes
+  void Flush();
+
+  // bytes accepted by the command, and those it missed, also counted in
+  // Metrics
+  uint64_t Piped() const;
+  uint64_t Dropped() const;
+  // buffered for the command, dropped when the pipe is stopped
+  size_t Pending() const;
+  // the command exited or closed its input
+  bool Closed() const;
+};
@@ -0,0 +1,232 @@
+#include "control.h"
+#include "layout.h"
+#include "node.h"
+#include "selector.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <optional>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+namespace term_screen {
+
+// read from the client at most this much per turn
+static const size_t READ_SIZE = 64 * 1024;
+// output a client may fall behind by before it is disconnected
+static const size_t BACKLOG = 16 * 1024 * 1024;
+
+struct ControlImpl {
+  // empty for stdin and stdout
+  std::string m_path;
+  int m_listen = -1;
+  int m_in = -1;
+  int m_out = -1;
+  bool m_closed = false;
+
+  std::string m_received;
+  std::string m_queued;
+  // the OUTPUT message of this turn, while panes are appended to it
+  std::optional<MessageWriter> m_output;
+  std::string m_layout;
+  std::string m_encoded;
+
+  ~ControlImpl() {
+    if (m_out >= 0) {
+      m_output.reset();
+      MessageWriter w(m_queued, MSG::BYE);
+      w.Put(BYE::EXITED);
+    }
+    Write();
+    // what the client takes right away, the rest is dropped
+    Selector::Instance().Flush();
+    Disconnect();
+    if (m_listen >= 0) {
+      Selector::Instance().Unwatch(m_listen);
+      unlink(m_path.c_str());
+      close(m_listen);
+    }
+  }
+
+  void Disconnect() {
+    m_output.reset();
+    m_queued.clear();
+    m_received.clear();
+    m_layout.clear();
+    if (m_in < 0) {
+      return;
+    }
+    Selector::Instance().Discard(m_out);
+    Selector::Instance().Unwatch(m_in);
+    if (m_path.empty()) {
+      // stdin and stdout stay open, mtm ends
+      m_closed = true;
+    } else {
+      close(m_in);
+    }
+    m_in = m_out = -1;
+  }
+
+  // handed to the selector, which sends what the client does not take yet
+  // once it reads again; a client too far behind is dropped
+  void Write() {
+    m_output.reset();
+    if (m_out >= 0 && !m_queued.empty()) {
+      auto &selector = Selector::Instance();
+      selector.Write(m_out, m_queued);
+      if (selector.Pending(m_out) > BACKLOG) {
+        Disconnect();
+      }
+    }
+    m_queued.clear();
+  }
+
+  void Accept() {
+    int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    // the last client to connect drives mtm
+    Disconnect();
+    m_in = m_out = fd;
+    Selector::Instance().Watch(fd);
+  }
+
+  void Receive(const std::function<void(std::string &&line)> &onCommand) {
+    auto old = m_received.size();
+    m_received.resize(old + READ_SIZE);
+    auto r = read(m_in, m_received.data() + old, READ_SIZE);
+    m_received.resize(old + std::max<ssize_t>(r, 0));
+    if (r == 0 || (r < 0 && errno != EINTR && errno != EAGAIN)) {
+      Disconnect();
+      return;
+    }
+    size_t used = 0;
+    MSG type;
+    std::span<const char> body;
+    while (auto n =
+               NextMessage(std::span(m_received).subspan(used), &type, &body)) {
+      used += n;
+      if (type == MSG::COMMAND) {
+        onCommand(std::string(body.data(), body.size()));
+      }
+      if (m_in < 0) {
+        // the command ended the connection
+        return;
+      }
+    }
+    m_received.erase(0, used);
+  }
+};
+
+Control::Control() : m_impl(new ControlImpl) {}
+
+Control::~Control() { delete m_impl; }
+
+std::unique_ptr<Control> Control::Open(const char *path) {
+  auto ptr = std::unique_ptr<Control>(new Control);
+  auto &impl = *ptr->m_impl;
+  if (!strcmp(path, "-")) {
+    impl.m_in = STDIN_FILENO;
+    impl.m_out = STDOUT_FILENO;
+    // written by the selector, which never waits for a full pipe
+    fcntl(STDOUT_FILENO, F_SETFL, fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
+    // a second Watch of stdin, if InputStream has one, does no harm
+    Selector::Instance().Watch(STDIN_FILENO);
+    return ptr;
+  }
+
+  struct sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return {};
+  }
+  strcpy(addr.sun_path, path);
+  // a running mtm keeps its socket, a file is never removed
+  if (!ClaimSocket(path)) {
+    return {};
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return {};
+  }
+  // only the owner may connect
+  auto mask = umask(0077);
+  bool bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound || listen(fd, 4) != 0) {
+    close(fd);
+    return {};
+  }
+  impl.m_path = path;
+  impl.m_listen = fd;
+  Selector::Instance().Watch(fd);
+  return ptr;
+}
+
+void Control::Dispatch(
+    const std::function<void(std::string &&line)> &onCommand) {
+  auto &selector = Selector::Instance();
+  if (m_impl->m_in >= 0 && selector.Ready(m_impl->m_in)) {
+    m_impl->Receive(onCommand);
+  }
+  if (m_impl->m_listen >= 0 && selector.Ready(m_impl->m_listen)) {
+    m_impl->Accept();
+  }
+}
+
+bool Control::Closed() const { return m_impl->m_closed; }
+
+void Control::Output(uint32_t id, std::span<const char> data) {
+  auto &impl = *m_impl;
+  if (impl.m_out < 0 || data.empty()) {
+    return;
+  }
+  if (!impl.m_output) {
+    impl.m_output.emplace(impl.m_queued, MSG::OUTPUT);
+  }
+  impl.m_output->Put(id);
+  impl.m_output->Put((uint32_t)data.size());
+  impl.m_queued.append(data.data(), data.size());
+}
+
+void Control::Reply(const std::string &text) {
+  auto &impl = *m_impl;
+  if (impl.m_out < 0) {
+    return;
+  }
+  impl.m_output.reset();
+  MessageWriter w(impl.m_queued, MSG::REPLY);
+  impl.m_queued += text;
+}
+
+void Control::Send(const Layout &layout) {
+  auto &impl = *m_impl;
+  if (impl.m_out < 0) {
+    return;
+  }
+  std::vector<PANE_INFO> panes;
+  auto focused = layout.Focused();
+  for (auto &node : layout.Panes()) {
+    panes.push_back({node->m_id, node->Pos, node->Size});
+  }
+  impl.m_encoded.clear();
+  EncodeLayout(impl.m_encoded, panes, focused ? focused->m_id : 0,
+               layout.Borders());
+  if (impl.m_encoded != impl.m_layout) {
+    impl.m_output.reset();
+    impl.m_queued += impl.m_encoded;
+    impl.m_layout.swap(impl.m_encoded);
+  }
+}
+
+void Control::Flush() { m_impl->Write(); }
+
+size_t Control::Backlog() const {
+  return m_impl->m_out < 0 ? 0 : Selector::Instance().Pending(m_impl->m_out);
+}
+
+} // namespace term_screen
@@ -0,0 +1,268 @@
+#include "events.h"
+#include "selector.h"
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#if !defined(SYS_pidfd_open)
+#define SYS_pidfd_open 434
+#endif
+#endif
+
+struct CHILD {
+  int Pid = -1;
+  // pidfd, -1 when exits are noticed through SIGCHLD
+  int Fd = -1;
+  std::function<void(int)> OnExit;
+};
+
+static int g_pipe[2] = {-1, -1};
+
+/* fallback when signalfd is missing */
+static void onsignal(int sig) {
+  int saved = errno;
+  char c = (char)sig;
+  (void)!write(g_pipe[1], &c, 1);
+  errno = saved;
+}
+
+struct EventsImpl {
+  // signalfd, or the read end of the self-pipe
+  int m_signal = -1;
+  bool m_signalfd = false;
+  bool m_resized = false;
+  bool m_terminated = false;
+  bool m_dump = false;
+  std::vector<CHILD> m_children;
+  // the same eventfd twice, or the ends of a pipe
+  int m_wake[2] = {-1, -1};
+  // set until the loop has seen the wake, so a burst writes once
+  std::atomic<bool> m_woken = false;
+
+  EventsImpl() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGWINCH);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGHUP);
+    sigaddset(&mask, SIGUSR1);
+#if defined(__linux__)
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    m_signal = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    m_signalfd = m_signal >= 0;
+    if (!m_signalfd) {
+      sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+    }
+#endif
+    if (!m_signalfd && pipe(g_pipe) == 0) {
+      for (auto fd : g_pipe) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+      struct sigaction sa = {};
+      sa.sa_handler = onsignal;
+      sa.sa_flags = SA_RESTART;
+      sigaction(SIGWINCH, &sa, nullptr);
+      sigaction(SIGCHLD, &sa, nullptr);
+      sigaction(SIGTERM, &sa, nullptr);
+      sigaction(SIGHUP, &sa, nullptr);
+      sigaction(SIGUSR1, &sa, nullptr);
+      m_signal = g_pipe[0];
+    }
+    if (m_signal >= 0) {
+      Selector::Instance().Watch(m_signal);
+    }
+#if defined(__linux__)
+    m_wake[0] = m_wake[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+    if (m_wake[0] < 0 && pipe(m_wake) == 0) {
+      for (auto fd : m_wake) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+    }
+    if (m_wake[0] >= 0) {
+      Selector::Instance().Watch(m_wake[0]);
+    }
+    // a pipe-pane command may exit while we write to it
+    signal(SIGPIPE, SIG_IGN);
+  }
+
+  ~EventsImpl() {
+    for (auto &child : m_children) {
+      if (child.Fd >= 0) {
+        close(child.Fd);
+      }
+    }
+    close(m_signal);
+    if (m_wake[1] != m_wake[0]) {
+      close(m_wake[1]);
+    }
+    close(m_wake[0]);
+  }
+
+  void Wake() {
+    if (m_wake[1] < 0 || m_woken.exchange(true)) {
+      return;
+    }
+    uint64_t one = 1;
+    (void)!write(m_wake[1], &one, m_wake[1] == m_wake[0] ? sizeof(one) : 1);
+  }
+
+  void Handle(int sig, bool *sigchld) {
+    m_resized |= sig == SIGWINCH;
+    *sigchld |= sig == SIGCHLD;
+    m_terminated |= sig == SIGTERM || sig == SIGHUP;
+    m_dump |= sig == SIGUSR1;
+  }
+
+  void ReadSignals(bool *sigchld) {
+    if (m_signalfd) {
+#if defined(__linux__)
+      struct signalfd_siginfo info[16];
+      ssize_t r;
+      while ((r = read(m_signal, info, sizeof(info))) > 0) {
+        for (size_t i = 0; i < r / sizeof(info[0]); ++i) {
+          Handle(info[i].ssi_signo, sigchld);
+        }
+      }
+#endif
+    } else {
+      char sigs[64];
+      ssize_t r;
+      while ((r = read(m_signal, sigs, sizeof(sigs))) > 0) {
+        for (ssize_t i = 0; i < r; ++i) {
+          Handle(sigs[i], sigchld);
+        }
+      }
+    }
+  }
+
+  // returns false while the child is running
+  bool Reap(CHILD &child) {
+    int status = 0;
+    if (waitpid(child.Pid, &status, WNOHANG) != child.Pid) {
+      return false;
+    }
+    if (child.Fd >= 0) {
+      Selector::Instance().Unwatch(child.Fd);
+      close(child.Fd);
+    }
+    if (child.OnExit) {
+      child.OnExit(status);
+    }
+    return true;
+  }
+
+  void Dispatch() {
+    auto &selector = Selector::Instance();
+    bool sigchld = false;
+    if (m_signal >= 0 && selector.Ready(m_signal)) {
+      ReadSignals(&sigchld);
+    }
+    if (m_wake[0] >= 0 && selector.Ready(m_wake[0])) {
+      uint64_t buf[8];
+      while (read(m_wake[0], buf, sizeof(buf)) > 0) {
+      }
+      // cleared after reading: a wake skipped in between was for a parse
+      // that finished before this, and the loop draws it in this turn
+      m_woken = false;
+    }
+    std::erase_if(m_children, [&](CHILD &child) {
+      if (child.Fd >= 0 ? selector.Ready(child.Fd) : sigchld) {
+        return Reap(child);
+      }
+      return false;
+    });
+  }
+
+  void Watch(int pid, const std::function<void(int)> &onexit) {
+    CHILD child{
+        .Pid = pid,
+        .OnExit = onexit,
+    };
+#if defined(__linux__)
+    child.Fd = (int)syscall(SYS_pidfd_open, pid, 0);
+    if (child.Fd >= 0) {
+      fcntl(child.Fd, F_SETFD, FD_CLOEXEC);
+      Selector::Instance().Watch(child.Fd);
+    }
+#endif
+    m_children.push_back(child);
+    // it may have exited before the pidfd was opened
+    if (Reap(m_children.back())) {
+      m_children.pop_back();
+    }
+  }
+
+  void Unwatch(int pid) {
+    for (auto &child : m_children) {
+      if (child.Pid == pid) {
+        child.OnExit = {};
+      }
+    }
+  }
+};
+
+Events::Events() : m_impl(new EventsImpl) {}
+Events::~Events() { delete m_impl; }
+
+void Events::ResetChild() {
+  sigset_t none;
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, nullptr);
+  signal(SIGWINCH, SIG_DFL);
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  signal(SIGHUP, SIG_DFL);
+  signal(SIGUSR1, SIG_DFL);
+  signal(SIGPIPE, SIG_DFL);
+}
+
+void Events::ResetSpawn(posix_spawnattr_t *attr) {
+  sigset_t none, defaults;
+  sigemptyset(&none);
+  sigemptyset(&defaults);
+  for (auto sig :
+       {SIGWINCH, SIGCHLD, SIGTERM, SIGHUP, SIGUSR1, SIGPIPE}) {
+    sigaddset(&defaults, sig);
+  }
+  posix_spawnattr_setsigmask(attr, &none);
+  posix_spawnattr_setsigdefault(attr, &defaults);
+  short flags = 0;
+  posix_spawnattr_getflags(attr, &flags);
+  flags |= POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  posix_spawnattr_setflags(attr, flags);
+}
+
+void Events::Dispatch() { m_impl->Dispatch(); }
+
+bool Events::Resized() {
+  auto resized = m_impl->m_resized;
+  m_impl->m_resized = false;
+  return resized;
+}
+
+bool Events::Terminated() const { return m_impl->m_terminated; }
+
+bool Events::DumpRequested() {
+  auto dump = m_impl->m_dump;
+  m_impl->m_dump = false;
+  return dump;
+}
+
+void Events::Wake() { m_impl->Wake(); }
+
+void Events::WatchChild(int pid, const std::function<void(int)> &onexit) {
+  m_impl->Watch(pid, onexit);
+}
+
+void Events::UnwatchChild(int pid) { m_impl->Unwatch(pid); }
@@ -0,0 +1,185 @@
+#include "pipe_pane.h"
+#include "config.h"
+#include "events.h"
+#include "metrics.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+
+static char g_iobuf[BUFSIZ];
+
+struct PipePaneImpl {
+  // the command's stdin
+  int m_out = -1;
+  // pty output is spliced into here and teed to m_out
+  int m_tap[2] = {-1, -1};
+  bool m_splice = false;
+  // bytes the command has not taken yet, never more than PIPE_PANE_BUFFER
+  std::string m_pending;
+  uint64_t m_piped = 0;
+  uint64_t m_dropped = 0;
+
+  ~PipePaneImpl() {
+    Dropped(m_pending.size());
+    close(m_out);
+    close(m_tap[0]);
+    close(m_tap[1]);
+  }
+
+  bool Closed() const { return m_out < 0; }
+
+  void Piped(size_t n) {
+    m_piped += n;
+    Metrics::Add(COUNTER::PIPED_BYTES, n);
+  }
+
+  void Dropped(size_t n) {
+    m_dropped += n;
+    Metrics::Add(COUNTER::PIPE_DROPPED, n);
+  }
+
+  // returns the number of bytes the command took
+  size_t Send(const char *data, size_t size) {
+    if (Closed()) {
+      return 0;
+    }
+    auto w = write(m_out, data, size);
+    if (w < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        // EPIPE, the command is gone
+        close(m_out);
+        m_out = -1;
+      }
+      return 0;
+    }
+    Piped(w);
+    return w;
+  }
+
+  void Buffer(const char *data, size_t size) {
+    if (Closed()) {
+      Dropped(size);
+      return;
+    }
+    auto room = PIPE_PANE_BUFFER - std::min<size_t>(m_pending.size(),
+                                                    PIPE_PANE_BUFFER);
+    auto n = std::min(size, room);
+    m_pending.append(data, n);
+    Dropped(size - n);
+  }
+
+  void Flush() {
+    if (!m_pending.empty()) {
+      m_pending.erase(0, Send(m_pending.data(), m_pending.size()));
+    }
+  }
+
+  void Copy(const char *data, size_t size) {
+    Flush();
+    size_t sent = 0;
+    if (m_pending.empty()) {
+      sent = Send(data, size);
+    }
+    Buffer(data + sent, size - sent);
+  }
+
+  std::optional<std::span<char>> Splice(int fd) {
+#if defined(__linux__)
+    Flush();
+    auto n = splice(fd, nullptr, m_tap[1], nullptr, sizeof(g_iobuf),
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+      return std::span<char>{};
+    }
+    if (n < 0 && errno == EINVAL) {
+      // this pty does not support splice, read it instead from now on
+      m_splice = false;
+      return std::span<char>{};
+    }
+    if (n <= 0) {
+      return std::nullopt;
+    }
+
+    ssize_t teed = 0;
+    if (m_pending.empty() && !Closed()) {
+      // duplicates the bytes in the kernel, they stay in the tap for us
+      teed = tee(m_tap[0], m_out, n, SPLICE_F_NONBLOCK);
+      if (teed < 0) {
+        if (errno != EAGAIN) {
+          close(m_out);
+          m_out = -1;
+        }
+        teed = 0;
+      }
+      Piped(teed);
+    }
+
+    // the tap was empty, so this returns all n bytes
+    auto r = read(m_tap[0], g_iobuf, n);
+    if (r != n) {
+      return std::nullopt;
+    }
+    Buffer(g_iobuf + teed, n - teed);
+    return std::span<char>(g_iobuf, n);
+#else
+    return std::nullopt;
+#endif
+  }
+};
+
+PipePane::PipePane() : m_impl(new PipePaneImpl) {}
+PipePane::~PipePane() { delete m_impl; }
+
+std::unique_ptr<PipePane> PipePane::Open(const char *command) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return {};
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return {};
+  } else if (pid == 0) {
+    Events::ResetChild();
+    dup2(fds[0], STDIN_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execl("/bin/sh", "sh", "-c", command, nullptr);
+    _exit(127);
+  }
+  close(fds[0]);
+  // only reaped
+  Events::Instance().WatchChild(pid, {});
+
+  auto ptr = std::unique_ptr<PipePane>(new PipePane);
+  auto impl = ptr->m_impl;
+  impl->m_out = fds[1];
+  fcntl(impl->m_out, F_SETFL, O_NONBLOCK);
+  fcntl(impl->m_out, F_SETFD, FD_CLOEXEC);
+#if defined(__linux__)
+  impl->m_splice = pipe2(impl->m_tap, O_NONBLOCK | O_CLOEXEC) == 0;
+#endif
+  return ptr;
+}
+
+bool PipePane::CanSplice() const { return m_impl->m_splice; }
+
+std::optional<std::span<char>> PipePane::Splice(int fd) {
+  return m_impl->Splice(fd);
+}
+
+void PipePane::Copy(std::span<const char> data) {
+  m_impl->Copy(data.data(), data.size());
+}
+
+void PipePane::Flush() { m_impl->Flush(); }
+
+uint64_t PipePane::Piped() const { return m_impl->m_piped; }
+uint64_t PipePane::Dropped() const { return m_impl->m_dropped; }
+size_t PipePane::Pending() const { return m_impl->m_pending.size(); }
+bool PipePane::Closed() const { return m_impl->Closed(); }
@@ -1,10 +1,20 @@
-#include "input_stream.h"
 #include "child_process.h"
+#include "events.h"
+#include "input_stream.h"
+#include "selector.h"
 #include <curses.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <optional>
 #include <pty.h>
 #include <pwd.h>
 #include <signal.h>
+#include <spawn.h>
 #include <string.h>
+#include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <vector>
 
 #define DEFAULT_TERMINAL "screen-bce"
 #define DEFAULT_256_COLOR_TERMINAL "screen-256color-bce"
@@ -13,28 +23,78 @@ namespace term_screen {
 
 struct ProcessImpl {
   int m_pty = -1;
+  pid_t m_pid = -1;
+  std::optional<int> m_status;
 
   ~ProcessImpl() {
-    Selector::Instance().Unregister(m_pty);
+    Events::Instance().UnwatchChild(m_pid);
+    InputStream::Instance().Unregister((void *)(intptr_t)m_pty);
     close(m_pty);
   }
 
   void Write(const char *b, size_t n) {
-    size_t w = 0;
-    while (w < n) {
-      ssize_t s = ::write(m_pty, b + w, n - w);
-      if (s < 0 && errno != EINTR)
-        return;
-      else if (s < 0)
-        s = 0;
-      w += (size_t)s;
-    }
+    Selector::Instance().Write(m_pty, {b, n});
   }
 };
 
+#if defined(__linux__) && defined(POSIX_SPAWN_SETSID)
+/* Start shell on a new pty, -1 on failure. The child becomes a session
+ * leader before it opens the pty, which makes it its controlling terminal. */
+static pid_t spawn(int *master, const struct winsize &ws, const char *term,
+                   const char *shell) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+  char slave[PATH_MAX];
+  if (fd < 0 || grantpt(fd) || unlockpt(fd) ||
+      ptsname_r(fd, slave, sizeof(slave)) || ioctl(fd, TIOCSWINSZ, &ws)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return -1;
+  }
+
+  /* the environment of mtm with MTM and TERM replaced */
+  std::vector<std::string> vars;
+  vars.push_back("MTM=" + std::to_string(getpid()));
+  vars.push_back(std::string("TERM=") + term);
+  for (char **e = environ; *e; ++e) {
+    if (strncmp(*e, "MTM=", 4) && strncmp(*e, "TERM=", 5)) {
+      vars.push_back(*e);
+    }
+  }
+  std::vector<char *> envp;
+  for (auto &var : vars) {
+    envp.push_back(var.data());
+  }
+  envp.push_back(nullptr);
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, slave, O_RDWR, 0);
+  posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDOUT_FILENO);
+  posix_spawn_file_actions_adddup2(&actions, STDIN_FILENO, STDERR_FILENO);
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+  Events::ResetSpawn(&attr);
+
+  pid_t pid;
+  char *argv[] = {(char *)shell, nullptr};
+  int err = posix_spawn(&pid, shell, &actions, &attr, argv, envp.data());
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&actions);
+  if (err) {
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  *master = fd;
+  return pid;
+}
+#endif
+
 Process::Process() : m_impl(new ProcessImpl) {}
 
-Process::~Process() {}
+Process::~Process() { delete m_impl; }
 
 std::shared_ptr<Process> Process::Fork(const SIZE &size, const char *term,
                                        const char *shell) {
@@ -51,6 +111,14 @@ std::shared_ptr<Process> Process::Fork(const SIZE &size, const char *term,
       .ws_row = size.Rows,
       .ws_col = size.Cols,
   };
+#if defined(__linux__) && defined(POSIX_SPAWN_SETSID)
+  /* posix_spawn does not copy the page tables of a large mtm like fork */
+  pid_t pid = spawn(&ptr->m_impl->m_pty, ws, term, shell);
+  if (pid < 0) {
+    perror("posix_spawn");
+    return {};
+  }
+#else
   pid_t pid = forkpty(&ptr->m_impl->m_pty, NULL, NULL, &ws);
   if (pid < 0) {
     perror("forkpty");
@@ -61,16 +129,20 @@ std::shared_ptr<Process> Process::Fork(const SIZE &size, const char *term,
     setsid();
     setenv("MTM", buf, 1);
     setenv("TERM", term, 1);
-    signal(SIGCHLD, SIG_DFL);
+    Events::ResetChild();
     execl(shell, shell, NULL);
     return {};
   }
+#endif
 
-  Selector::Instance().Register(ptr->m_impl->m_pty);
+  ptr->m_impl->m_pid = pid;
+  Events::Instance().WatchChild(
+      pid, [impl = ptr->m_impl](int status) { impl->m_status = status; });
+  InputStream::Instance().Register(ptr->Handle());
   return ptr;
 }
 
-int Process::FD() const { return m_impl->m_pty; }
+void *Process::Handle() const { return (void *)(intptr_t)m_impl->m_pty; }
 
 void Process::Write(const char *b, size_t n) { m_impl->Write(b, n); }
 void Process::WriteString(const char *s) { m_impl->Write(s, strlen(s)); }
@@ -83,6 +155,13 @@ void Process::Resize(const SIZE &size) {
   ioctl(m_impl->m_pty, TIOCSWINSZ, &ws);
 }
 
+bool Process::Exited(int *status) const {
+  if (status && m_impl->m_status) {
+    *status = *m_impl->m_status;
+  }
+  return m_impl->m_status.has_value();
+}
+
 const char *Process::GetTerm() {
   const char *envterm = getenv("TERM");
   if (envterm) {
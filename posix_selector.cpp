@@ -1,51 +1,352 @@
-#include "input_stream.h"
+#include "selector_impl.h"
+#include "metrics.h"
+#include "trace.h"
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/epoll.h>
 #include <sys/select.h>
 #include <unistd.h>
+#include <unordered_map>
+#include <vector>
 
-static int g_nfds = 1; /* stdin */
-static fd_set g_fds;
 static char g_iobuf[BUFSIZ];
 
-Selector::Selector() { FD_SET(STDIN_FILENO, &g_fds); }
+/* Common part of the select and epoll backends: fds are reported readable
+ * and read into a single static buffer. What an fd does not take is kept
+ * and sent when the fd is reported writable. */
+struct ReadinessSelector : SelectorImpl {
+  std::vector<bool> m_ready;
+  // the unwritten tail per fd, everything later goes behind it
+  std::unordered_map<int, std::string> m_unwritten;
 
-void Selector::Register(int fd) {
-  FD_SET(fd, &g_fds);
-  fcntl(fd, F_SETFL, O_NONBLOCK);
-  g_nfds = fd > g_nfds ? fd : g_nfds;
-}
+  void SetReady(int fd, bool ready) {
+    if (fd >= (int)m_ready.size()) {
+      m_ready.resize(fd + 1);
+    }
+    m_ready[fd] = ready;
+  }
 
-void Selector::Unregister(int fd) { FD_CLR(fd, &g_fds); }
+  bool Ready(int fd) const override {
+    return fd >= 0 && fd < (int)m_ready.size() && m_ready[fd];
+  }
 
-void Selector::Select() {
-  fd_set sfds = g_fds;
-  if (select(g_nfds + 1, &sfds, nullptr, nullptr, nullptr) < 0) {
-    FD_ZERO(&sfds);
+  void Register(int fd) override {
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    Watch(fd);
   }
-}
 
-std::optional<std::span<char>> Selector::Read(int fd) {
-  if (fd <= 0) {
-    // error
-    return std::nullopt;
+  void Unregister(int fd) override {
+    Unwatch(fd);
+    SetReady(fd, false);
+    m_unwritten.erase(fd);
   }
-  if (!FD_ISSET(fd, &g_fds)) {
+
+  void Pause(int fd) override {
+    Unwatch(fd);
+    SetReady(fd, false);
+  }
+
+  void Resume(int fd) override { Watch(fd); }
+
+  std::optional<std::span<char>> Read(int fd) override {
+    if (fd <= 0) {
+      // error
+      return std::nullopt;
+    }
+    if (!Ready(fd)) {
+      // empty
+      return std::span<char>{};
+    }
+
+    ++m_syscalls;
+    auto r = read(fd, g_iobuf, std::size(g_iobuf));
+    if (r > 0) {
+      if (r < (ssize_t)std::size(g_iobuf)) {
+        // drained, wait for the next readiness
+        SetReady(fd, false);
+      }
+      return std::span<char>(g_iobuf, r);
+    }
+
+    if (r == 0 || (errno != EINTR && errno != EWOULDBLOCK)) {
+      // error or end of file
+      return std::nullopt;
+    }
+
     // empty
+    SetReady(fd, false);
     return std::span<char>{};
   }
 
-  auto r = read(fd, g_iobuf, std::size(g_iobuf));
-  if (r > 0) {
-    return std::span<char>(g_iobuf, r);
+  // what fd took of data until it was full, -1 on an error
+  ssize_t Send(int fd, std::span<const char> data) {
+    size_t w = 0;
+    while (w < data.size()) {
+      ++m_syscalls;
+      ssize_t s = ::write(fd, data.data() + w, data.size() - w);
+      if (s > 0) {
+        w += (size_t)s;
+      } else if (s < 0 && errno == EAGAIN) {
+        break;
+      } else if (s < 0 && errno != EINTR) {
+        return -1;
+      }
+    }
+    return w;
+  }
+
+  void Write(int fd, std::span<const char> data) override {
+    auto found = m_unwritten.find(fd);
+    if (found != m_unwritten.end()) {
+      found->second.append(data.data(), data.size());
+      return;
+    }
+    auto w = Send(fd, data);
+    if (w >= 0 && (size_t)w < data.size()) {
+      m_unwritten[fd].assign(data.data() + w, data.size() - w);
+    }
+  }
+
+  // sends what is left for fd, dropped on an error
+  void Drain(int fd) {
+    auto found = m_unwritten.find(fd);
+    if (found == m_unwritten.end()) {
+      return;
+    }
+    auto &tail = found->second;
+    auto w = Send(fd, tail);
+    if (w < 0 || (size_t)w == tail.size()) {
+      m_unwritten.erase(found);
+    } else {
+      tail.erase(0, w);
+    }
+  }
+
+  size_t Pending(int fd) const override {
+    auto found = m_unwritten.find(fd);
+    return found == m_unwritten.end() ? 0 : found->second.size();
+  }
+
+  void Discard(int fd) override { m_unwritten.erase(fd); }
+
+  void Flush() override {
+    std::vector<int> fds;
+    for (auto &[fd, tail] : m_unwritten) {
+      fds.push_back(fd);
+    }
+    for (auto fd : fds) {
+      Drain(fd);
+    }
+  }
+};
+
+struct SelectSelector : ReadinessSelector {
+  int m_nfds = 0;
+  fd_set m_fds;
+
+  SelectSelector() { FD_ZERO(&m_fds); }
+
+  Selector::Backend Backend() const override {
+    return Selector::Backend::Select;
+  }
+
+  void Watch(int fd) override {
+    FD_SET(fd, &m_fds);
+    m_nfds = fd > m_nfds ? fd : m_nfds;
+  }
+
+  void Unwatch(int fd) override { FD_CLR(fd, &m_fds); }
+
+  void Select(int timeout) override {
+    fd_set sfds = m_fds;
+    fd_set wfds;
+    FD_ZERO(&wfds);
+    int nfds = m_nfds;
+    for (auto &[fd, tail] : m_unwritten) {
+      FD_SET(fd, &wfds);
+      nfds = std::max(nfds, fd);
+    }
+    struct timeval tv = {
+        .tv_sec = timeout / 1000,
+        .tv_usec = (timeout % 1000) * 1000,
+    };
+    ++m_syscalls;
+    if (select(nfds + 1, &sfds, &wfds, nullptr,
+               timeout < 0 ? nullptr : &tv) < 0) {
+      FD_ZERO(&sfds);
+      FD_ZERO(&wfds);
+    }
+    for (int fd = 0; fd <= m_nfds; ++fd) {
+      SetReady(fd, FD_ISSET(fd, &sfds));
+    }
+    for (int fd = 0; fd <= nfds; ++fd) {
+      if (FD_ISSET(fd, &wfds)) {
+        Drain(fd);
+      }
+    }
+  }
+};
+
+struct EpollSelector : ReadinessSelector {
+  int m_epoll = -1;
+  std::vector<int> m_set;
+
+  EpollSelector() : m_epoll(epoll_create1(EPOLL_CLOEXEC)) {}
+  ~EpollSelector() { close(m_epoll); }
+
+  Selector::Backend Backend() const override {
+    return Selector::Backend::Epoll;
+  }
+
+  void Watch(int fd) override {
+    struct epoll_event ev = {.events = EPOLLIN, .data = {.fd = fd}};
+    ++m_syscalls;
+    epoll_ctl(m_epoll, EPOLL_CTL_ADD, fd, &ev);
   }
 
-  if (errno != EINTR && errno != EWOULDBLOCK) {
-    // error
-    return std::nullopt;
+  void Unwatch(int fd) override {
+    ++m_syscalls;
+    epoll_ctl(m_epoll, EPOLL_CTL_DEL, fd, nullptr);
   }
 
-  // empty
-  return std::span<char>{};
+  void Select(int timeout) override {
+    for (auto fd : m_set) {
+      SetReady(fd, false);
+    }
+    m_set.clear();
+
+    if (!m_unwritten.empty()) {
+      // the epoll fd turns readable with a pending event, so it is waited
+      // for together with the fds that have output left
+      std::vector<struct pollfd> fds = {{.fd = m_epoll, .events = POLLIN}};
+      for (auto &[fd, tail] : m_unwritten) {
+        fds.push_back({.fd = fd, .events = POLLOUT});
+      }
+      ++m_syscalls;
+      if (poll(fds.data(), fds.size(), timeout) <= 0) {
+        return;
+      }
+      for (size_t i = 1; i < fds.size(); ++i) {
+        if (fds[i].revents) {
+          Drain(fds[i].fd);
+        }
+      }
+      if (!fds[0].revents) {
+        return;
+      }
+      timeout = 0;
+    }
+
+    struct epoll_event events[64];
+    ++m_syscalls;
+    int n = epoll_wait(m_epoll, events, std::size(events), timeout);
+    for (int i = 0; i < n; ++i) {
+      SetReady(events[i].data.fd, true);
+      m_set.push_back(events[i].data.fd);
+    }
+  }
+};
+
+SelectorImpl *CreateSelectSelector() { return new SelectSelector; }
+
+SelectorImpl *CreateEpollSelector() {
+  auto impl = new EpollSelector;
+  if (impl->m_epoll < 0) {
+    delete impl;
+    return nullptr;
+  }
+  return impl;
+}
+
+#if !defined(__linux__)
+SelectorImpl *CreateUringSelector() { return nullptr; }
+#endif
+
+//
+// Selector
+//
+Selector::Selector() { Initialize(); }
+Selector::~Selector() { delete m_impl; }
+
+const char *Selector::Name(Backend backend) {
+  switch (backend) {
+  case Backend::Auto:
+    return "auto";
+  case Backend::Select:
+    return "select";
+  case Backend::Epoll:
+    return "epoll";
+  case Backend::Uring:
+    return "io_uring";
+  }
+  return "unknown";
+}
+
+bool Selector::Initialize(Backend backend) {
+  delete m_impl;
+  m_impl = nullptr;
+  switch (backend) {
+  case Backend::Auto:
+  case Backend::Uring:
+    if ((m_impl = CreateUringSelector())) {
+      break;
+    }
+    /* fall-through */
+  case Backend::Epoll:
+    if ((m_impl = CreateEpollSelector())) {
+      break;
+    }
+    /* fall-through */
+  case Backend::Select:
+    m_impl = CreateSelectSelector();
+    break;
+  }
+  return backend == Backend::Auto || m_impl->Backend() == backend;
+}
+
+Selector::Backend Selector::Current() const { return m_impl->Backend(); }
+uint64_t Selector::Syscalls() const { return m_impl->m_syscalls; }
+
+void Selector::Register(int fd) { m_impl->Register(fd); }
+void Selector::Unregister(int fd) { m_impl->Unregister(fd); }
+void Selector::Watch(int fd) { m_impl->Watch(fd); }
+void Selector::Unwatch(int fd) { m_impl->Unwatch(fd); }
+void Selector::Pause(int fd) { m_impl->Pause(fd); }
+void Selector::Resume(int fd) { m_impl->Resume(fd); }
+
+void Selector::Select(int timeout) {
+  {
+    TRACE("write");
+    m_impl->Flush();
+  }
+  {
+    TRACE("poll");
+    Metrics::Timer timer(HISTOGRAM::WAIT);
+    m_impl->Select(timeout);
+  }
+  Metrics::Set(GAUGE::SYSCALLS, m_impl->m_syscalls);
+}
+
+bool Selector::Ready(int fd) const { return m_impl->Ready(fd); }
+
+std::optional<std::span<char>> Selector::Read(int fd) {
+  return m_impl->Read(fd);
+}
+
+void Selector::Write(int fd, std::span<const char> data) {
+  m_impl->Write(fd, data);
+}
+
+size_t Selector::Pending(int fd) const { return m_impl->Pending(fd); }
+
+void Selector::Discard(int fd) { m_impl->Discard(fd); }
+
+void Selector::Flush() {
+  TRACE("write");
+  m_impl->Flush();
 }
@@ -0,0 +1,502 @@
+#include "layout.h"
+#include "node.h"
+#include "selector.h"
+#include "session.h"
+#include "timer_queue.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace term_screen {
+
+// a client that stopped reading is retried this often
+static const int RETRY_INTERVAL = 10;
+
+static bool address(const char *path, struct sockaddr_un *addr) {
+  *addr = {};
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path)) {
+    return false;
+  }
+  strcpy(addr->sun_path, path);
+  return true;
+}
+
+bool ClaimSocket(const char *path) {
+  struct stat st;
+  if (lstat(path, &st) != 0) {
+    return errno == ENOENT;
+  }
+  struct sockaddr_un addr;
+  if (!S_ISSOCK(st.st_mode) || !address(path, &addr)) {
+    errno = EEXIST;
+    return false;
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  int r = connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+  int error = errno;
+  close(fd);
+  if (r == 0) {
+    // somebody listens there
+    errno = EADDRINUSE;
+    return false;
+  }
+  if (error != ECONNREFUSED) {
+    errno = error;
+    return false;
+  }
+  // left behind by a process that is gone
+  return unlink(path) == 0;
+}
+
+/* Append everything that can be read from fd to in, false on end of file
+ * or error. */
+static bool readall(int fd, std::string &in) {
+  char buf[BUFSIZ];
+  while (true) {
+    auto r = read(fd, buf, sizeof(buf));
+    if (r > 0) {
+      in.append(buf, r);
+    } else if (r < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return r < 0 && errno == EAGAIN;
+    }
+  }
+}
+
+struct PANE_STATE {
+  uint32_t Id;
+  // what the client shows
+  std::shared_ptr<const FRAME> Sent;
+};
+
+struct SessionServerImpl {
+  std::string m_path;
+  int m_listen = -1;
+  int m_client = -1;
+  // the forked caller leaves the socket alone
+  bool m_owner = true;
+
+  std::string m_in;
+  std::string m_out;
+  TimerQueue::TimerId m_retry = 0;
+
+  bool m_hello = false;
+  bool m_resized = false;
+  SIZE m_size = {};
+  std::vector<Input> m_inputs;
+
+  uint32_t m_nextId = 1;
+  std::unordered_map<const NODE *, PANE_STATE> m_panes;
+  std::string m_layout;
+  std::string m_encoded;
+  std::string m_status;
+  bool m_statusSent = false;
+
+  ~SessionServerImpl() {
+    Close(BYE::EXITED);
+    if (m_listen >= 0) {
+      if (m_owner) {
+        Selector::Instance().Unwatch(m_listen);
+        unlink(m_path.c_str());
+      }
+      close(m_listen);
+    }
+  }
+
+  void Close(BYE reason) {
+    if (m_client < 0) {
+      return;
+    }
+    {
+      MessageWriter w(m_out, MSG::BYE);
+      w.Put(reason);
+    }
+    // best effort, the client may be gone
+    Flush();
+    Selector::Instance().Unwatch(m_client);
+    close(m_client);
+    m_client = -1;
+    m_hello = false;
+    m_in.clear();
+    m_out.clear();
+    TimerQueue::Instance().Cancel(m_retry);
+    m_retry = 0;
+  }
+
+  void Resend() {
+    m_layout.clear();
+    m_statusSent = false;
+    for (auto &[node, pane] : m_panes) {
+      pane.Sent.reset();
+    }
+  }
+
+  void Accept() {
+    int fd = accept4(m_listen, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return;
+    }
+    Close(BYE::REPLACED);
+    m_client = fd;
+    Selector::Instance().Watch(fd);
+    Resend();
+  }
+
+  // false if the client has to go
+  bool Handle(MSG type, std::span<const char> body) {
+    MessageReader r(body);
+    switch (type) {
+    case MSG::HELLO:
+      if (r.Get<uint16_t>() != SESSION_VERSION) {
+        Close(BYE::VERSION);
+        return false;
+      }
+      m_hello = true;
+      [[fallthrough]];
+    case MSG::RESIZE:
+      m_size = r.Get<SIZE>();
+      m_resized = true;
+      break;
+    case MSG::INPUT:
+      while (!r.Empty()) {
+        Input input;
+        input.Error = r.Get<int32_t>();
+        input.Char = r.Get<uint32_t>();
+        m_inputs.push_back(input);
+      }
+      break;
+    default:
+      break;
+    }
+    return !r.Error();
+  }
+
+  void Receive() {
+    if (!readall(m_client, m_in)) {
+      Close(BYE::DETACHED);
+      return;
+    }
+    size_t used = 0;
+    MSG type;
+    std::span<const char> body;
+    while (auto n = NextMessage(std::span(m_in).subspan(used), &type, &body)) {
+      used += n;
+      if (!Handle(type, body)) {
+        Close(BYE::VERSION);
+        return;
+      }
+    }
+    m_in.erase(0, used);
+  }
+
+  void Flush() {
+    size_t sent = 0;
+    while (sent < m_out.size()) {
+      auto s = send(m_client, m_out.data() + sent, m_out.size() - sent,
+                    MSG_NOSIGNAL | MSG_DONTWAIT);
+      if (s > 0) {
+        sent += s;
+      } else if (s < 0 && errno == EINTR) {
+        continue;
+      } else {
+        break;
+      }
+    }
+    m_out.erase(0, sent);
+    if (!m_out.empty() && !m_retry) {
+      // wakes up the loop, whose next Send continues
+      m_retry = TimerQueue::Instance().Add(RETRY_INTERVAL, [this]() {
+        m_retry = 0;
+        Flush();
+      });
+    }
+  }
+
+  void Send(const Layout &layout) {
+    if (!m_hello) {
+      return;
+    }
+    if (!m_out.empty()) {
+      Flush();
+      if (!m_out.empty()) {
+        // still behind, the next frames are diffed against the last sent
+        return;
+      }
+    }
+
+    std::vector<PANE_INFO> panes;
+    std::unordered_map<const NODE *, PANE_STATE> states;
+    auto focused = layout.Focused();
+    uint32_t focusedId = 0;
+    for (auto &node : layout.Panes()) {
+      auto found = m_panes.find(node.get());
+      auto &state = states[node.get()];
+      state = found != m_panes.end() ? std::move(found->second)
+                                     : PANE_STATE{m_nextId++, nullptr};
+      panes.push_back({state.Id, node->Pos, node->Size});
+      if (node == focused) {
+        focusedId = state.Id;
+      }
+    }
+    m_panes = std::move(states);
+
+    m_encoded.clear();
+    EncodeLayout(m_encoded, panes, focusedId, layout.Borders());
+    if (m_encoded != m_layout) {
+      m_out += m_encoded;
+      m_layout.swap(m_encoded);
+      // the client clears its screen for a new layout
+      m_statusSent = false;
+    }
+    if (!m_statusSent) {
+      MessageWriter w(m_out, MSG::STATUS);
+      m_out += m_status;
+      m_statusSent = true;
+    }
+
+    for (auto &node : layout.Panes()) {
+      auto &state = m_panes[node.get()];
+      auto frame = node->m_grid.Acquire();
+      if (!frame || frame == state.Sent) {
+        continue;
+      }
+      EncodeCells(m_out, state.Id, state.Sent.get(), *frame);
+      state.Sent = std::move(frame);
+    }
+    Flush();
+  }
+};
+
+SessionServer::SessionServer() : m_impl(new SessionServerImpl) {}
+
+SessionServer::~SessionServer() { delete m_impl; }
+
+std::unique_ptr<SessionServer> SessionServer::Listen(const char *path) {
+  struct sockaddr_un addr;
+  if (!address(path, &addr)) {
+    return {};
+  }
+  if (!ClaimSocket(path)) {
+    return {};
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return {};
+  }
+  // only the owner may attach
+  auto mask = umask(0077);
+  bool bound = bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0;
+  umask(mask);
+  if (!bound || listen(fd, 4) != 0) {
+    close(fd);
+    return {};
+  }
+
+  auto ptr = std::unique_ptr<SessionServer>(new SessionServer);
+  ptr->m_impl->m_path = path;
+  ptr->m_impl->m_listen = fd;
+  return ptr;
+}
+
+int SessionServer::Fork() {
+  auto pid = fork();
+  if (pid < 0) {
+    return -1;
+  }
+  if (pid > 0) {
+    // the caller
+    m_impl->m_owner = false;
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? pid : -1;
+  }
+
+  // a new session without a controlling terminal, and a second fork so
+  // that the server is not a session leader and is reparented to init
+  if (setsid() < 0) {
+    _exit(EXIT_FAILURE);
+  }
+  pid = fork();
+  if (pid != 0) {
+    _exit(pid < 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+  }
+  int null = open("/dev/null", O_RDWR);
+  if (null >= 0) {
+    dup2(null, STDIN_FILENO);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    if (null > STDERR_FILENO) {
+      close(null);
+    }
+  }
+  Selector::Instance().Watch(m_impl->m_listen);
+  return 0;
+}
+
+void SessionServer::Dispatch() {
+  auto &selector = Selector::Instance();
+  if (m_impl->m_client >= 0 && selector.Ready(m_impl->m_client)) {
+    m_impl->Receive();
+  }
+  if (selector.Ready(m_impl->m_listen)) {
+    m_impl->Accept();
+  }
+}
+
+bool SessionServer::Attached() const { return m_impl->m_hello; }
+
+bool SessionServer::Resized(SIZE *size) {
+  if (!m_impl->m_resized) {
+    return false;
+  }
+  m_impl->m_resized = false;
+  *size = m_impl->m_size;
+  return true;
+}
+
+void SessionServer::Inputs(std::vector<Input> *inputs) {
+  inputs->insert(inputs->end(), m_impl->m_inputs.begin(),
+                 m_impl->m_inputs.end());
+  m_impl->m_inputs.clear();
+}
+
+void SessionServer::Send(const Layout &layout) { m_impl->Send(layout); }
+
+void SessionServer::Status(const std::string &text) {
+  if (text != m_impl->m_status) {
+    m_impl->m_status = text;
+    m_impl->m_statusSent = false;
+  }
+}
+
+void SessionServer::Resend() { m_impl->Resend(); }
+
+void SessionServer::Detach() { m_impl->Close(BYE::DETACHED); }
+
+struct SessionClientImpl {
+  int m_fd = -1;
+  std::string m_in;
+  BYE m_reason = BYE::EXITED;
+
+  ~SessionClientImpl() {
+    if (m_fd >= 0) {
+      Selector::Instance().Unwatch(m_fd);
+      close(m_fd);
+    }
+  }
+
+  void Write(std::string &out) { Selector::Instance().Write(m_fd, out); }
+};
+
+SessionClient::SessionClient() : m_impl(new SessionClientImpl) {}
+
+SessionClient::~SessionClient() { delete m_impl; }
+
+std::unique_ptr<SessionClient> SessionClient::Connect(const char *path) {
+  struct sockaddr_un addr;
+  if (!address(path, &addr)) {
+    return {};
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return {};
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return {};
+  }
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  auto ptr = std::unique_ptr<SessionClient>(new SessionClient);
+  ptr->m_impl->m_fd = fd;
+  return ptr;
+}
+
+void SessionClient::Attach(const SIZE &size) {
+  Selector::Instance().Watch(m_impl->m_fd);
+  std::string out;
+  {
+    MessageWriter w(out, MSG::HELLO);
+    w.Put(SESSION_VERSION);
+    w.Put(size);
+  }
+  m_impl->Write(out);
+}
+
+void SessionClient::Resize(const SIZE &size) {
+  std::string out;
+  {
+    MessageWriter w(out, MSG::RESIZE);
+    w.Put(size);
+  }
+  m_impl->Write(out);
+}
+
+void SessionClient::Send(std::span<const Input> inputs) {
+  if (inputs.empty()) {
+    return;
+  }
+  std::string out;
+  {
+    MessageWriter w(out, MSG::INPUT);
+    for (auto &input : inputs) {
+      w.Put((int32_t)input.Error);
+      w.Put(input.Char);
+    }
+  }
+  m_impl->Write(out);
+}
+
+bool SessionClient::Receive(const SessionView &view) {
+  auto &in = m_impl->m_in;
+  if (!Selector::Instance().Ready(m_impl->m_fd)) {
+    return true;
+  }
+  bool open = readall(m_impl->m_fd, in);
+
+  size_t used = 0;
+  MSG type;
+  std::span<const char> body;
+  while (auto n = NextMessage(std::span(in).subspan(used), &type, &body)) {
+    used += n;
+    bool ok = true;
+    switch (type) {
+    case MSG::LAYOUT:
+      ok = DecodeLayout(body, view);
+      break;
+    case MSG::CELLS:
+      ok = DecodeCells(body, view);
+      break;
+    case MSG::STATUS:
+      if (view.OnStatus) {
+        view.OnStatus(std::string(body.data(), body.size()));
+      }
+      break;
+    case MSG::BYE:
+      m_impl->m_reason = MessageReader(body).Get<BYE>();
+      return false;
+    default:
+      break;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  in.erase(0, used);
+  return open;
+}
+
+BYE SessionClient::Reason() const { return m_impl->m_reason; }
+
+} // namespace term_screen
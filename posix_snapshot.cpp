@@ -0,0 +1,271 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace term_screen {
+
+static const char MAGIC[8] = {'M', 'T', 'M', 'S', 'N', 'A', 'P', 0};
+// bumped whenever the layout of the file, a CELL or a history changes
+static const uint32_t VERSION = 1;
+
+// pieces are gathered up to this size before a write
+static const size_t WRITE_SIZE = 1024 * 1024;
+
+struct SNAPSHOT_HEADER {
+  char Magic[8];
+  uint32_t Version;
+  uint32_t Panes;
+  uint64_t ShapeSize;
+};
+
+struct PANE_HEADER {
+  uint16_t Rows;
+  uint16_t Cols;
+  int16_t CursorY;
+  int16_t CursorX;
+  uint32_t Modes;
+  uint8_t Charsets[4];
+  uint8_t Shift;
+  uint8_t Reserved[3];
+  uint32_t Tabs;
+  uint64_t HistorySize;
+};
+
+static_assert(sizeof(CELL) == 12, "CELL is written as is");
+
+// sections start on 8 byte boundaries
+static size_t align(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/* Batches small pieces, large ones go out directly. */
+class Writer {
+  int m_fd;
+  std::vector<char> m_buffer;
+  size_t m_written = 0;
+  bool m_error = false;
+
+  void Write(const char *data, size_t size) {
+    while (size && !m_error) {
+      auto w = ::write(m_fd, data, size);
+      if (w < 0 && errno == EINTR) {
+        continue;
+      }
+      if (w <= 0) {
+        m_error = true;
+        return;
+      }
+      data += w;
+      size -= w;
+    }
+  }
+
+public:
+  Writer(int fd) : m_fd(fd) { m_buffer.reserve(WRITE_SIZE); }
+
+  bool Error() const { return m_error; }
+
+  void Put(std::span<const char> data) {
+    m_written += data.size();
+    if (m_buffer.size() + data.size() <= WRITE_SIZE) {
+      m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+      return;
+    }
+    Flush();
+    if (data.size() >= WRITE_SIZE / 2) {
+      Write(data.data(), data.size());
+    } else {
+      m_buffer.insert(m_buffer.end(), data.begin(), data.end());
+    }
+  }
+
+  template <typename T> void Put(const T &value) {
+    Put({(const char *)&value, sizeof(value)});
+  }
+
+  void Pad() {
+    static const char zeros[8] = {};
+    Put({zeros, align(m_written) - m_written});
+  }
+
+  void Flush() {
+    Write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+  }
+};
+
+bool Snapshot::Write(const char *path, const std::string &shape,
+                     std::span<const PANE_SNAPSHOT> panes) {
+  auto tmp = std::string(path) + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    return false;
+  }
+
+  Writer w(fd);
+  SNAPSHOT_HEADER header = {};
+  memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+  header.Version = VERSION;
+  header.Panes = panes.size();
+  header.ShapeSize = shape.size();
+  w.Put(header);
+  w.Put(std::span(shape));
+  w.Pad();
+
+  for (auto &pane : panes) {
+    PANE_HEADER ph = {};
+    ph.Rows = pane.Size.Rows;
+    ph.Cols = pane.Size.Cols;
+    ph.CursorY = pane.Cursor.Y;
+    ph.CursorX = pane.Cursor.X;
+    ph.Modes = pane.Modes;
+    for (int i = 0; i < 4; ++i) {
+      ph.Charsets[i] = (uint8_t)pane.Charsets[i];
+    }
+    ph.Shift = pane.Shift;
+    ph.Tabs = pane.Tabs.size();
+    ph.HistorySize = pane.History ? pane.History->SavedSize() : 0;
+    w.Put(ph);
+    w.Put({(const char *)pane.Tabs.data(),
+           pane.Tabs.size() * sizeof(uint16_t)});
+    w.Pad();
+    // short grids are padded with blanks
+    auto cells = (size_t)ph.Rows * ph.Cols;
+    auto have = std::min(cells, pane.Cells.size());
+    w.Put({(const char *)pane.Cells.data(), have * sizeof(CELL)});
+    for (auto i = have; i < cells; ++i) {
+      w.Put(CELL{});
+    }
+    w.Pad();
+    if (pane.History) {
+      pane.History->Save([&w](std::span<const char> data) { w.Put(data); });
+      w.Pad();
+    }
+  }
+  w.Flush();
+
+  bool ok = !w.Error();
+  close(fd);
+  if (!ok || rename(tmp.c_str(), path) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+struct PANE_ENTRY {
+  const PANE_HEADER *Header;
+  const uint16_t *Tabs;
+  const CELL *Cells;
+  std::span<const char> History;
+};
+
+struct SnapshotImpl {
+  std::shared_ptr<const void> m_mapping;
+  std::string m_shape;
+  std::vector<PANE_ENTRY> m_panes;
+
+  // walks the pane headers once, nothing of a grid or history is read
+  bool Index(const char *base, size_t size) {
+    SNAPSHOT_HEADER header;
+    if (size < sizeof(header)) {
+      return false;
+    }
+    memcpy(&header, base, sizeof(header));
+    if (memcmp(header.Magic, MAGIC, sizeof(MAGIC)) ||
+        header.Version != VERSION) {
+      return false;
+    }
+    size_t p = sizeof(header);
+    if (header.ShapeSize > size - p) {
+      return false;
+    }
+    m_shape.assign(base + p, header.ShapeSize);
+    p = align(p + header.ShapeSize);
+
+    for (uint32_t i = 0; i < header.Panes; ++i) {
+      if (p > size || size - p < sizeof(PANE_HEADER)) {
+        return false;
+      }
+      PANE_ENTRY entry;
+      entry.Header = (const PANE_HEADER *)(base + p);
+      p += sizeof(PANE_HEADER);
+      entry.Tabs = (const uint16_t *)(base + p);
+      p = align(p + entry.Header->Tabs * sizeof(uint16_t));
+      entry.Cells = (const CELL *)(base + p);
+      p = align(p + (size_t)entry.Header->Rows * entry.Header->Cols *
+                        sizeof(CELL));
+      // the tabs and the cells end before p
+      auto history = entry.Header->HistorySize;
+      if (p > size || history > size - p) {
+        return false;
+      }
+      entry.History = {base + p, history};
+      p = align(p + history);
+      m_panes.push_back(entry);
+    }
+    return true;
+  }
+};
+
+Snapshot::Snapshot() : m_impl(new SnapshotImpl) {}
+
+Snapshot::~Snapshot() { delete m_impl; }
+
+std::unique_ptr<Snapshot> Snapshot::Open(const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return {};
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return {};
+  }
+  size_t size = st.st_size;
+  auto base = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    return {};
+  }
+
+  auto ptr = std::unique_ptr<Snapshot>(new Snapshot);
+  // unmapped when the snapshot and every history using it are gone
+  ptr->m_impl->m_mapping = std::shared_ptr<const void>(
+      base, [size](const void *p) { munmap((void *)p, size); });
+  if (!ptr->m_impl->Index((const char *)base, size)) {
+    return {};
+  }
+  return ptr;
+}
+
+const std::string &Snapshot::Shape() const { return m_impl->m_shape; }
+
+size_t Snapshot::Panes() const { return m_impl->m_panes.size(); }
+
+bool Snapshot::Pane(size_t i, PANE_SNAPSHOT *pane) const {
+  if (i >= m_impl->m_panes.size()) {
+    return false;
+  }
+  auto &entry = m_impl->m_panes[i];
+  auto &header = *entry.Header;
+  pane->Size = {header.Rows, header.Cols};
+  pane->Cursor = {header.CursorY, header.CursorX};
+  pane->Modes = header.Modes;
+  pane->Tabs.assign(entry.Tabs, entry.Tabs + header.Tabs);
+  for (int j = 0; j < 4; ++j) {
+    pane->Charsets[j] = (CHARSET)header.Charsets[j];
+  }
+  pane->Shift = header.Shift;
+  pane->Cells.assign(entry.Cells,
+                     entry.Cells + (size_t)header.Rows * header.Cols);
+  if (pane->History && !entry.History.empty()) {
+    return pane->History->Map(m_impl->m_mapping, entry.History);
+  }
+  return true;
+}
+
+} // namespace term_screen
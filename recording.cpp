@@ -0,0 +1,192 @@
+#include "recording.h"
+#include "timer_queue.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+static const char MAGIC[8] = {'M', 'T', 'M', 'R', 'E', 'C', 0, 0};
+// bumped whenever a record changes
+static const uint32_t VERSION = 1;
+
+// stdio buffer, also the most that is lost if mtm dies
+static const size_t BUFFER_SIZE = 256 * 1024;
+// milliseconds a record may stay buffered
+static const int FLUSH_DELAY = 1000;
+
+// the largest output record a replay accepts
+static const uint64_t MAX_OUTPUT = 64 * 1024 * 1024;
+
+struct HEADER {
+  char Magic[8];
+  uint32_t Version;
+  uint16_t Rows;
+  uint16_t Cols;
+};
+
+using Clock = std::chrono::steady_clock;
+
+static void putvarint(uint64_t n, FILE *fp) {
+  while (n >= 0x80) {
+    putc((int)(n & 0x7f) | 0x80, fp);
+    n >>= 7;
+  }
+  putc((int)n, fp);
+}
+
+static bool getvarint(FILE *fp, uint64_t *n) {
+  *n = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = getc(fp);
+    if (c == EOF) {
+      return false;
+    }
+    *n |= (uint64_t)(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+struct RecordingImpl {
+  FILE *m_fp = nullptr;
+  Clock::time_point m_last = Clock::now();
+  // armed while records are buffered
+  TimerQueue::TimerId m_flush = 0;
+
+  ~RecordingImpl() {
+    TimerQueue::Instance().Cancel(m_flush);
+    if (m_fp) {
+      fclose(m_fp);
+    }
+  }
+
+  void Begin(REPLAY_EVENT::TYPE type) {
+    auto now = Clock::now();
+    auto delta =
+        std::chrono::duration_cast<std::chrono::microseconds>(now - m_last);
+    m_last = now;
+    putc(type, m_fp);
+    putvarint(delta.count(), m_fp);
+  }
+
+  // also when the pane goes quiet right after
+  void End() {
+    if (!m_flush) {
+      m_flush = TimerQueue::Instance().Add(FLUSH_DELAY, [this]() {
+        m_flush = 0;
+        fflush(m_fp);
+      });
+    }
+  }
+};
+
+Recording::Recording() : m_impl(new RecordingImpl) {}
+
+Recording::~Recording() { delete m_impl; }
+
+std::unique_ptr<Recording> Recording::Create(const char *path,
+                                             const term_screen::SIZE &size) {
+  auto fp = fopen(path, "wb");
+  if (!fp) {
+    return {};
+  }
+  setvbuf(fp, nullptr, _IOFBF, BUFFER_SIZE);
+  auto ptr = std::unique_ptr<Recording>(new Recording);
+  ptr->m_impl->m_fp = fp;
+  HEADER header = {};
+  memcpy(header.Magic, MAGIC, sizeof(MAGIC));
+  header.Version = VERSION;
+  header.Rows = size.Rows;
+  header.Cols = size.Cols;
+  fwrite(&header, sizeof(header), 1, fp);
+  return ptr;
+}
+
+void Recording::Output(std::span<const char> data) {
+  m_impl->Begin(REPLAY_EVENT::OUTPUT);
+  putvarint(data.size(), m_impl->m_fp);
+  fwrite(data.data(), 1, data.size(), m_impl->m_fp);
+  m_impl->End();
+}
+
+void Recording::Resize(const term_screen::SIZE &size) {
+  m_impl->Begin(REPLAY_EVENT::RESIZE);
+  putvarint(size.Rows, m_impl->m_fp);
+  putvarint(size.Cols, m_impl->m_fp);
+  m_impl->End();
+}
+
+struct ReplayImpl {
+  FILE *m_fp = nullptr;
+  HEADER m_header;
+  uint64_t m_time = 0;
+  std::vector<char> m_data;
+
+  ~ReplayImpl() {
+    if (m_fp) {
+      fclose(m_fp);
+    }
+  }
+};
+
+Replay::Replay() : m_impl(new ReplayImpl) {}
+
+Replay::~Replay() { delete m_impl; }
+
+std::unique_ptr<Replay> Replay::Open(const char *path) {
+  auto fp = fopen(path, "rb");
+  if (!fp) {
+    return {};
+  }
+  setvbuf(fp, nullptr, _IOFBF, BUFFER_SIZE);
+  auto ptr = std::unique_ptr<Replay>(new Replay);
+  ptr->m_impl->m_fp = fp;
+  auto &header = ptr->m_impl->m_header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      memcmp(header.Magic, MAGIC, sizeof(MAGIC)) ||
+      header.Version != VERSION) {
+    return {};
+  }
+  return ptr;
+}
+
+term_screen::SIZE Replay::Size() const {
+  return {m_impl->m_header.Rows, m_impl->m_header.Cols};
+}
+
+bool Replay::Next(REPLAY_EVENT *event) {
+  auto fp = m_impl->m_fp;
+  int type = getc(fp);
+  uint64_t delta;
+  if (type == EOF || !getvarint(fp, &delta)) {
+    return false;
+  }
+  m_impl->m_time += delta;
+  event->Type = (REPLAY_EVENT::TYPE)type;
+  event->Time = m_impl->m_time;
+  switch (type) {
+  case REPLAY_EVENT::OUTPUT: {
+    uint64_t size;
+    if (!getvarint(fp, &size) || size > MAX_OUTPUT) {
+      return false;
+    }
+    m_impl->m_data.resize(size);
+    if (fread(m_impl->m_data.data(), 1, size, fp) != size) {
+      return false;
+    }
+    event->Data = m_impl->m_data;
+    return true;
+  }
+  case REPLAY_EVENT::RESIZE: {
+    uint64_t rows, cols;
+    if (!getvarint(fp, &rows) || !getvarint(fp, &cols)) {
+      return false;
+    }
+    event->Size = {(uint16_t)rows, (uint16_t)cols};
+    return true;
+  }
+  }
+  return false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "screen.h"
+#include <memory>
+#include <span>
+#include <stdint.h>
+
+// Writes the raw pty output of a pane with the time it arrived.
+//
+// Every record is a type, the microseconds since the previous record and
+// its payload, with varints for the numbers. Resizes of the emulator are
+// recorded between the bytes, so a replay at the recorded sizes parses
+// exactly what the pane parsed. A record reaches the file within a second,
+// by a timer of the TimerQueue. Only used from the main thread.
+class Recording {
+
+  struct RecordingImpl *m_impl = nullptr;
+
+  Recording();
+
+public:
+  Recording(const Recording &) = delete;
+  Recording &operator=(const Recording &) = delete;
+  // flushes what is buffered
+  ~Recording();
+
+  // nullptr if the file could not be created
+  static std::unique_ptr<Recording> Create(const char *path,
+                                           const term_screen::SIZE &size);
+
+  void Output(std::span<const char> data);
+  void Resize(const term_screen::SIZE &size);
+};
+
+// One record of a recording.
+struct REPLAY_EVENT {
+  enum TYPE : uint8_t {
+    OUTPUT,
+    RESIZE,
+  } Type;
+  // microseconds since the start of the recording
+  uint64_t Time;
+  // OUTPUT, valid until the next call of Next
+  std::span<const char> Data;
+  // RESIZE
+  term_screen::SIZE Size;
+};
+
+// Reads a recording back one record at a time.
+class Replay {
+
+  struct ReplayImpl *m_impl = nullptr;
+
+  Replay();
+
+public:
+  Replay(const Replay &) = delete;
+  Replay &operator=(const Replay &) = delete;
+  ~Replay();
+
+  // nullptr if path is missing or not a recording of this version
+  static std::unique_ptr<Replay> Open(const char *path);
+
+  // the size of the pane when the recording started
+  term_screen::SIZE Size() const;
+  // false at the end, or at a truncated record
+  bool Next(REPLAY_EVENT *event);
+};
@@ -1,6 +1,10 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
 
+/* curses WINDOW */
+struct _win_st;
+
 namespace term_screen {
 
 struct POS {
@@ -30,19 +34,20 @@ struct Input {
 };
 
 struct SCRN {
-  int sy, sx;
-  int vis;
-  int tos;
-  int off;
-  short fg, bg;
-  short sfg, sbg;
-  short sp;
-  bool insert;
-  bool oxenl;
-  bool xenl;
-  bool saved;
-  uint32_t sattr;
-  struct _win_st *win;
+  int sy = 0, sx = 0;
+  int vis = 1;
+  int tos = 0;
+  int off = 0;
+  // -1 for the default colors
+  short fg = -1, bg = -1;
+  short sfg = -1, sbg = -1;
+  short sp = 0;
+  bool insert = false;
+  bool oxenl = false;
+  bool xenl = false;
+  bool saved = false;
+  uint32_t sattr = 0;
+  ::_win_st *win = nullptr;
 
   SCRN(const SIZE &size);
   ~SCRN();
@@ -62,6 +67,16 @@ struct SCRN {
   void Scroll(int d);
   void Update();
   void WriteCell(const POS &pos, wchar_t ch, int fg, int bg);
+  // shows cols cells from pos in reverse video, until they are written
+  void Reverse(const POS &pos, int cols);
+  // an estimate of the memory of the pad
+  size_t Bytes() const;
 };
 
+// borders between panes, drawn on the host screen
+void DrawVLine(const POS &pos, uint16_t rows);
+void DrawHLine(const POS &pos, uint16_t cols);
+// a row of ASCII text in reverse video, cut or padded to cols
+void DrawStatus(const POS &pos, uint16_t cols, const char *text);
+
 } // namespace term_screen
@@ -0,0 +1,318 @@
+#include "scrollback.h"
+#include "utf8.h"
+#include <algorithm>
+#include <string.h>
+
+namespace term_screen {
+
+// cells of equal looks, their characters follow the runs of the line
+struct RUN {
+  short Fg;
+  short Bg;
+  uint16_t Attr;
+  uint16_t Count;
+  uint8_t Width;
+};
+
+static uint32_t getutf8(const char *&p, const char *end) {
+  uint8_t c = *p++;
+  int more = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+  uint32_t out = more ? c & (0x3f >> more) : c;
+  for (; more && p < end; --more) {
+    out = (out << 6) | (*p++ & 0x3f);
+  }
+  return out;
+}
+
+// past n characters from p
+static const char *skiputf8(const char *p, const char *end, int n) {
+  if (n <= end - p) {
+    // mostly ASCII, one byte each
+    uint8_t high = 0;
+    for (int i = 0; i < n; ++i) {
+      high |= (uint8_t)p[i];
+    }
+    if (high < 0x80) {
+      return p + n;
+    }
+  }
+  for (; n > 0 && p < end; --n) {
+    uint8_t c = *p;
+    p += c >= 0xf0 ? 4 : c >= 0xe0 ? 3 : c >= 0xc0 ? 2 : 1;
+  }
+  return std::min(p, end);
+}
+
+static void encode(std::span<const CELL> cells, std::vector<char> &out) {
+  // cells never written by the child
+  auto n = cells.size();
+  while (n && !cells[n - 1].Char && !cells[n - 1].Attr) {
+    --n;
+  }
+
+  thread_local std::vector<RUN> runs;
+  thread_local std::vector<char> chars;
+  runs.clear();
+  chars.clear();
+  for (size_t i = 0; i < n; ++i) {
+    auto &cell = cells[i];
+    if (cell.Width == 0 || cell.Char == (uint32_t)-1) {
+      // the right half of a wide character
+      continue;
+    }
+    pututf8(chars, cell.Char);
+    if (!runs.empty()) {
+      auto &run = runs.back();
+      if (run.Fg == cell.Fg && run.Bg == cell.Bg && run.Attr == cell.Attr &&
+          run.Width == cell.Width && run.Count < UINT16_MAX) {
+        ++run.Count;
+        continue;
+      }
+    }
+    runs.push_back({cell.Fg, cell.Bg, cell.Attr, 1, cell.Width});
+  }
+
+  uint16_t count = runs.size();
+  auto p = out.size();
+  out.resize(p + sizeof(count) + runs.size() * sizeof(RUN));
+  memcpy(out.data() + p, &count, sizeof(count));
+  memcpy(out.data() + p + sizeof(count), runs.data(),
+         runs.size() * sizeof(RUN));
+  out.insert(out.end(), chars.begin(), chars.end());
+}
+
+static void decode(std::span<const char> line, std::vector<CELL> *cells) {
+  cells->clear();
+  uint16_t count;
+  if (line.size() < sizeof(count)) {
+    return;
+  }
+  memcpy(&count, line.data(), sizeof(count));
+  auto runs = line.data() + sizeof(count);
+  auto p = runs + count * sizeof(RUN);
+  auto end = line.data() + line.size();
+  if (p > end) {
+    return;
+  }
+  for (int i = 0; i < count; ++i) {
+    RUN run;
+    memcpy(&run, runs + i * sizeof(RUN), sizeof(run));
+    for (int j = 0; j < run.Count && p < end; ++j) {
+      CELL cell;
+      cell.Char = getutf8(p, end);
+      cell.Fg = run.Fg;
+      cell.Bg = run.Bg;
+      cell.Attr = run.Attr;
+      cell.Width = run.Width;
+      cells->push_back(cell);
+      if (run.Width == 2) {
+        cell.Char = 0;
+        cell.Width = 0;
+        cells->push_back(cell);
+      }
+    }
+  }
+}
+
+Scrollback::Scrollback(size_t limit) : m_limit(std::max(limit, (size_t)1)) {}
+
+size_t Scrollback::Size() const {
+  return m_mappedLines + m_offsets.size() - 1 - m_first;
+}
+
+size_t Scrollback::Bytes() const {
+  return m_data.capacity() + m_offsets.capacity() * sizeof(uint64_t);
+}
+
+std::span<const char> Scrollback::Raw(size_t i) const {
+  auto j = m_first + i;
+  if (j < m_mappedLines) {
+    auto begin = m_mappedOffsets[j];
+    auto end = m_mappedOffsets[j + 1];
+    if (begin > end || end > m_mappedOffsets[m_mappedLines]) {
+      return {};
+    }
+    return {m_mappedData + begin, m_mappedData + end};
+  }
+  j -= m_mappedLines;
+  return {m_data.data() + m_offsets[j], m_data.data() + m_offsets[j + 1]};
+}
+
+// drops the heap lines that were trimmed
+void Scrollback::Compact() {
+  if (m_first < m_mappedLines) {
+    return;
+  }
+  auto dropped = m_first - m_mappedLines;
+  if (dropped < 1024 || dropped < m_limit / 2) {
+    return;
+  }
+  auto base = m_offsets[dropped];
+  m_data.erase(m_data.begin(), m_data.begin() + base);
+  m_offsets.erase(m_offsets.begin(), m_offsets.begin() + dropped);
+  for (auto &offset : m_offsets) {
+    offset -= base;
+  }
+  m_first -= dropped;
+}
+
+void Scrollback::Push(std::span<const CELL> cells) {
+  encode(cells, m_data);
+  m_offsets.push_back(m_data.size());
+  if (Size() > m_limit) {
+    ++m_first;
+    ++m_dropped;
+    if (m_mapping && m_first >= m_mappedLines) {
+      // every restored line is gone
+      m_first -= m_mappedLines;
+      m_mapping.reset();
+      m_mappedOffsets = nullptr;
+      m_mappedData = nullptr;
+      m_mappedLines = 0;
+    }
+    Compact();
+  }
+}
+
+bool Scrollback::Pop(std::vector<CELL> *cells) {
+  if (!Size()) {
+    return false;
+  }
+  decode(Raw(Size() - 1), cells);
+  if (m_offsets.size() > 1) {
+    m_offsets.pop_back();
+    m_data.resize(m_offsets.back());
+  } else {
+    --m_mappedLines;
+  }
+  return true;
+}
+
+void Scrollback::Line(size_t i, std::vector<CELL> *cells) const {
+  if (i < Size()) {
+    decode(Raw(i), cells);
+  } else {
+    cells->clear();
+  }
+}
+
+void Scrollback::Text(size_t i, int from, int to, std::string *out) const {
+  if (i >= Size() || from >= to) {
+    return;
+  }
+  auto line = Raw(i);
+  uint16_t count;
+  if (line.size() < sizeof(count)) {
+    return;
+  }
+  memcpy(&count, line.data(), sizeof(count));
+  auto runs = line.data() + sizeof(count);
+  auto p = runs + count * sizeof(RUN);
+  auto end = line.data() + line.size();
+  if (p > end) {
+    return;
+  }
+  auto start = out->size();
+  int col = 0;
+  for (int r = 0; r < count && col < to && p < end; ++r) {
+    RUN run;
+    memcpy(&run, runs + r * sizeof(RUN), sizeof(run));
+    int width = std::max(run.Width, (uint8_t)1);
+    // the characters starting in from to to
+    auto chars = [&](int64_t limit) {
+      return (int)std::clamp<int64_t>((limit - col + width - 1) / width, 0,
+                                      run.Count);
+    };
+    int first = chars(from);
+    int last = chars(to);
+    // the characters of a run are copied as one piece
+    auto begin = skiputf8(p, end, first);
+    p = skiputf8(begin, end, last - first);
+    out->append(begin, p);
+    p = skiputf8(p, end, run.Count - last);
+    col += run.Count * width;
+  }
+  // unwritten cells inside the line, and the blanks at its end
+  for (auto q = out->data() + start;
+       (q = (char *)memchr(q, 0, out->data() + out->size() - q));) {
+    *q = ' ';
+  }
+  auto kept = out->find_last_not_of(' ');
+  out->resize(kept == std::string::npos || kept < start ? start : kept + 1);
+}
+
+size_t Scrollback::SavedSize() const {
+  size_t data = 0;
+  if (m_first < m_mappedLines) {
+    data += m_mappedOffsets[m_mappedLines] - m_mappedOffsets[m_first];
+  }
+  auto heapFirst = m_first > m_mappedLines ? m_first - m_mappedLines : 0;
+  data += m_data.size() - m_offsets[heapFirst];
+  return sizeof(uint64_t) * (Size() + 2) + data;
+}
+
+void Scrollback::Save(
+    const std::function<void(std::span<const char>)> &write) const {
+  uint64_t lines = Size();
+  write({(const char *)&lines, sizeof(lines)});
+
+  // the offsets are rebased to the first line kept, in chunks
+  uint64_t chunk[8192];
+  size_t used = 0;
+  auto put = [&](uint64_t offset) {
+    chunk[used++] = offset;
+    if (used == std::size(chunk)) {
+      write({(const char *)chunk, sizeof(chunk)});
+      used = 0;
+    }
+  };
+  uint64_t mapped = 0;
+  if (m_first < m_mappedLines) {
+    auto base = m_mappedOffsets[m_first];
+    for (auto j = m_first; j < m_mappedLines; ++j) {
+      put(m_mappedOffsets[j] - base);
+    }
+    mapped = m_mappedOffsets[m_mappedLines] - base;
+  }
+  auto heapFirst = m_first > m_mappedLines ? m_first - m_mappedLines : 0;
+  auto base = m_offsets[heapFirst];
+  for (auto j = heapFirst; j < m_offsets.size(); ++j) {
+    put(mapped + m_offsets[j] - base);
+  }
+  write({(const char *)chunk, used * sizeof(uint64_t)});
+
+  if (mapped) {
+    write({m_mappedData + m_mappedOffsets[m_first], mapped});
+  }
+  write({m_data.data() + base, m_data.size() - base});
+}
+
+bool Scrollback::Map(std::shared_ptr<const void> mapping,
+                     std::span<const char> saved) {
+  uint64_t lines;
+  if (saved.size() < sizeof(lines) ||
+      (uintptr_t)saved.data() % alignof(uint64_t)) {
+    return false;
+  }
+  memcpy(&lines, saved.data(), sizeof(lines));
+  auto table = sizeof(uint64_t) * (lines + 2);
+  if (lines > saved.size() / sizeof(uint64_t) || table > saved.size()) {
+    return false;
+  }
+  auto offsets = (const uint64_t *)(saved.data() + sizeof(lines));
+  if (offsets[0] != 0 || offsets[lines] != saved.size() - table) {
+    return false;
+  }
+
+  m_mapping = std::move(mapping);
+  m_mappedOffsets = offsets;
+  m_mappedData = saved.data() + table;
+  m_mappedLines = lines;
+  m_offsets.assign(1, 0);
+  m_data.clear();
+  m_first = lines > m_limit ? lines - m_limit : 0;
+  m_dropped = 0;
+  return true;
+}
+
+} // namespace term_screen
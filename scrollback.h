@@ -0,0 +1,70 @@
+#pragma once
+#include "grid_snapshot.h"
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace term_screen {
+
+// The lines that scrolled off the top of a pane, oldest first.
+//
+// A line is stored as runs of equal colors and attributes followed by its
+// characters in UTF-8, without the unwritten cells at its end. The lines
+// sit back to back behind an offset table, so a history is saved with a
+// few large writes and restored by mapping the file, without decoding a
+// line until it is shown. Restored lines stay in the read-only mapping,
+// new ones go to the heap after them.
+class Scrollback {
+  size_t m_limit;
+
+  // restored lines, kept alive by m_mapping
+  std::shared_ptr<const void> m_mapping;
+  const uint64_t *m_mappedOffsets = nullptr;
+  const char *m_mappedData = nullptr;
+  size_t m_mappedLines = 0;
+
+  std::vector<uint64_t> m_offsets{0};
+  std::vector<char> m_data;
+
+  // dropped lines at the front, mapped ones first
+  size_t m_first = 0;
+  // lines trimmed since the history was created or mapped
+  uint64_t m_dropped = 0;
+
+  std::span<const char> Raw(size_t i) const;
+  void Compact();
+
+public:
+  // keeps at most limit lines
+  Scrollback(size_t limit);
+
+  size_t Size() const;
+  // heap bytes in use, mapped lines are not counted
+  size_t Bytes() const;
+
+  void Push(std::span<const CELL> cells);
+  // removes the newest line, false if there is none
+  bool Pop(std::vector<CELL> *cells);
+  // 0 is the oldest line. A wide character is followed by a cell of
+  // width 0.
+  void Line(size_t i, std::vector<CELL> *cells) const;
+  // appends the characters of columns from to to of line i, without the
+  // blanks at the end, reading no more of the line than that
+  void Text(size_t i, int from, int to, std::string *out) const;
+  // line i was number Dropped() + i, so that a line can be found again
+  // after older ones were trimmed
+  uint64_t Dropped() const { return m_dropped; }
+
+  // Save writes the line count, the offset table and the lines, in
+  // SavedSize bytes.
+  size_t SavedSize() const;
+  void Save(const std::function<void(std::span<const char>)> &write) const;
+  // adopts what Save wrote, from a mapping that stays alive as long as
+  // mapping does. Replaces every line, false if saved is malformed.
+  bool Map(std::shared_ptr<const void> mapping, std::span<const char> saved);
+};
+
+} // namespace term_screen
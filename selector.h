@@ -0,0 +1,64 @@
+#pragma once
+#include <optional>
+#include <span>
+#include <stdint.h>
+
+// Waits for pty output and reads it, and writes to ptys and the host.
+//
+// Registered fds are read by the selector, watched fds (stdin, signals) are
+// only reported as ready. Writes may be queued and are sent at the latest by
+// the next Select or Flush, preserving order per fd. A write never blocks:
+// what an fd does not take is kept and sent once it is writable again.
+class Selector {
+
+  struct SelectorImpl *m_impl = nullptr;
+
+  Selector();
+
+public:
+  enum class Backend {
+    Auto,
+    Select,
+    Epoll,
+    Uring,
+  };
+
+  Selector(const Selector &) = delete;
+  Selector &operator=(const Selector &) = delete;
+  ~Selector();
+
+  static Selector &Instance() {
+    static Selector s_instance;
+    return s_instance;
+  }
+
+  static const char *Name(Backend backend);
+
+  // Auto tries io_uring, then epoll, then select. Must be called before any
+  // fd is registered.
+  bool Initialize(Backend backend = Backend::Auto);
+  Backend Current() const;
+  // system calls issued by the selector so far
+  uint64_t Syscalls() const;
+
+  void Register(int fd);
+  void Unregister(int fd);
+  void Watch(int fd);
+  void Unwatch(int fd);
+  // a paused fd is not read or reported, its output stays in the kernel
+  void Pause(int fd);
+  void Resume(int fd);
+
+  // timeout in milliseconds, negative waits forever
+  void Select(int timeout = -1);
+  bool Ready(int fd) const;
+  // nullopt on error or end of file, an empty span if nothing is pending
+  std::optional<std::span<char>> Read(int fd);
+
+  void Write(int fd, std::span<const char> data);
+  // bytes written to fd that have not reached it yet
+  size_t Pending(int fd) const;
+  // forgets what is queued for fd, before it is closed
+  void Discard(int fd);
+  void Flush();
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include "selector.h"
+
+// Interface implemented by each Selector backend.
+struct SelectorImpl {
+  uint64_t m_syscalls = 0;
+
+  virtual ~SelectorImpl() {}
+  virtual Selector::Backend Backend() const = 0;
+  virtual void Register(int fd) = 0;
+  virtual void Unregister(int fd) = 0;
+  virtual void Watch(int fd) = 0;
+  virtual void Unwatch(int fd) = 0;
+  virtual void Pause(int fd) = 0;
+  virtual void Resume(int fd) = 0;
+  virtual void Select(int timeout) = 0;
+  virtual bool Ready(int fd) const = 0;
+  virtual std::optional<std::span<char>> Read(int fd) = 0;
+  virtual void Write(int fd, std::span<const char> data) = 0;
+  virtual size_t Pending(int fd) const = 0;
+  virtual void Discard(int fd) = 0;
+  virtual void Flush() {}
+};
+
+SelectorImpl *CreateSelectSelector();
+SelectorImpl *CreateEpollSelector();
+// nullptr if the kernel does not support io_uring
+SelectorImpl *CreateUringSelector();
@@ -0,0 +1,167 @@
+#include "session.h"
+#include "layout.h"
+#include <string.h>
+
+namespace term_screen {
+
+// type and length
+static const size_t HEADER_SIZE = sizeof(MSG) + sizeof(uint32_t);
+
+MessageWriter::MessageWriter(std::string &out, MSG type)
+    : m_out(out), m_start(out.size()) {
+  Put(type);
+  Put((uint32_t)0);
+}
+
+MessageWriter::~MessageWriter() {
+  uint32_t length = m_out.size() - m_start - HEADER_SIZE;
+  memcpy(m_out.data() + m_start + sizeof(MSG), &length, sizeof(length));
+}
+
+size_t NextMessage(std::span<const char> data, MSG *type,
+                   std::span<const char> *body) {
+  if (data.size() < HEADER_SIZE) {
+    return 0;
+  }
+  uint32_t length;
+  memcpy(&length, data.data() + sizeof(MSG), sizeof(length));
+  if (data.size() - HEADER_SIZE < length) {
+    return 0;
+  }
+  *type = (MSG)data[0];
+  *body = data.subspan(HEADER_SIZE, length);
+  return HEADER_SIZE + length;
+}
+
+void EncodeLayout(std::string &out, std::span<const PANE_INFO> panes,
+                  uint32_t focused, std::span<const BORDER> borders) {
+  MessageWriter w(out, MSG::LAYOUT);
+  w.Put(focused);
+  w.Put((uint16_t)panes.size());
+  for (auto &pane : panes) {
+    w.Put(pane.Id);
+    w.Put((int16_t)pane.Pos.Y);
+    w.Put((int16_t)pane.Pos.X);
+    w.Put(pane.Size);
+  }
+  w.Put((uint16_t)borders.size());
+  for (auto &border : borders) {
+    w.Put((int16_t)border.Pos.Y);
+    w.Put((int16_t)border.Pos.X);
+    w.Put(border.Length);
+    w.Put((uint8_t)border.Vertical);
+  }
+}
+
+bool DecodeLayout(std::span<const char> body, const SessionView &view) {
+  MessageReader r(body);
+  auto focused = r.Get<uint32_t>();
+  std::vector<PANE_INFO> panes(r.Get<uint16_t>());
+  for (auto &pane : panes) {
+    pane.Id = r.Get<uint32_t>();
+    pane.Pos.Y = r.Get<int16_t>();
+    pane.Pos.X = r.Get<int16_t>();
+    pane.Size = r.Get<SIZE>();
+  }
+  std::vector<BORDER> borders(r.Get<uint16_t>());
+  for (auto &border : borders) {
+    border.Pos.Y = r.Get<int16_t>();
+    border.Pos.X = r.Get<int16_t>();
+    border.Length = r.Get<uint16_t>();
+    border.Vertical = r.Get<uint8_t>();
+  }
+  if (r.Error()) {
+    return false;
+  }
+  view.OnLayout(panes, focused, borders);
+  return true;
+}
+
+static void putcell(MessageWriter &w, const CELL &cell) {
+  w.Put(cell.Char);
+  w.Put(cell.Fg);
+  w.Put(cell.Bg);
+  w.Put((uint8_t)cell.Attr);
+  w.Put(cell.Width);
+}
+
+static CELL getcell(MessageReader &r) {
+  CELL cell;
+  cell.Char = r.Get<uint32_t>();
+  cell.Fg = r.Get<short>();
+  cell.Bg = r.Get<short>();
+  cell.Attr = r.Get<uint8_t>();
+  cell.Width = r.Get<uint8_t>();
+  return cell;
+}
+
+void EncodeCells(std::string &out, uint32_t id, const FRAME *prev,
+                 const FRAME &frame) {
+  if (prev && !(prev->Size == frame.Size)) {
+    prev = nullptr;
+  }
+
+  MessageWriter w(out, MSG::CELLS);
+  w.Put(id);
+  w.Put((int16_t)frame.Cursor.Y);
+  w.Put((int16_t)frame.Cursor.X);
+  w.Put((uint8_t)frame.CursorVisible);
+  for (int y = 0; y < frame.Size.Rows; ++y) {
+    auto &cells = frame.Rows[y]->Cells;
+    int begin = 0;
+    int end = cells.size();
+    if (prev) {
+      auto &old = prev->Rows[y];
+      if (old == frame.Rows[y]) {
+        // shared rows are unchanged
+        continue;
+      }
+      // only the changed run of the row
+      while (begin < end && old->Cells[begin] == cells[begin]) {
+        ++begin;
+      }
+      while (end > begin && old->Cells[end - 1] == cells[end - 1]) {
+        --end;
+      }
+      if (begin == end) {
+        continue;
+      }
+    }
+    w.Put((uint16_t)y);
+    w.Put((uint16_t)begin);
+    w.Put((uint16_t)(end - begin));
+    for (int x = begin; x < end; ++x) {
+      putcell(w, cells[x]);
+    }
+  }
+}
+
+bool DecodeCells(std::span<const char> body, const SessionView &view) {
+  MessageReader r(body);
+  auto id = r.Get<uint32_t>();
+  POS cursor;
+  cursor.Y = r.Get<int16_t>();
+  cursor.X = r.Get<int16_t>();
+  bool visible = r.Get<uint8_t>();
+  std::vector<CELL> cells;
+  while (!r.Error() && !r.Empty()) {
+    POS pos;
+    pos.Y = r.Get<uint16_t>();
+    pos.X = r.Get<uint16_t>();
+    cells.resize(r.Get<uint16_t>());
+    for (auto &cell : cells) {
+      cell = getcell(r);
+    }
+    if (r.Error()) {
+      return false;
+    }
+    view.OnCells(id, pos, cells);
+  }
+  if (r.Error()) {
+    return false;
+  }
+  view.OnCursor(id, cursor, visible);
+  return true;
+}
+
+} // namespace term_screen
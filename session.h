@@ -0,0 +1,207 @@
+#pragma once
+#include "grid_snapshot.h"
+#include "screen.h"
+#include <functional>
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace term_screen {
+
+class Layout;
+struct BORDER;
+
+// bumped whenever a message changes
+const uint16_t SESSION_VERSION = 2;
+
+// Every message is a type byte and a 32 bit length followed by the body.
+// Both ends are the same binary on the same host, so integers are sent in
+// host order.
+enum class MSG : uint8_t {
+  // client: version and host terminal size, answered with the whole screen
+  HELLO,
+  // client: the host terminal was resized
+  RESIZE,
+  // client: keys
+  INPUT,
+  // server: panes, focus and borders
+  LAYOUT,
+  // server: the cells of one pane that changed, and its cursor
+  CELLS,
+  // server: a reason, then the connection is closed
+  BYE,
+  // server: the text of the status line, none without one
+  STATUS,
+
+  // control mode, see Control
+  // client: one command line, answered with a REPLY
+  COMMAND,
+  // server: what the command printed
+  REPLY,
+  // server: runs of pane output, each an id, a 32 bit length and the bytes
+  OUTPUT,
+};
+
+enum class BYE : uint8_t {
+  DETACHED,
+  // the last pane was closed
+  EXITED,
+  // another client attached
+  REPLACED,
+  VERSION,
+};
+
+struct PANE_INFO {
+  uint32_t Id;
+  POS Pos;
+  SIZE Size;
+};
+
+// Appends one message to out, the length is filled in by the destructor.
+class MessageWriter {
+  std::string &m_out;
+  size_t m_start;
+
+public:
+  MessageWriter(std::string &out, MSG type);
+  MessageWriter(const MessageWriter &) = delete;
+  MessageWriter &operator=(const MessageWriter &) = delete;
+  ~MessageWriter();
+
+  template <typename T> void Put(const T &value) {
+    m_out.append((const char *)&value, sizeof(value));
+  }
+};
+
+// Reads the body of one message. A short body reads as zeros and sets
+// Error.
+class MessageReader {
+  std::span<const char> m_data;
+  bool m_error = false;
+
+public:
+  MessageReader(std::span<const char> data) : m_data(data) {}
+
+  bool Error() const { return m_error; }
+  bool Empty() const { return m_data.empty(); }
+  template <typename T> T Get() {
+    T value{};
+    if (m_data.size() < sizeof(value)) {
+      m_error = true;
+      m_data = {};
+      return value;
+    }
+    memcpy(&value, m_data.data(), sizeof(value));
+    m_data = m_data.subspan(sizeof(value));
+    return value;
+  }
+};
+
+// the size of the first complete message in data, 0 if it is incomplete
+size_t NextMessage(std::span<const char> data, MSG *type,
+                   std::span<const char> *body);
+
+void EncodeLayout(std::string &out, std::span<const PANE_INFO> panes,
+                  uint32_t focused, std::span<const BORDER> borders);
+// the cells of frame that differ from prev, everything without prev
+void EncodeCells(std::string &out, uint32_t id, const FRAME *prev,
+                 const FRAME &frame);
+
+// What an attached client shows.
+struct SessionView {
+  std::function<void(std::span<const PANE_INFO> panes, uint32_t focused,
+                     std::span<const BORDER> borders)>
+      OnLayout;
+  // a run of cells in one row
+  std::function<void(uint32_t id, const POS &pos, std::span<const CELL> cells)>
+      OnCells;
+  std::function<void(uint32_t id, const POS &cursor, bool visible)> OnCursor;
+  // on the last row of the screen, which has no panes while it is not empty
+  std::function<void(const std::string &text)> OnStatus;
+};
+
+// false on a malformed message
+bool DecodeLayout(std::span<const char> body, const SessionView &view);
+bool DecodeCells(std::span<const char> body, const SessionView &view);
+
+// Makes way for a Unix socket at path: true if nothing is there or a stale
+// socket, one nobody listens on, was removed. Otherwise false with errno
+// set, EADDRINUSE when a server listens there.
+bool ClaimSocket(const char *path);
+
+// Owns the panes of a session and shows them to one client at a time.
+//
+// The client gets the whole screen when it attaches and afterwards only
+// the cells that changed. Frames are compared with the last one sent, so a
+// client that falls behind skips intermediate frames instead of queueing
+// them.
+class SessionServer {
+
+  struct SessionServerImpl *m_impl = nullptr;
+
+  SessionServer();
+
+public:
+  SessionServer(const SessionServer &) = delete;
+  SessionServer &operator=(const SessionServer &) = delete;
+  // says BYE to the client and removes the socket
+  ~SessionServer();
+
+  // replaces a stale socket at path, never a file or a socket somebody
+  // listens on. nullptr on failure, with errno set.
+  static std::unique_ptr<SessionServer> Listen(const char *path);
+
+  // Forks the process that keeps the session, without a controlling
+  // terminal and with stdio on /dev/null. Returns 0 in that process, a
+  // negative value on failure and a positive one in the caller, whose copy
+  // must be destroyed without touching the socket. Call before the
+  // selector exists.
+  int Fork();
+
+  // handles what the last Select reported
+  void Dispatch();
+  bool Attached() const;
+  // true once after a client attached or resized its terminal
+  bool Resized(SIZE *size);
+  // moves the keys sent since the last call into inputs
+  void Inputs(std::vector<Input> *inputs);
+
+  // sends the layout if it changed and the cells that changed
+  void Send(const Layout &layout);
+  // sent with the next Send if it changed
+  void Status(const std::string &text);
+  // the next Send repeats everything
+  void Resend();
+  void Detach();
+};
+
+// The client side of a session.
+class SessionClient {
+
+  struct SessionClientImpl *m_impl = nullptr;
+
+  SessionClient();
+
+public:
+  SessionClient(const SessionClient &) = delete;
+  SessionClient &operator=(const SessionClient &) = delete;
+  ~SessionClient();
+
+  // nullptr if no server listens at path
+  static std::unique_ptr<SessionClient> Connect(const char *path);
+
+  // starts watching the server, call once the selector may be used
+  void Attach(const SIZE &size);
+  void Resize(const SIZE &size);
+  void Send(std::span<const Input> inputs);
+
+  // applies what the server sent. false once the connection is closed.
+  bool Receive(const SessionView &view);
+  // why the server closed the connection
+  BYE Reason() const;
+};
+
+} // namespace term_screen
@@ -0,0 +1,69 @@
+#include "shell_pool.h"
+#include "child_process.h"
+#include "timer_queue.h"
+#include <deque>
+
+namespace term_screen {
+
+struct ShellPoolImpl {
+  size_t m_count;
+  SIZE m_size;
+  const char *m_term;
+  std::deque<std::shared_ptr<Process>> m_ready;
+  TimerQueue::TimerId m_timer = 0;
+
+  ShellPoolImpl(size_t count, const SIZE &size, const char *term)
+      : m_count(count), m_size(size), m_term(term) {}
+
+  ~ShellPoolImpl() {
+    if (m_timer) {
+      TimerQueue::Instance().Cancel(m_timer);
+    }
+  }
+
+  // one shell per turn of the loop, so that a burst of splits is not slowed
+  // down by starting all of their replacements at once
+  void Refill() {
+    if (m_timer || m_ready.size() >= m_count) {
+      return;
+    }
+    m_timer = TimerQueue::Instance().Add(0, [this]() {
+      m_timer = 0;
+      if (auto process = Process::Fork(m_size, m_term)) {
+        m_ready.push_back(process);
+        Refill();
+      }
+    });
+  }
+};
+
+ShellPool::ShellPool(size_t count, const SIZE &size, const char *term)
+    : m_impl(new ShellPoolImpl(count, size, term)) {
+  m_impl->Refill();
+}
+
+ShellPool::~ShellPool() { delete m_impl; }
+
+std::shared_ptr<Process> ShellPool::Take(const SIZE &size) {
+  m_impl->m_size = size;
+  std::shared_ptr<Process> process;
+  while (!process && !m_impl->m_ready.empty()) {
+    process = m_impl->m_ready.front();
+    m_impl->m_ready.pop_front();
+    if (process->Exited()) {
+      // died waiting, its pty is closed with it
+      process.reset();
+    }
+  }
+  if (process) {
+    process->Resize(size);
+  } else {
+    process = Process::Fork(size, m_impl->m_term);
+  }
+  m_impl->Refill();
+  return process;
+}
+
+size_t ShellPool::Ready() const { return m_impl->m_ready.size(); }
+
+} // namespace term_screen
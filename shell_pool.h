@@ -0,0 +1,33 @@
+#pragma once
+#include "screen.h"
+#include <memory>
+#include <stddef.h>
+
+namespace term_screen {
+
+class Process;
+
+// Shells started ahead of time, so that a split does not wait for one.
+//
+// Every pooled shell runs on its own pty and prints its prompt into the
+// InputStream, where it waits for the pane. Take hands out the oldest one,
+// resized to the pane, and a replacement is started by a timer once the
+// pane has been drawn.
+class ShellPool {
+
+  struct ShellPoolImpl *m_impl = nullptr;
+
+public:
+  // size is a guess for the first pane, later ones get the last taken size
+  ShellPool(size_t count, const SIZE &size, const char *term);
+  ShellPool(const ShellPool &) = delete;
+  ShellPool &operator=(const ShellPool &) = delete;
+  ~ShellPool();
+
+  // a pooled shell, or a newly started one when the pool is empty
+  std::shared_ptr<Process> Take(const SIZE &size);
+  // shells ready to be taken
+  size_t Ready() const;
+};
+
+} // namespace term_screen
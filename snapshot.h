@@ -0,0 +1,75 @@
+#pragma once
+#include "grid_snapshot.h"
+#include "scrollback.h"
+#include <memory>
+#include <span>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace term_screen {
+
+enum PANE_MODE : uint32_t {
+  MODE_CURSOR_VISIBLE = 1 << 0,
+  MODE_ALTSCREEN = 1 << 1,
+  MODE_REVERSE = 1 << 2,
+  MODE_APPLICATION_CURSOR = 1 << 3,
+  MODE_ORIGIN = 1 << 4,
+  MODE_AUTOWRAP = 1 << 5,
+  MODE_NEWLINE = 1 << 6,
+  MODE_BRACKETED_PASTE = 1 << 7,
+};
+
+// the tables G0 to G3 can be designated to
+enum class CHARSET : uint8_t {
+  US,
+  UK,
+  GRAPH,
+};
+
+// What survives a restart of a pane. Its child does not.
+struct PANE_SNAPSHOT {
+  SIZE Size = {};
+  POS Cursor = {};
+  uint32_t Modes = MODE_CURSOR_VISIBLE | MODE_AUTOWRAP;
+  // columns with a tab stop, empty for the default of every eighth
+  std::vector<uint16_t> Tabs;
+  CHARSET Charsets[4] = {};
+  // which of G0 to G3 is in use
+  uint8_t Shift = 0;
+  // Size.Rows * Size.Cols
+  std::vector<CELL> Cells;
+  // written from, or restored into
+  Scrollback *History = nullptr;
+};
+
+// The layout and every pane of a session in one file.
+//
+// Write fills a temporary file with a few large sequential writes and
+// renames it over path, so that a mapped older snapshot stays intact. Open
+// maps the file, the histories are used in place and only decoded when a
+// line is shown.
+class Snapshot {
+
+  struct SnapshotImpl *m_impl = nullptr;
+
+  Snapshot();
+
+public:
+  Snapshot(const Snapshot &) = delete;
+  Snapshot &operator=(const Snapshot &) = delete;
+  ~Snapshot();
+
+  // shape is Layout::Shape, panes in the same order
+  static bool Write(const char *path, const std::string &shape,
+                    std::span<const PANE_SNAPSHOT> panes);
+  // nullptr if path is missing, of another version or malformed
+  static std::unique_ptr<Snapshot> Open(const char *path);
+
+  const std::string &Shape() const;
+  size_t Panes() const;
+  // maps the history into pane->History when it is set
+  bool Pane(size_t i, PANE_SNAPSHOT *pane) const;
+};
+
+} // namespace term_screen
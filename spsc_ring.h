@@ -0,0 +1,79 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <span>
+#include <stddef.h>
+#include <string.h>
+
+// A byte ring with one producer and one consumer thread.
+//
+// Neither side takes a lock or allocates after construction. The consumer
+// reads in place: Peek returns the contiguous readable bytes and Consume
+// releases them to the producer.
+class SpscRing {
+  std::unique_ptr<char[]> m_buffer;
+  size_t m_mask;
+  // written by the consumer
+  alignas(64) std::atomic<size_t> m_head{0};
+  // written by the producer
+  alignas(64) std::atomic<size_t> m_tail{0};
+  std::atomic<bool> m_closed{false};
+
+public:
+  // capacity is rounded up to a power of two
+  explicit SpscRing(size_t capacity) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_buffer.reset(new char[size]);
+    m_mask = size - 1;
+  }
+  SpscRing(const SpscRing &) = delete;
+  SpscRing &operator=(const SpscRing &) = delete;
+
+  size_t Capacity() const { return m_mask + 1; }
+
+  //
+  // producer
+  //
+  size_t Free() const {
+    return Capacity() - (m_tail.load(std::memory_order_relaxed) -
+                         m_head.load(std::memory_order_acquire));
+  }
+
+  // returns the number of bytes that fitted
+  size_t Write(std::span<const char> data) {
+    auto tail = m_tail.load(std::memory_order_relaxed);
+    auto n = std::min(data.size(), Free());
+    auto offset = tail & m_mask;
+    auto first = std::min(n, Capacity() - offset);
+    memcpy(m_buffer.get() + offset, data.data(), first);
+    memcpy(m_buffer.get(), data.data() + first, n - first);
+    m_tail.store(tail + n, std::memory_order_release);
+    return n;
+  }
+
+  // no more bytes will be written
+  void Close() { m_closed.store(true, std::memory_order_release); }
+
+  //
+  // consumer
+  //
+  bool Closed() const { return m_closed.load(std::memory_order_acquire); }
+
+  // bytes up to the end of the buffer, call again after Consume for the rest
+  std::span<const char> Peek() const {
+    auto head = m_head.load(std::memory_order_relaxed);
+    auto tail = m_tail.load(std::memory_order_acquire);
+    auto offset = head & m_mask;
+    return {m_buffer.get() + offset,
+            std::min(tail - head, Capacity() - offset)};
+  }
+
+  void Consume(size_t n) {
+    m_head.store(m_head.load(std::memory_order_relaxed) + n,
+                 std::memory_order_release);
+  }
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "screen.h"
+#include <string>
 #include <vector>
 
 namespace term_screen {
@@ -27,11 +28,20 @@ public:
     return s_instance;
   }
 
-  bool Initialize();
+  // headless keeps the screen in memory only, for a session server without
+  // a terminal
+  bool Initialize(bool headless = false);
   void RawMode();
   SIZE Size() const;
+  // adopts the current size of the host terminal
+  SIZE Resize();
+  // bytes the host terminal sent that nobody read yet
+  size_t Pending() const;
 
   short AllocPair(int fg, int bg);
+
+  // puts text on the clipboard of the host terminal with OSC 52
+  void Clipboard(const std::string &text);
 };
 
 } // namespace term_screen
@@ -0,0 +1,72 @@
+#include "timer_queue.h"
+#include <chrono>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+struct Deadline {
+  Clock::time_point Time;
+  TimerQueue::TimerId Id;
+
+  bool operator>(const Deadline &rhs) const {
+    return Time != rhs.Time ? Time > rhs.Time : Id > rhs.Id;
+  }
+};
+
+struct TimerQueueImpl {
+  TimerQueue::TimerId m_next = 1;
+  std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>>
+      m_deadlines;
+  // cancelled timers are dropped from here and skipped when they come due
+  std::unordered_map<TimerQueue::TimerId, std::function<void()>> m_callbacks;
+
+  void SkipCancelled() {
+    while (!m_deadlines.empty() &&
+           !m_callbacks.contains(m_deadlines.top().Id)) {
+      m_deadlines.pop();
+    }
+  }
+};
+
+TimerQueue::TimerQueue() : m_impl(new TimerQueueImpl) {}
+TimerQueue::~TimerQueue() { delete m_impl; }
+
+TimerQueue::TimerId TimerQueue::Add(int delay,
+                                    const std::function<void()> &callback) {
+  auto id = m_impl->m_next++;
+  m_impl->m_deadlines.push(
+      {Clock::now() + std::chrono::milliseconds(delay), id});
+  m_impl->m_callbacks.emplace(id, callback);
+  return id;
+}
+
+void TimerQueue::Cancel(TimerId id) { m_impl->m_callbacks.erase(id); }
+
+int TimerQueue::Timeout() const {
+  m_impl->SkipCancelled();
+  if (m_impl->m_deadlines.empty()) {
+    return -1;
+  }
+  auto left = std::chrono::ceil<std::chrono::milliseconds>(
+      m_impl->m_deadlines.top().Time - Clock::now());
+  return left.count() > 0 ? (int)left.count() : 0;
+}
+
+void TimerQueue::Run() {
+  auto now = Clock::now();
+  while (true) {
+    m_impl->SkipCancelled();
+    if (m_impl->m_deadlines.empty() || m_impl->m_deadlines.top().Time > now) {
+      break;
+    }
+    auto id = m_impl->m_deadlines.top().Id;
+    m_impl->m_deadlines.pop();
+    auto found = m_impl->m_callbacks.find(id);
+    auto callback = std::move(found->second);
+    m_impl->m_callbacks.erase(found);
+    // may add or cancel timers
+    callback();
+  }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <functional>
+#include <stdint.h>
+
+// One-shot timers run by the event loop.
+//
+// The loop waits at most Timeout() milliseconds and then calls Run(), which
+// fires every due timer. Only used from the main thread.
+class TimerQueue {
+
+  struct TimerQueueImpl *m_impl = nullptr;
+
+  TimerQueue();
+
+public:
+  using TimerId = uint64_t;
+
+  TimerQueue(const TimerQueue &) = delete;
+  TimerQueue &operator=(const TimerQueue &) = delete;
+  ~TimerQueue();
+
+  static TimerQueue &Instance() {
+    static TimerQueue s_instance;
+    return s_instance;
+  }
+
+  // delay in milliseconds
+  TimerId Add(int delay, const std::function<void()> &callback);
+  // does nothing if the timer already fired
+  void Cancel(TimerId id);
+
+  // milliseconds until the next timer, -1 if there is none
+  int Timeout() const;
+  void Run();
+};
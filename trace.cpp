@@ -0,0 +1,122 @@
+#include "trace.h"
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+std::atomic<bool> Trace::s_enabled = false;
+
+// events per thread, Write gets the last this many but one
+static const size_t RING_SIZE = 1 << 16;
+
+struct EVENT {
+  const char *Name;
+  uint32_t Arg;
+  Trace::Clock::time_point Start;
+  Trace::Clock::duration Duration;
+};
+
+struct RING {
+  uint32_t Tid;
+  std::unique_ptr<EVENT[]> Events{new EVENT[RING_SIZE]};
+  // events recorded so far, the next one goes to Count % RING_SIZE
+  std::atomic<uint64_t> Count = 0;
+};
+
+static std::mutex g_mutex;
+static std::string g_path;
+static Trace::Clock::time_point g_epoch;
+// never freed, a ring outlives its thread
+static std::vector<RING *> g_rings;
+static thread_local RING *t_ring = nullptr;
+
+static RING &ring() {
+  if (!t_ring) {
+    t_ring = new RING;
+    std::scoped_lock<std::mutex> lock(g_mutex);
+    t_ring->Tid = g_rings.size() + 1;
+    g_rings.push_back(t_ring);
+  }
+  return *t_ring;
+}
+
+void Trace::Start(const char *path) {
+  // the thread that starts is the first, named main
+  ring();
+  std::scoped_lock<std::mutex> lock(g_mutex);
+  g_path = path;
+  g_epoch = Clock::now();
+  s_enabled = true;
+}
+
+void Trace::Record(const char *name, uint32_t arg, Clock::time_point start,
+                   Clock::time_point end) {
+  auto &r = ring();
+  auto count = r.Count.load(std::memory_order_relaxed);
+  r.Events[count % RING_SIZE] = {name, arg, start, end - start};
+  r.Count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::Write() {
+  std::scoped_lock<std::mutex> lock(g_mutex);
+  if (g_path.empty()) {
+    return false;
+  }
+  auto tmp = g_path + ".tmp";
+  auto fp = fopen(tmp.c_str(), "w");
+  if (!fp) {
+    return false;
+  }
+  auto pid = (int)getpid();
+  fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  bool first = true;
+  std::vector<EVENT> events;
+  for (auto ring : g_rings) {
+    // copied while the thread may go on, what it overwrote meanwhile is
+    // left out. The slot of event Count is the one being written, that of
+    // Count - RING_SIZE, so the oldest event read is the one after it.
+    auto count = ring->Count.load(std::memory_order_acquire);
+    auto begin = count >= RING_SIZE ? count - RING_SIZE + 1 : 0;
+    events.clear();
+    for (auto i = begin; i < count; ++i) {
+      events.push_back(ring->Events[i % RING_SIZE]);
+    }
+    auto now = ring->Count.load(std::memory_order_acquire);
+    auto valid = now >= RING_SIZE ? now - RING_SIZE + 1 : 0;
+    if (valid > begin) {
+      events.erase(events.begin(),
+                   events.begin() + std::min<size_t>(valid - begin,
+                                                     events.size()));
+    }
+
+    char name[32] = "main";
+    if (ring->Tid > 1) {
+      snprintf(name, sizeof(name), "thread %u", ring->Tid);
+    }
+    fprintf(fp,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,"
+            "\"args\":{\"name\":\"%s\"}}",
+            first ? "" : ",\n", pid, ring->Tid, name);
+    first = false;
+    for (auto &e : events) {
+      auto ts = std::chrono::duration<double, std::micro>(e.Start - g_epoch);
+      auto dur = std::chrono::duration<double, std::micro>(e.Duration);
+      fprintf(fp,
+              ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f",
+              e.Name, pid, ring->Tid, ts.count(), dur.count());
+      if (e.Arg) {
+        fprintf(fp, ",\"args\":{\"pane\":%u}", e.Arg);
+      }
+      fputs("}", fp);
+    }
+  }
+  fprintf(fp, "\n]}\n");
+  if (fclose(fp) != 0) {
+    return false;
+  }
+  return rename(tmp.c_str(), g_path.c_str()) == 0;
+}
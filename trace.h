@@ -0,0 +1,64 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+
+// A timeline of the phases of the event loop and the parse workers, written
+// as Chrome trace events for chrome://tracing or Perfetto.
+//
+// Every thread records into a ring of its own, the oldest events are
+// overwritten. A phase is one complete event, its start and duration, so a
+// ring that wrapped never holds an end without its begin. Built without
+// HAVE_TRACING the TRACE macro is empty; built with it and not started, a
+// phase costs one load and a branch that is never taken.
+class Trace {
+public:
+  using Clock = std::chrono::steady_clock;
+
+private:
+  static std::atomic<bool> s_enabled;
+
+public:
+  static bool Enabled() {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+
+  // from the start on, path is where Write puts the events
+  static void Start(const char *path);
+  // name must be a literal, arg is shown when it is not 0
+  static void Record(const char *name, uint32_t arg, Clock::time_point start,
+                     Clock::time_point end);
+  // writes the events of every thread, false if the file could not be
+  // written; the events stay, a later Write includes them again
+  static bool Write();
+
+  class Scope {
+    const char *m_name;
+    uint32_t m_arg;
+    Clock::time_point m_start;
+
+  public:
+    explicit Scope(const char *name, uint32_t arg = 0)
+        : m_name(Enabled() ? name : nullptr), m_arg(arg) {
+      if (m_name) {
+        m_start = Clock::now();
+      }
+    }
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+    ~Scope() {
+      if (m_name) {
+        Record(m_name, m_arg, m_start, Clock::now());
+      }
+    }
+  };
+};
+
+#define TRACE_CONCAT2(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT2(a, b)
+#if HAVE_TRACING
+// times the rest of the enclosing block
+#define TRACE(...) Trace::Scope TRACE_CONCAT(trace_, __LINE__)(__VA_ARGS__)
+#else
+#define TRACE(...)
+#endif
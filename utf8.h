@@ -0,0 +1,39 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// The UTF-8 encoder of everything that turns cells back into text.
+
+// writes c to out, which has room for 4 bytes, and returns the length
+inline size_t encodeutf8(uint32_t c, char *out) {
+  if (c < 0x80) {
+    out[0] = (char)c;
+    return 1;
+  }
+  if (c < 0x800) {
+    out[0] = (char)(0xc0 | (c >> 6));
+    out[1] = (char)(0x80 | (c & 0x3f));
+    return 2;
+  }
+  if (c < 0x10000) {
+    out[0] = (char)(0xe0 | (c >> 12));
+    out[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+    out[2] = (char)(0x80 | (c & 0x3f));
+    return 3;
+  }
+  out[0] = (char)(0xf0 | ((c >> 18) & 0x07));
+  out[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+  out[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+  out[3] = (char)(0x80 | (c & 0x3f));
+  return 4;
+}
+
+// appends c to a std::string or a std::vector<char>
+template <typename T> void pututf8(T &out, uint32_t c) {
+  if (c < 0x80) {
+    out.push_back((char)c);
+    return;
+  }
+  char bytes[4];
+  out.insert(out.end(), bytes, bytes + encodeutf8(c, bytes));
+}
@@ -243,4 +243,16 @@ void Process::Resize(const SIZE &size) {
   m_impl->Resize({.X = (short)size.Cols, .Y = (short)size.Rows});
 }
 
+bool Process::Exited(int *status) const {
+  DWORD code;
+  if (!GetExitCodeProcess(m_impl->m_pi.hProcess, &code) ||
+      code == STILL_ACTIVE) {
+    return false;
+  }
+  if (status) {
+    *status = (int)code;
+  }
+  return true;
+}
+
 } // namespace term_screen
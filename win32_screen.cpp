@@ -19,5 +19,11 @@ void SCRN::MoveCursor(const POS &pos) {}
 void SCRN::Scroll(int d) {}
 void SCRN::Update() {}
 void SCRN::WriteCell(const POS &pos, wchar_t ch, int fg, int bg) {}
+void SCRN::Reverse(const POS &pos, int cols) {}
+size_t SCRN::Bytes() const { return 0; }
+
+void DrawVLine(const POS &pos, uint16_t rows) {}
+void DrawHLine(const POS &pos, uint16_t cols) {}
+void DrawStatus(const POS &pos, uint16_t cols, const char *text) {}
 
 } // namespace term_screen
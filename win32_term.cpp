@@ -93,11 +93,14 @@ Term::Term() : m_impl(new TermImpl) {}
 
 Term::~Term() { delete m_impl; }
 
-bool Term::Initialize() { return true; }
+bool Term::Initialize(bool headless) { return true; }
 
 void Term::RawMode() { m_impl->RawMode(); }
 
 SIZE Term::Size() const { return {}; }
+SIZE Term::Resize() { return Size(); }
+size_t Term::Pending() const { return 0; }
 short Term::AllocPair(int fg, int bg) { return {}; }
+void Term::Clipboard(const std::string &text) {}
 
 } // namespace term_screen